@@ -4,9 +4,13 @@
 
 //#include "Renderer\Commands\CommandGroupWriter.h"
 
+#include "Core\JobManager.h"
+
 #include "Core\Allocators\FreeListAllocator.h"
 #include "Core\Allocators\DynamicLinearAllocator.h"
 #include "Core\Allocators\ProxyAllocator.h"
+#include "Core\Allocators\FrameScratchAllocators.h"
+#include "Core\Allocators\AllocationGuard.h"
 
 //#include "Core\Allocators\BlockAllocator.h"
 //#include "Core\Allocators\BlockAllocatorProxy.h"
@@ -26,7 +30,8 @@ LRESULT CALLBACK WindowProc(HWND hWnd, u32 message, WPARAM wParam, LPARAM lParam
 #endif
 
 AquaGame::AquaGame() : _title("Title not found!"), _state(GAME_STATE::GAME_RUNNING),
-					   _wnd_width(1280), _wnd_height(720), _main_allocator(nullptr)
+					   _wnd_width(1280), _wnd_height(720), _main_allocator(nullptr),
+					   _frame_scratch_allocators(nullptr), _seal_frames(false)
 {
 	for(u32 i = 0; i < NUM_KEYS; i++)
 	{
@@ -105,6 +110,12 @@ bool AquaGame::init()
 	else
 		Logger::get().write(MESSAGE_LEVEL::INFO_MESSAGE, CHANNEL::GENERAL, "Config loaded!");
 
+	//After loadConfig (sets the number of workers). One allocator per worker + THREAD_ID 0
+	_frame_scratch_allocators = allocator::allocateNew<FrameScratchAllocators>(*_main_allocator, *_main_allocator,
+																			   (u8)(JobManager::get().getNumWorkers() + 1));
+
+	ASSERT(_frame_scratch_allocators != nullptr);
+
 	if(!createWindow())
 	{
 		Logger::get().write(MESSAGE_LEVEL::ERROR_MESSAGE, CHANNEL::GENERAL, "Error creating window!");
@@ -113,7 +124,7 @@ bool AquaGame::init()
 
 	Logger::get().write(MESSAGE_LEVEL::INFO_MESSAGE, CHANNEL::GENERAL, "Window created!");
 
-	_renderer_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator);
+	_renderer_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator, "renderer");
 
 	ASSERT(_renderer_allocator != nullptr);
 	
@@ -207,7 +218,63 @@ bool AquaGame::loadConfig()
 	else
 		_wnd_height = static_cast<int>(lua_tointeger(_lua_state, -1));
 
-	lua_pop(_lua_state, 4); //pop title, width and height and config table
+	//Job system (optional, defaults to one worker per logical CPU)
+	JobManagerConfig jobs_config;
+
+	lua_getfield(_lua_state, -4, "num_workers");
+
+	if(lua_isnumber(_lua_state, -1))
+		jobs_config.num_workers = static_cast<u32>(lua_tointeger(_lua_state, -1));
+
+	lua_getfield(_lua_state, -5, "worker_placement");
+
+	if(lua_isstring(_lua_state, -1))
+	{
+		const char* placement = lua_tostring(_lua_state, -1);
+
+		if(strcmp(placement, "physical_core") == 0)
+			jobs_config.placement = WorkerPlacement::PHYSICAL_CORE;
+		else if(strcmp(placement, "node") == 0)
+			jobs_config.placement = WorkerPlacement::NODE;
+		else if(strcmp(placement, "default") != 0)
+			Logger::get().write(MESSAGE_LEVEL::WARNING_MESSAGE, CHANNEL::GENERAL, "Unknown 'worker_placement' %s!", placement);
+	}
+
+	lua_getfield(_lua_state, -6, "worker_node");
+
+	if(lua_isnumber(_lua_state, -1))
+		jobs_config.node = static_cast<u32>(lua_tointeger(_lua_state, -1));
+
+	lua_getfield(_lua_state, -7, "free_cores");
+
+	if(lua_isnumber(_lua_state, -1))
+		jobs_config.num_free_cores = static_cast<u32>(lua_tointeger(_lua_state, -1));
+
+	JobManager::get().init(jobs_config);
+
+	lua_getfield(_lua_state, -8, "allocation_guard");
+
+	if(lua_isstring(_lua_state, -1))
+	{
+		const char* mode = lua_tostring(_lua_state, -1);
+
+#if AQUA_ALLOCATION_GUARD
+		if(strcmp(mode, "record") == 0 || strcmp(mode, "assert") == 0)
+		{
+			_seal_frames = true;
+			allocation_guard::setAssertOnViolation(strcmp(mode, "assert") == 0);
+		}
+		else if(strcmp(mode, "off") != 0)
+		{
+			Logger::get().write(MESSAGE_LEVEL::WARNING_MESSAGE, CHANNEL::GENERAL, "Unknown allocation_guard '%s'!", mode);
+		}
+#else
+		if(strcmp(mode, "off") != 0)
+			Logger::get().write(MESSAGE_LEVEL::WARNING_MESSAGE, CHANNEL::GENERAL, "allocation_guard needs a debug or development build!");
+#endif
+	}
+
+	lua_pop(_lua_state, 9); //pop title, width, height, job system fields, allocation guard and config table
 
 	script_utilities::unloadScript(_lua_state, "data/config.lua");
 
@@ -234,6 +301,11 @@ int AquaGame::render()
 
 	//_temp_allocator->clear();
 	_scratchpad_allocator->clear();
+	_frame_scratch_allocators->reset();
+
+#if AQUA_ALLOCATOR_TELEMETRY
+	allocator_telemetry::nextFrame();
+#endif
 
 	return 1;
 }
@@ -294,12 +366,19 @@ bool AquaGame::render(Camera& camera, int generator)
 	_renderer.present();
 
 	_scratchpad_allocator->clear();
+	_frame_scratch_allocators->reset();
+
+#if AQUA_ALLOCATOR_TELEMETRY
+	allocator_telemetry::nextFrame();
+#endif
 
 	return true;
 }
 
 int AquaGame::shutdown()
 {
+	JobManager::get().stop();
+
 	//_texture_manager.shutdown();
 
 #if _DEBUG
@@ -332,6 +411,9 @@ int AquaGame::shutdown()
 
 		if(_scratchpad_allocator != nullptr)
 			allocator::deallocateDelete(*_main_allocator, _scratchpad_allocator);
+
+		if(_frame_scratch_allocators != nullptr)
+			allocator::deallocateDelete(*_main_allocator, _frame_scratch_allocators);
 		/*
 		if(_temp_allocator != nullptr)
 		allocator::deallocateDelete(*_main_allocator, _temp_allocator);
@@ -367,6 +449,11 @@ Timer* AquaGame::getTimer()
 	return &_timer;
 }
 
+FrameScratchAllocators& AquaGame::getFrameScratchAllocators()
+{
+	return *_frame_scratch_allocators;
+}
+
 void AquaGame::setGameState(GAME_STATE state)
 {
 	_state = state;
@@ -397,7 +484,19 @@ int AquaGame::run()
 
 			if(_state == GAME_STATE::GAME_RUNNING)
 			{
-				update(_timer.getElapsedTime());
+#if AQUA_ALLOCATION_GUARD
+				if(_seal_frames)
+				{
+					//Frames must not allocate from the main allocator (every thread), until present
+					AllocationSealScope seal(*_main_allocator);
+
+					update(_timer.getElapsedTime());
+				}
+				else
+#endif
+				{
+					update(_timer.getElapsedTime());
+				}
 
 				for(u32 i = 0; i < NUM_KEYS; i++)
 				{
@@ -413,8 +512,21 @@ int AquaGame::run()
 
 	}
 
+#if AQUA_ALLOCATION_GUARD
+	u32 num_violations = allocation_guard::getNumViolations();
+
+	if(num_violations > 0)
+		Logger::get().write(MESSAGE_LEVEL::ERROR_MESSAGE, CHANNEL::GENERAL, "%u allocations in sealed frames!", num_violations);
+#endif
+
 	shutdown();
 
+#if AQUA_ALLOCATION_GUARD
+	//Headless CI runs fail if a sealed frame allocated
+	if(_seal_frames && num_violations > 0)
+		return EXIT_FAILURE;
+#endif
+
 	return (int)msg.wParam;
 #endif
 }
@@ -44,6 +44,7 @@ namespace aqua
 	class SmallBlockAllocator;
 	class DynamicLinearAllocator;
 	class ProxyAllocator;
+	class FrameScratchAllocators;
 
 	//class CommandGroupWriter;
 
@@ -69,6 +70,9 @@ namespace aqua
 
 		Timer* getTimer();
 
+		//Per thread scratch memory for jobs, reset every frame
+		FrameScratchAllocators& getFrameScratchAllocators();
+
 		/*
 		enum KeyState : u8
 		{
@@ -94,6 +98,7 @@ namespace aqua
 		Allocator*                 _main_allocator;
 		DynamicLinearAllocator*    _scratchpad_allocator;
 		ProxyAllocator*            _renderer_allocator;
+		FrameScratchAllocators*    _frame_scratch_allocators;
 
 		lua_State*                 _lua_state;
 
@@ -117,6 +122,8 @@ namespace aqua
 
 		WindowH                    _wnd;
 
+		bool                       _seal_frames;   //config.lua allocation_guard
+
 		//bool _keys_state[256];
 	};
 };
\ No newline at end of file
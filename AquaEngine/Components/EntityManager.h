@@ -39,6 +39,9 @@ namespace aqua
 		}
 
 		friend class EntityManager;
+
+		template<class V>
+		friend class EntitySparseSet;
 	};
 
 	inline bool operator==(const Entity& x, const Entity& y)
@@ -0,0 +1,246 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "EntityManager.h"
+
+#include "..\Core\Allocators\Allocator.h"
+
+#include "..\Utilities\PointerMath.h"
+
+#include "..\AquaTypes.h"
+
+namespace aqua
+{
+	//Maps entities to component instances (dense SoA index) with a sparse array indexed by Entity::index().
+	//The sparse array is split in pages of PAGE_SIZE entries allocated when an entity of the page is inserted.
+	//Entries store the whole entity id, so a lookup is: page table load, entry load, compare with the entity
+	//(stale handles of destroyed entities don't match because the generation changed).
+	//Unused entries (and pages, which point to a shared empty page) store an id that can't match any entity that
+	//maps to them, so lookups don't branch on empty pages or entries.
+	//V must be trivially copyable (u32, Instance handles, ...).
+	template<class V>
+	class EntitySparseSet
+	{
+	public:
+		EntitySparseSet(Allocator& allocator);
+		~EntitySparseSet();
+
+		bool has(Entity e) const;
+
+		//Returns the value stored for e, or default_value if e isn't in the set
+		const V& lookup(Entity e, const V& default_value) const;
+
+		//out[i] = lookup(entities[i], default_value), prefetches the entries of several entities before resolving them
+		void lookupBatch(const Entity* entities, size_t n, V* out, const V& default_value) const;
+
+		//Replaces the value if e is already in the set
+		void insert(Entity e, const V& value);
+
+		bool remove(Entity e);
+
+		//Swap-remove of the SoA arrays: last_e was moved to e's instance, so last_e gets e's value and e is removed.
+		//Same as insert(last_e, lookup(e)); remove(e); (works when e == last_e)
+		void swapRemove(Entity e, Entity last_e);
+
+		void clear();
+
+		u32 size() const;
+
+	private:
+		EntitySparseSet(const EntitySparseSet&);
+		EntitySparseSet& operator=(const EntitySparseSet&);
+
+		static const u32 PAGE_SHIFT        = 12;
+		static const u32 PAGE_SIZE         = 1 << PAGE_SHIFT;
+		static const u32 PAGE_MASK         = PAGE_SIZE - 1;
+		static const u32 NUM_PAGES         = 1 << (Entity::NUM_INDEX_BITS - PAGE_SHIFT);
+
+		static const u32 LOOKUP_BATCH_SIZE = 16;
+
+		struct Entry
+		{
+			u32 id;
+			V   value;
+		};
+
+		//Index bits differ from every entity index that maps to entry i of a page
+		static u32 getEmptyId(u32 i)
+		{
+			return (i & PAGE_MASK) ^ 1;
+		}
+
+		const Entry& getEntry(Entity e) const
+		{
+			u32 index = e.index();
+
+			return _pages[index >> PAGE_SHIFT][index & PAGE_MASK];
+		}
+
+		Entry* allocatePage();
+
+		Allocator& _allocator;
+
+		Entry**    _pages;       //NUM_PAGES, unused pages point to _empty_page
+		Entry*     _empty_page;
+
+		u32        _size;
+	};
+
+	//Definitions
+
+	template<class V>
+	EntitySparseSet<V>::EntitySparseSet(Allocator& allocator) : _allocator(allocator), _size(0)
+	{
+		_empty_page = allocatePage();
+
+		_pages = allocator::allocateArrayNoConstruct<Entry*>(_allocator, NUM_PAGES);
+
+		for(u32 i = 0; i < NUM_PAGES; i++)
+			_pages[i] = _empty_page;
+	}
+
+	template<class V>
+	EntitySparseSet<V>::~EntitySparseSet()
+	{
+		for(u32 i = 0; i < NUM_PAGES; i++)
+		{
+			if(_pages[i] != _empty_page)
+				_allocator.deallocate(_pages[i]);
+		}
+
+		allocator::deallocateArrayNoDestruct(_allocator, _pages);
+
+		_allocator.deallocate(_empty_page);
+	}
+
+	template<class V>
+	typename EntitySparseSet<V>::Entry* EntitySparseSet<V>::allocatePage()
+	{
+		Entry* page = (Entry*)_allocator.allocate(PAGE_SIZE * sizeof(Entry), __alignof(Entry));
+
+		ASSERT(page != nullptr);
+
+		for(u32 i = 0; i < PAGE_SIZE; i++)
+			page[i].id = getEmptyId(i);
+
+		return page;
+	}
+
+	template<class V>
+	bool EntitySparseSet<V>::has(Entity e) const
+	{
+		return getEntry(e).id == (u32)e;
+	}
+
+	template<class V>
+	const V& EntitySparseSet<V>::lookup(Entity e, const V& default_value) const
+	{
+		const Entry& entry = getEntry(e);
+
+		return entry.id == (u32)e ? entry.value : default_value;
+	}
+
+	template<class V>
+	void EntitySparseSet<V>::lookupBatch(const Entity* entities, size_t n, V* out, const V& default_value) const
+	{
+		const Entry* entries[LOOKUP_BATCH_SIZE];
+
+		for(size_t first = 0; first < n; first += LOOKUP_BATCH_SIZE)
+		{
+			size_t count = n - first < LOOKUP_BATCH_SIZE ? n - first : LOOKUP_BATCH_SIZE;
+
+			for(size_t i = 0; i < count; i++)
+			{
+				entries[i] = &getEntry(entities[first + i]);
+
+				pointer_math::prefetch(entries[i]);
+			}
+
+			for(size_t i = 0; i < count; i++)
+				out[first + i] = entries[i]->id == (u32)entities[first + i] ? entries[i]->value : default_value;
+		}
+	}
+
+	template<class V>
+	void EntitySparseSet<V>::insert(Entity e, const V& value)
+	{
+		u32 index = e.index();
+
+		Entry*& page = _pages[index >> PAGE_SHIFT];
+
+		if(page == _empty_page)
+			page = allocatePage();
+
+		Entry& entry = page[index & PAGE_MASK];
+
+		if(entry.id != (u32)e)
+		{
+			//Entries of older generations are overwritten
+			if(entry.id == getEmptyId(index))
+				_size++;
+
+			entry.id = e;
+		}
+
+		entry.value = value;
+	}
+
+	template<class V>
+	bool EntitySparseSet<V>::remove(Entity e)
+	{
+		u32 index = e.index();
+
+		Entry& entry = _pages[index >> PAGE_SHIFT][index & PAGE_MASK];
+
+		if(entry.id != (u32)e)
+			return false;
+
+		entry.id = getEmptyId(index);
+
+		_size--;
+
+		return true;
+	}
+
+	template<class V>
+	void EntitySparseSet<V>::swapRemove(Entity e, Entity last_e)
+	{
+		u32 index      = e.index();
+		u32 last_index = last_e.index();
+
+		Entry& entry      = _pages[index >> PAGE_SHIFT][index & PAGE_MASK];
+		Entry& last_entry = _pages[last_index >> PAGE_SHIFT][last_index & PAGE_MASK];
+
+		ASSERT("Entity not in set" && entry.id == (u32)e && last_entry.id == (u32)last_e);
+
+		last_entry.value = entry.value;
+
+		entry.id = getEmptyId(index);
+
+		_size--;
+	}
+
+	template<class V>
+	void EntitySparseSet<V>::clear()
+	{
+		for(u32 i = 0; i < NUM_PAGES; i++)
+		{
+			if(_pages[i] != _empty_page)
+			{
+				_allocator.deallocate(_pages[i]);
+				_pages[i] = _empty_page;
+			}
+		}
+
+		_size = 0;
+	}
+
+	template<class V>
+	u32 EntitySparseSet<V>::size() const
+	{
+		return _size;
+	}
+};
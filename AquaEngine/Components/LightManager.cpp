@@ -9,6 +9,8 @@
 
 #include "..\Renderer\RenderDevice\RenderDeviceDescs.h"
 
+#include "..\Core\JobManager.h"
+
 #include "..\Utilities\Blob.h"
 #include "..\Utilities\StringID.h"
 #include "..\Utilities\half.h"
@@ -23,8 +25,10 @@ using namespace aqua;
 
 const LightManager::Instance LightManager::INVALID_INSTANCE = { LightType::DIRECTIONAL, INVALID_INDEX };
 
-LightManager::LightManager(Allocator& allocator, TransformManager& transform, Renderer& renderer, u32 inital_capacity)
-	: _allocator(allocator), _map(allocator), _transform_manager(transform), _renderer(&renderer)
+LightManager::LightManager(Allocator& allocator, TransformManager& transform, Renderer& renderer, u32 inital_capacity,
+						   Allocator* data_allocator)
+	: _allocator(allocator), _data_allocator(data_allocator != nullptr ? *data_allocator : allocator), _map(allocator),
+	_transform_manager(transform), _renderer(&renderer)
 {
 	_directional_lights_data.count    = 0;
 	_directional_lights_data.capacity = 0;
@@ -241,13 +245,13 @@ LightManager::~LightManager()
 	//--------------------
 
 	if(_directional_lights_data.capacity > 0)
-		_allocator.deallocate(_directional_lights_data.buffer);
+		_data_allocator.deallocate(_directional_lights_data.buffer);
 
 	if(_point_lights_data.capacity > 0)
-		_allocator.deallocate(_point_lights_data.buffer);
+		_data_allocator.deallocate(_point_lights_data.buffer);
 
 	if(_spot_lights_data.capacity > 0)
-		_allocator.deallocate(_spot_lights_data.buffer);
+		_data_allocator.deallocate(_spot_lights_data.buffer);
 }
 
 #define COLOR( r, g, b, a ) (DWORD)(((a) << 24) | ((b) << 16) | ((g) << 8) | (r))
@@ -547,6 +551,11 @@ LightManager::Instance LightManager::lookup(Entity e)
 	return _map.lookup(e, INVALID_INSTANCE);
 }
 
+void LightManager::lookupBatch(const Entity* entities, u32 count, Instance* out)
+{
+	_map.lookupBatch(entities, count, out, INVALID_INSTANCE);
+}
+
 void LightManager::destroy(Instance i)
 {
 	LightType type = i.getType();
@@ -605,14 +614,14 @@ void LightManager::destroy(Instance i)
 		ASSERT("Invalid light type" && false);
 	}
 
-	_map.insert(last_e, i);
-	_map.remove(e);
+	_map.swapRemove(e, last_e);
 }
 
 void LightManager::update()
 {
 	const Vector3 default_dir(0.0f, 0.0f, 1.0f);
 
+	//Few directional lights, not worth splitting
 	for(u32 i = 0; i < _directional_lights_data.count; i++)
 	{
 		TransformManager::Instance transform = _transform_manager.lookup(_directional_lights_data.entity[i]);
@@ -623,110 +632,132 @@ void LightManager::update()
 		_directional_lights_data.direction[i].Normalize();
 	}
 
-	for(u32 i = 0; i < _point_lights_data.count; i++)
+	JobManager::get().parallelFor(0, _point_lights_data.count, 64, [&](u32 begin, u32 end)
 	{
-		TransformManager::Instance transform = _transform_manager.lookup(_point_lights_data.entity[i]);
+		TransformManager::Instance transforms[LOOKUP_BATCH_SIZE];
 
-		ASSERT(transform.valid());
+		for(u32 i = begin; i < end; i++)
+		{
+			u32 k = (i - begin) % LOOKUP_BATCH_SIZE;
 
-		Vector3 position = Vector3::Transform(Vector3(0.0f, 0.0f, 0.0f), _transform_manager.getWorld(transform));
+			//Lookup the transforms of the next LOOKUP_BATCH_SIZE lights at once
+			if(k == 0)
+				_transform_manager.lookupBatch(&_point_lights_data.entity[i], end - i < LOOKUP_BATCH_SIZE ? end - i : LOOKUP_BATCH_SIZE, transforms);
 
-		_point_lights_data.position_radius[i].x = position.x;
-		_point_lights_data.position_radius[i].y = position.y;
-		_point_lights_data.position_radius[i].z = position.z;
-	}
+			TransformManager::Instance transform = transforms[k];
+
+			ASSERT(transform.valid());
+
+			Vector3 position = Vector3::Transform(Vector3(0.0f, 0.0f, 0.0f), _transform_manager.getWorld(transform));
+
+			_point_lights_data.position_radius[i].x = position.x;
+			_point_lights_data.position_radius[i].y = position.y;
+			_point_lights_data.position_radius[i].z = position.z;
+		}
+	});
 
-	for(u32 i = 0; i < _spot_lights_data.count; i++)
+	JobManager::get().parallelFor(0, _spot_lights_data.count, 32, [&](u32 begin, u32 end)
 	{
-		TransformManager::Instance transform = _transform_manager.lookup(_spot_lights_data.entity[i]);
+		TransformManager::Instance transforms[LOOKUP_BATCH_SIZE];
 
-		ASSERT(transform.valid());
+		for(u32 i = begin; i < end; i++)
+		{
+			u32 k = (i - begin) % LOOKUP_BATCH_SIZE;
+
+			//Lookup the transforms of the next LOOKUP_BATCH_SIZE lights at once
+			if(k == 0)
+				_transform_manager.lookupBatch(&_spot_lights_data.entity[i], end - i < LOOKUP_BATCH_SIZE ? end - i : LOOKUP_BATCH_SIZE, transforms);
 
-		const Matrix4x4& world = _transform_manager.getWorld(transform);
+			TransformManager::Instance transform = transforms[k];
 
-		Vector3 position  = Vector3::Transform(Vector3(0.0f, 0.0f, 0.0f), world);
-		Vector3 direction = world.Backward();
-		direction.Normalize();
+			ASSERT(transform.valid());
+
+			const Matrix4x4& world = _transform_manager.getWorld(transform);
+
+			Vector3 position  = Vector3::Transform(Vector3(0.0f, 0.0f, 0.0f), world);
+			Vector3 direction = world.Backward();
+			direction.Normalize();
 
 #if SPOT_PARAMS_HALF
 
-	#if SPHEREMAP_ENCODE
+		#if SPHEREMAP_ENCODE
 
-			//encode direction
-			float p = sqrt(direction.z*8+8);
-			Vector2 enc(direction.x/p + 0.5f,direction.y/p + 0.5f);
+				//encode direction
+				float p = sqrt(direction.z*8+8);
+				Vector2 enc(direction.x/p + 0.5f,direction.y/p + 0.5f);
 
-			_spot_lights_data.params[i].light_dir_x = half_from_float(enc.x);
-			_spot_lights_data.params[i].light_dir_y = half_from_float(enc.y);
+				_spot_lights_data.params[i].light_dir_x = half_from_float(enc.x);
+				_spot_lights_data.params[i].light_dir_y = half_from_float(enc.y);
 
-			//decode direction and use decoded directon to prevent errors
-			enc.x = half_to_float(_spot_lights_data.params[i].light_dir_x);
-			enc.y = half_to_float(_spot_lights_data.params[i].light_dir_y);
+				//decode direction and use decoded directon to prevent errors
+				enc.x = half_to_float(_spot_lights_data.params[i].light_dir_x);
+				enc.y = half_to_float(_spot_lights_data.params[i].light_dir_y);
 
-			Vector2 fenc = enc * 4 - Vector2(2.0f, 2.0f);
-			float f      = fenc.Dot(fenc);
-			float g      = sqrt(1 - f / 4);
+				Vector2 fenc = enc * 4 - Vector2(2.0f, 2.0f);
+				float f      = fenc.Dot(fenc);
+				float g      = sqrt(1 - f / 4);
 
-			Vector3 unpacked_dir(fenc.x*g, fenc.y*g, 1 - f / 2);
+				Vector3 unpacked_dir(fenc.x*g, fenc.y*g, 1 - f / 2);
 
-	#else
+		#else
 
-			_spot_lights_data.params[i].light_dir_x = half_from_float(direction.x);
-			_spot_lights_data.params[i].light_dir_y = half_from_float(direction.y);
+				_spot_lights_data.params[i].light_dir_x = half_from_float(direction.x);
+				_spot_lights_data.params[i].light_dir_y = half_from_float(direction.y);
 
-			Vector3 unpacked_dir;
-			unpacked_dir.x = half_to_float(_spot_lights_data.params[i].light_dir_x);
-			unpacked_dir.y = half_to_float(_spot_lights_data.params[i].light_dir_y);
+				Vector3 unpacked_dir;
+				unpacked_dir.x = half_to_float(_spot_lights_data.params[i].light_dir_x);
+				unpacked_dir.y = half_to_float(_spot_lights_data.params[i].light_dir_y);
 
-			float temp = 1.0f - unpacked_dir.x*unpacked_dir.x - unpacked_dir.y*unpacked_dir.y;
+				float temp = 1.0f - unpacked_dir.x*unpacked_dir.x - unpacked_dir.y*unpacked_dir.y;
 
-			unpacked_dir.z = sqrt(temp > 0 ? temp : 0.0f);
+				unpacked_dir.z = sqrt(temp > 0 ? temp : 0.0f);
 
-			if(direction.z < 0.0f)
-				unpacked_dir.z = -unpacked_dir.z;
+				if(direction.z < 0.0f)
+					unpacked_dir.z = -unpacked_dir.z;
 
-	#endif
+		#endif
 
 #else
-		_spot_lights_data.params[i].light_dir_x = direction.x;
-		_spot_lights_data.params[i].light_dir_y = direction.y;
+			_spot_lights_data.params[i].light_dir_x = direction.x;
+			_spot_lights_data.params[i].light_dir_y = direction.y;
 
-		Vector3 unpacked_dir = direction;
+			Vector3 unpacked_dir = direction;
 #endif
 
-		//-----------
+			//-----------
 
-		//Vector4 pos_radius(position.x, position.y, position.z,
-		//				   half_to_float(_spot_lights_data.params[i].falloff_radius));
+			//Vector4 pos_radius(position.x, position.y, position.z,
+			//				   half_to_float(_spot_lights_data.params[i].falloff_radius));
 
-		Vector4 pos_radius(position.x, position.y, position.z, _spot_lights_data.radius[i]);
+			Vector4 pos_radius(position.x, position.y, position.z, _spot_lights_data.radius[i]);
 
-		_spot_lights_data.position_radius[i] = calculateSpotLightBoundingSphere(pos_radius, unpacked_dir,
-																				_spot_lights_data.angle[i]);
+			_spot_lights_data.position_radius[i] = calculateSpotLightBoundingSphere(pos_radius, unpacked_dir,
+																					_spot_lights_data.angle[i]);
 
 #if !SPHEREMAP_ENCODE
-		// put the sign bit for light dir z in the sign bit for the cone angle
-		// (we can do this because we know the cone angle is always positive)
-		if(unpacked_dir.z < 0.0f)
-		{
+			// put the sign bit for light dir z in the sign bit for the cone angle
+			// (we can do this because we know the cone angle is always positive)
+			if(unpacked_dir.z < 0.0f)
+			{
 #if SPOT_PARAMS_HALF
-			_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign |= 0x8000;
+				_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign |= 0x8000;
 #else
-			if(_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign > 0)
-				_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign = -_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign;
+				if(_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign > 0)
+					_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign = -_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign;
 #endif
-		}
-		else
-		{
+			}
+			else
+			{
 #if SPOT_PARAMS_HALF
-			_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign &= 0x7FFF;
+				_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign &= 0x7FFF;
 #else
-			if(_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign < 0)
-				_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign = -_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign;
+				if(_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign < 0)
+					_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign = -_spot_lights_data.params[i].cosine_of_cone_angle_light_dir_zsign;
 #endif
-		}
+			}
 #endif
-	}
+		}
+	});
 }
 
 void LightManager::setColor(Instance i, u8 red, u8 green, u8 blue, u8 intensity)
@@ -827,7 +858,7 @@ void LightManager::setCapacity(u32 new_capacity)
 	new_data.count = _directional_lights_data.count;
 	new_data.capacity = new_capacity;
 
-	new_data.buffer = allocateBlob(_allocator, new_capacity, new_data.entity, new_data.direction, new_data.color);
+	new_data.buffer = allocateBlob(_data_allocator, new_capacity, new_data.entity, new_data.direction, new_data.color);
 
 	//CHECK IF ALL ARRAYS ARE PROPERLY ALIGNED
 	ASSERT(pointer_math::isAligned(new_data.entity));
@@ -842,7 +873,7 @@ void LightManager::setCapacity(u32 new_capacity)
 	}
 
 	if(_directional_lights_data.capacity > 0)
-		_allocator.deallocate(_directional_lights_data.buffer);
+		_data_allocator.deallocate(_directional_lights_data.buffer);
 
 	_directional_lights_data = new_data;
 }
@@ -853,7 +884,7 @@ void LightManager::setDirectionalLightsCapacity(u32 new_capacity)
 	new_data.count = _directional_lights_data.count;
 	new_data.capacity = new_capacity;
 
-	new_data.buffer = allocateBlob(_allocator, new_capacity, new_data.entity, new_data.direction, new_data.color);
+	new_data.buffer = allocateBlob(_data_allocator, new_capacity, new_data.entity, new_data.direction, new_data.color);
 
 	//CHECK IF ALL ARRAYS ARE PROPERLY ALIGNED
 	ASSERT(pointer_math::isAligned(new_data.entity));
@@ -868,7 +899,7 @@ void LightManager::setDirectionalLightsCapacity(u32 new_capacity)
 	}
 
 	if(_directional_lights_data.capacity > 0)
-		_allocator.deallocate(_directional_lights_data.buffer);
+		_data_allocator.deallocate(_directional_lights_data.buffer);
 
 	_directional_lights_data = new_data;
 }
@@ -879,7 +910,7 @@ void LightManager::setPointLightsCapacity(u32 new_capacity)
 	new_data.count = _point_lights_data.count;
 	new_data.capacity = new_capacity;
 
-	new_data.buffer = allocateBlob(_allocator, new_capacity, new_data.entity, new_data.position_radius, new_data.color);
+	new_data.buffer = allocateBlob(_data_allocator, new_capacity, new_data.entity, new_data.position_radius, new_data.color);
 
 	//CHECK IF ALL ARRAYS ARE PROPERLY ALIGNED
 	ASSERT(pointer_math::isAligned(new_data.entity));
@@ -894,7 +925,7 @@ void LightManager::setPointLightsCapacity(u32 new_capacity)
 	}
 
 	if(_point_lights_data.capacity > 0)
-		_allocator.deallocate(_point_lights_data.buffer);
+		_data_allocator.deallocate(_point_lights_data.buffer);
 
 	_point_lights_data = new_data;
 }
@@ -905,7 +936,7 @@ void LightManager::setSpotLightsCapacity(u32 new_capacity)
 	new_data.count = _spot_lights_data.count;
 	new_data.capacity = new_capacity;
 
-	new_data.buffer = allocateBlob(_allocator, new_capacity, new_data.entity,
+	new_data.buffer = allocateBlob(_data_allocator, new_capacity, new_data.entity,
 								   new_data.position_radius, new_data.color, new_data.params, 
 								   new_data.angle, new_data.radius);
 
@@ -928,7 +959,7 @@ void LightManager::setSpotLightsCapacity(u32 new_capacity)
 	}
 
 	if(_spot_lights_data.capacity > 0)
-		_allocator.deallocate(_spot_lights_data.buffer);
+		_data_allocator.deallocate(_spot_lights_data.buffer);
 
 	_spot_lights_data = new_data;
 }
\ No newline at end of file
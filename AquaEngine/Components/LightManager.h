@@ -6,13 +6,12 @@
 
 //#include <World\TransformManager.h>
 #include "EntityManager.h"
+#include "EntitySparseSet.h"
 
 #include "..\Renderer\RendererStructs.h"
 #include "..\Renderer\RendererInterfaces.h"
 #include "..\Renderer\RenderDevice\RenderDeviceTypes.h"
 
-#include "..\Core\Containers\HashMap.h"
-
 #include "..\AquaMath.h"
 #include "..\AquaTypes.h"
 
@@ -59,6 +58,8 @@ namespace aqua
 		struct Instance
 		{
 		public:
+			Instance() : i(INVALID_INDEX) {}
+
 			operator u32()
 			{
 				return i;
@@ -83,7 +84,6 @@ namespace aqua
 				return i & INDEX_MASK;
 			}
 
-			//Instance() {};
 			Instance(LightType type, u32 index) : i(((u8)type << 30) | index) { ASSERT(index >> 30 == 0); }
 
 			u32 i;
@@ -95,7 +95,9 @@ namespace aqua
 
 		static const Instance INVALID_INSTANCE;
 
-		LightManager(Allocator& allocator, TransformManager& transform, Renderer& renderer, u32 inital_capacity);
+		//SoA data is allocated from data_allocator if not null (eg: HugePageAllocator for big buffers)
+		LightManager(Allocator& allocator, TransformManager& transform, Renderer& renderer, u32 inital_capacity,
+					 Allocator* data_allocator = nullptr);
 		~LightManager();
 
 		//ResourceGenerator interface
@@ -111,6 +113,9 @@ namespace aqua
 		Instance lookup(Entity e);
 		void	 destroy(Instance i);
 
+		//out[i] = lookup(entities[i]), prefetches the map for several entities at a time to hide cache misses
+		void lookupBatch(const Entity* entities, u32 count, Instance* out);
+
 		void update();
 
 		void setColor(Instance i, u8 red, u8 green, u8 blue, u8 intensity = 1);
@@ -129,6 +134,8 @@ namespace aqua
 		void setShadowsParams(ShaderResourceH shadow_map, Matrix4x4* cascades_matrices, float* cascades_ends);
 
 	private:
+		static const u32 LOOKUP_BATCH_SIZE = 64;
+
 		/*
 		struct InstanceData
 		{
@@ -206,8 +213,9 @@ namespace aqua
 		};
 
 		Allocator& _allocator;
+		Allocator& _data_allocator;
 
-		HashMap<u32, Instance> _map;
+		EntitySparseSet<Instance> _map;
 
 		//InstanceData _data;
 		DirectionalLightsData _directional_lights_data;
@@ -6,6 +6,8 @@
 #include "..\Renderer\RendererUtilities.h"
 #include "..\Renderer\Renderer.h"
 
+#include "..\Core\JobManager.h"
+
 #include "..\Core\Allocators\ScopeStack.h"
 #include "..\Core\Allocators\SmallBlockAllocator.h"
 //#include "..\Utilities\Allocators\LinearAllocator.h"
@@ -19,8 +21,10 @@ using namespace aqua;
 const ModelManager::Instance ModelManager::INVALID_INSTANCE = { ModelManager::INVALID_INDEX };
 
 ModelManager::ModelManager(Allocator& allocator, LinearAllocator& temp_allocator,
-						   Renderer& renderer, TransformManager& transform, u32 inital_capacity)
-	: _allocator(allocator), _temp_allocator(&temp_allocator),
+						   Renderer& renderer, TransformManager& transform, u32 inital_capacity,
+						   Allocator* data_allocator)
+	: _allocator(allocator), _data_allocator(data_allocator != nullptr ? *data_allocator : allocator),
+	_temp_allocator(&temp_allocator),
 	_renderer(&renderer), _transform_manager(&transform), _map(allocator), _params_manager(allocator)
 {
 	_params_groups_allocator = allocator::allocateNew<SmallBlockAllocator>(_allocator, _allocator, 4 * 1024, 16);
@@ -47,7 +51,7 @@ ModelManager::~ModelManager()
 	}
 
 	if(_data.capacity > 0)
-		_allocator.deallocate(_data.buffer);
+		_data_allocator.deallocate(_data.buffer);
 
 	allocator::deallocateDelete(_allocator, _params_groups_allocator);
 }
@@ -61,39 +65,53 @@ void ModelManager::update()
 	const u32 num_modified_transforms = _transform_manager->getNumModifiedTransforms();
 	auto modified_transforms          = _transform_manager->getModifiedTransforms();
 
-	for(u32 k = 0; k < num_modified_transforms; k++)
+	//Lookup the instances of LOOKUP_BATCH_SIZE modified transforms at a time (prefetched)
+	Entity   entities[LOOKUP_BATCH_SIZE];
+	Instance instances[LOOKUP_BATCH_SIZE];
+
+	for(u32 first = 0; first < num_modified_transforms; first += LOOKUP_BATCH_SIZE)
 	{
-		auto i = lookup(modified_transforms[k].entity).i;
+		u32 count = num_modified_transforms - first < LOOKUP_BATCH_SIZE ? num_modified_transforms - first : LOOKUP_BATCH_SIZE;
+
+		for(u32 k = 0; k < count; k++)
+			entities[k] = modified_transforms[first + k].entity;
+
+		lookupBatch(entities, count, instances);
+
+		for(u32 k = 0; k < count; k++)
+		{
+			auto i = instances[k].i;
 
-		if(i == INVALID_INDEX)
-			continue;
+			if(i == INVALID_INDEX)
+				continue;
 
-		ASSERT(i < _data.size);
-			
-		auto params_desc = getParameterGroupDesc(*params_desc_set, _data.permutation[i]);
+			ASSERT(i < _data.size);
+				
+			auto params_desc = getParameterGroupDesc(*params_desc_set, _data.permutation[i]);
 
-		//Update world matrix
-		u32 offset = params_desc->getConstantOffset(getStringID("world"));
+			//Update world matrix
+			u32 offset = params_desc->getConstantOffset(getStringID("world"));
 
-		ASSERT(offset != UINT32_MAX);
+			ASSERT(offset != UINT32_MAX);
 
-		Matrix4x4* world = (Matrix4x4*)pointer_math::add(_data.instance_params[i]->getCBuffersData(), offset);
+			Matrix4x4* world = (Matrix4x4*)pointer_math::add(_data.instance_params[i]->getCBuffersData(), offset);
 
-		//*world = _transform_manager->getWorld(_transform_manager->lookup(_data.entity[i]));
-		*world = *modified_transforms[k].transform;
+			//*world = _transform_manager->getWorld(_transform_manager->lookup(_data.entity[i]));
+			*world = *modified_transforms[first + k].transform;
 
-		//update bounding sphere
-		Vector3 scale;
-		Quaternion rotation;
-		Vector3 translation;
+			//update bounding sphere
+			Vector3 scale;
+			Quaternion rotation;
+			Vector3 translation;
 
-		world->Decompose(scale, rotation, translation);
+			world->Decompose(scale, rotation, translation);
 
-		float max_scale = max(scale.x, scale.y);
-		max_scale       = max(max_scale, scale.z);
+			float max_scale = max(scale.x, scale.y);
+			max_scale       = max(max_scale, scale.z);
 
-		_data.bounding_sphere[i].center = Vector3::Transform(_data.bounding_sphere2[i].center, *world);
-		_data.bounding_sphere[i].radius = _data.bounding_sphere2[i].radius * max_scale;
+			_data.bounding_sphere[i].center = Vector3::Transform(_data.bounding_sphere2[i].center, *world);
+			_data.bounding_sphere[i].radius = _data.bounding_sphere2[i].radius * max_scale;
+		}
 	}
 
 	// TODO: Move this to extract and only cache visible instances param groups
@@ -120,33 +138,57 @@ bool ModelManager::cull(u32 num_frustums, const Frustum* frustums, VisibilityDat
 	}
 	*/
 
-	for(u32 i = 0; i < num_frustums; i++)
+	if(_data.size == 0)
 	{
-		u32 num_visibles = 0;
+		for(u32 i = 0; i < num_frustums; i++)
+			out[i]->num_visibles = 0;
 
-		out[i]->visibles_indices = allocator::allocateArray<u32>(*_temp_allocator, _data.size);
-	
-		for(u32 j = 0; j < _data.size; j++)
+		return true;
+	}
+
+	//Test instances in parallel (one visibility flag per instance per frustum)
+	//then compact the visible indices serially to keep them sorted
+	u8* visible = allocator::allocateArrayNoConstruct<u8>(*_temp_allocator, num_frustums * _data.size);
+
+	JobManager::get().parallelFor(0, _data.size, 256, [&](u32 begin, u32 end)
+	{
+		for(u32 i = 0; i < num_frustums; i++)
 		{
-			bool in = true;
+			u8* frustum_visible = visible + i * _data.size;
 
-			for(u8 k = 0; k < 6; k++)
+			for(u32 j = begin; j < end; j++)
 			{
-				float d = frustums[i][k].DotCoordinate(_data.bounding_sphere[j].center);
+				u8 in = 1;
 
-				if(d < -_data.bounding_sphere[j].radius)
+				for(u8 k = 0; k < 6; k++)
 				{
-					in = false;
-					break;
+					float d = frustums[i][k].DotCoordinate(_data.bounding_sphere[j].center);
+
+					if(d < -_data.bounding_sphere[j].radius)
+					{
+						in = 0;
+						break;
+					}
 				}
+
+				frustum_visible[j] = in;
 			}
+		}
+	});
 
-			if(in)
-			{
-				out[i]->visibles_indices[num_visibles] = j;
+	for(u32 i = 0; i < num_frustums; i++)
+	{
+		u32 num_visibles = 0;
 
-				num_visibles++;
-			}
+		out[i]->visibles_indices = allocator::allocateArray<u32>(*_temp_allocator, _data.size);
+
+		const u8* frustum_visible = visible + i * _data.size;
+
+		for(u32 j = 0; j < _data.size; j++)
+		{
+			out[i]->visibles_indices[num_visibles] = j;
+
+			num_visibles += frustum_visible[j];
 		}
 
 		out[i]->num_visibles = num_visibles;
@@ -300,6 +342,21 @@ ModelManager::Instance ModelManager::lookup(Entity e)
 	return{ i };
 }
 
+void ModelManager::lookupBatch(const Entity* entities, u32 count, Instance* out)
+{
+	u32 indices[LOOKUP_BATCH_SIZE];
+
+	for(u32 first = 0; first < count; first += LOOKUP_BATCH_SIZE)
+	{
+		u32 n = count - first < LOOKUP_BATCH_SIZE ? count - first : LOOKUP_BATCH_SIZE;
+
+		_map.lookupBatch(entities + first, n, indices, UINT32_MAX);
+
+		for(u32 i = 0; i < n; i++)
+			out[first + i].i = indices[i];
+	}
+}
+
 void ModelManager::destroy(Instance i)
 {
 	u32 last      = _data.size - 1;
@@ -317,8 +374,7 @@ void ModelManager::destroy(Instance i)
 	COPY_SINLE_INSTANCE_DATA(subset);
 	COPY_SINLE_INSTANCE_DATA(bounding_sphere2);
 
-	_map.insert(last_e, i.i);
-	_map.remove(e);
+	_map.swapRemove(e, last_e);
 
 	_data.size--;
 }
@@ -344,7 +400,7 @@ void ModelManager::setCapacity(u32 new_capacity)
 	InstanceData new_data;
 	new_data.size     = _data.size;
 	new_data.capacity = new_capacity;
-	new_data.buffer   = allocateBlob(_allocator, new_capacity, new_data.entity, new_data.mesh, 
+	new_data.buffer   = allocateBlob(_data_allocator, new_capacity, new_data.entity, new_data.mesh, 
 									 new_data.bounding_sphere,  new_data.permutation, new_data.instance_params,
 									 new_data.cached_instance_params, new_data.subset, new_data.bounding_sphere2);
 
@@ -373,7 +429,7 @@ void ModelManager::setCapacity(u32 new_capacity)
 	}
 
 	if(_data.capacity > 0)
-		_allocator.deallocate(_data.buffer);
+		_data_allocator.deallocate(_data.buffer);
 
 	_data = new_data;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 /////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "EntityManager.h"
+#include "EntitySparseSet.h"
 
 //#include "..\Renderer\Renderer.h"
 #include "..\Renderer\RendererInterfaces.h"
@@ -13,8 +14,6 @@
 
 #include "..\Renderer\ParameterCache.h"
 
-#include "..\Core\Containers\HashMap.h"
-
 #include "..\AquaMath.h"
 #include "..\AquaTypes.h"
 
@@ -49,8 +48,10 @@ namespace aqua
 		static const u32 INVALID_INDEX = UINT32_MAX;
 		static const Instance INVALID_INSTANCE;
 
+		//SoA data is allocated from data_allocator if not null (eg: HugePageAllocator for big buffers)
 		ModelManager(Allocator& allocator, LinearAllocator& temp_allocator,
-					 Renderer& renderer, TransformManager& transform, u32 inital_capacity);
+					 Renderer& renderer, TransformManager& transform, u32 inital_capacity,
+					 Allocator* data_allocator = nullptr);
 		~ModelManager();
 
 		void update();
@@ -71,6 +72,9 @@ namespace aqua
 		Instance lookup(Entity e);
 		void	 destroy(Instance i);
 
+		//out[i] = lookup(entities[i]), prefetches the map for several entities at a time to hide cache misses
+		void lookupBatch(const Entity* entities, u32 count, Instance* out);
+
 		void setMesh(Instance i, const MeshData* mesh);
 		void addSubset(Instance i, u8 index, const Material* material);
 
@@ -78,6 +82,8 @@ namespace aqua
 
 	private:
 
+		static const u32 LOOKUP_BATCH_SIZE = 64;
+
 		struct Subset
 		{
 			Permutation					permutation;
@@ -106,6 +112,7 @@ namespace aqua
 		};
 
 		Allocator&       _allocator;
+		Allocator&       _data_allocator;
 		LinearAllocator* _temp_allocator;
 
 		SmallBlockAllocator* _params_groups_allocator;
@@ -113,7 +120,7 @@ namespace aqua
 		Renderer*		  _renderer;
 		TransformManager* _transform_manager;
 
-		HashMap<Entity, u32> _map;
+		EntitySparseSet<u32> _map;
 
 		InstanceData _data;
 
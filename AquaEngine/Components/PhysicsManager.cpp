@@ -252,9 +252,12 @@ PhysicsManager::Instance PhysicsManager::create(Entity e, PhysicActorType type,
 
 PhysicsManager::Instance PhysicsManager::lookup(Entity e)
 {
-	u32 i = _map.lookup(e, INVALID_INDEX);
+	return _map.lookup(e, INVALID_INSTANCE);
+}
 
-	return{ i };
+void PhysicsManager::lookupBatch(const Entity* entities, u32 count, Instance* out)
+{
+	_map.lookupBatch(entities, count, out, INVALID_INSTANCE);
 }
 
 void PhysicsManager::destroy(Instance i)
@@ -266,8 +269,7 @@ void PhysicsManager::destroy(Instance i)
 	_data.entity[i.i] = _data.entity[last];
 	_data.actor[i.i]  = _data.actor[last];
 
-	_map.insert(last_e, i.i);
-	_map.remove(e);
+	_map.swapRemove(e, last_e);
 
 	_data.size--;
 }
@@ -5,8 +5,7 @@
 /////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "EntityManager.h"
-
-#include "..\Core\Containers\HashMap.h"
+#include "EntitySparseSet.h"
 
 #include "..\AquaMath.h"
 #include "..\AquaTypes.h"
@@ -74,6 +73,8 @@ namespace aqua
 		struct Instance
 		{
 		public:
+			Instance() : i(INVALID_INDEX) {}
+
 			operator u32() { return i; };
 
 			bool valid() const
@@ -103,6 +104,9 @@ namespace aqua
 		Instance lookup(Entity e);
 		void	 destroy(Instance i);
 
+		//out[i] = lookup(entities[i]), prefetches the map for several entities at a time to hide cache misses
+		void lookupBatch(const Entity* entities, u32 count, Instance* out);
+
 		void addShape(Instance i, PhysicShape shape);
 		void setKinematic(Instance i, bool enable);
 
@@ -143,7 +147,7 @@ namespace aqua
 
 		Allocator& _allocator;
 
-		HashMap<u32, u32> _map;
+		EntitySparseSet<Instance> _map;
 
 		InstanceData _data;
 
@@ -4,8 +4,9 @@ using namespace aqua;
 
 const TransformManager::Instance TransformManager::INVALID_INSTANCE = { INVALID_INDEX };
 
-TransformManager::TransformManager(Allocator& allocator, u32 inital_capacity)
-	: _allocator(allocator), _map(allocator), _num_modified_transforms(0)
+TransformManager::TransformManager(Allocator& allocator, u32 inital_capacity, Allocator* data_allocator)
+	: _allocator(allocator), _data_allocator(data_allocator != nullptr ? *data_allocator : allocator),
+	_map(allocator), _num_modified_transforms(0)
 {
 	_data.size     = 0;
 	_data.capacity = 0;
@@ -17,7 +18,7 @@ TransformManager::TransformManager(Allocator& allocator, u32 inital_capacity)
 TransformManager::~TransformManager()
 {
 	if(_data.capacity > 0)
-		_allocator.deallocate(_data.buffer);
+		_data_allocator.deallocate(_data.buffer);
 }
 
 TransformManager::Instance TransformManager::create(Entity e)
@@ -52,9 +53,12 @@ TransformManager::Instance TransformManager::create(Entity e)
 
 TransformManager::Instance TransformManager::lookup(Entity e)
 {
-	u32 i = _map.lookup(e, INVALID_INDEX);
+	return _map.lookup(e, INVALID_INSTANCE);
+}
 
-	return{ i };
+void TransformManager::lookupBatch(const Entity* entities, u32 count, Instance* out)
+{
+	_map.lookupBatch(entities, count, out, INVALID_INSTANCE);
 }
 
 void TransformManager::destroy(Instance i)
@@ -68,8 +72,7 @@ void TransformManager::destroy(Instance i)
 	_data.local_rotation[i.i] = _data.local_rotation[last];
 	_data.local_scale[i.i]    = _data.local_scale[last];
 
-	_map.insert(last_e, i.i);
-	_map.remove(e);
+	_map.swapRemove(e, last_e);
 
 	_data.size--;
 }
@@ -248,7 +251,7 @@ void TransformManager::setCapacity(u32 new_capacity)
 	InstanceData new_data;
 	new_data.size     = _data.size;
 	new_data.capacity = new_capacity;
-	new_data.buffer   = _allocator.allocate(new_buffer_size, __alignof(Entity));
+	new_data.buffer   = _data_allocator.allocate(new_buffer_size, __alignof(Entity));
 
 	new_data.entity         = (Entity*)(new_data.buffer);
 	new_data.local_position = (Vector3*)(new_data.entity + new_capacity);
@@ -284,7 +287,7 @@ void TransformManager::setCapacity(u32 new_capacity)
 	}
 
 	if(_data.capacity > 0)
-		_allocator.deallocate(_data.buffer);
+		_data_allocator.deallocate(_data.buffer);
 
 	_data = new_data;
 }
\ No newline at end of file
@@ -5,8 +5,7 @@
 /////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "EntityManager.h"
-
-#include "..\Core\Containers\HashMap.h"
+#include "EntitySparseSet.h"
 
 #include "..\AquaMath.h"
 #include "..\AquaTypes.h"
@@ -25,6 +24,8 @@ namespace aqua
 		struct Instance
 		{
 		public:
+			Instance() : i(INVALID_INDEX) {}
+
 			operator u32() { return i; };
 
 			bool valid() const
@@ -44,13 +45,17 @@ namespace aqua
 
 		static const Instance INVALID_INSTANCE;
 
-		TransformManager(Allocator& allocator, u32 inital_capacity);
+		//SoA data is allocated from data_allocator if not null (eg: HugePageAllocator for big buffers)
+		TransformManager(Allocator& allocator, u32 inital_capacity, Allocator* data_allocator = nullptr);
 		~TransformManager();
 
 		Instance create(Entity e);
 		Instance lookup(Entity e);
 		void	 destroy(Instance i);
 
+		//out[i] = lookup(entities[i]), prefetches the map for several entities at a time to hide cache misses
+		void lookupBatch(const Entity* entities, u32 count, Instance* out);
+
 		u32						 getNumModifiedTransforms() const;
 		const ModifiedTransform* getModifiedTransforms() const;
 
@@ -99,8 +104,9 @@ namespace aqua
 		};
 
 		Allocator& _allocator;
+		Allocator& _data_allocator;
 
-		HashMap<u32, u32> _map;
+		EntitySparseSet<Instance> _map;
 
 		InstanceData _data;
 
@@ -0,0 +1,162 @@
+#include "AllocationGuard.h"
+
+#if AQUA_ALLOCATION_GUARD
+
+#include "ProxyAllocator.h"
+
+#include "..\..\Utilities\StackTrace.h"
+#include "..\..\Utilities\Logger.h"
+#include "..\..\Utilities\Debug.h"
+
+#include <mutex>
+
+using namespace aqua;
+
+namespace aqua
+{
+	extern __declspec(thread) aqua::u8 THREAD_ID;
+};
+
+std::atomic<u32>              allocation_guard::internal::num_sealed(0);
+std::atomic<const Allocator*> allocation_guard::internal::sealed[MAX_NUM_SEALED_ALLOCATORS];
+__declspec(thread) u32        allocation_guard::internal::thread_seal_depth = 0;
+
+static std::mutex          violations_mutex;
+static AllocationViolation violations[MAX_NUM_VIOLATIONS];
+static std::atomic<u32>    num_violations(0);
+static bool                assert_on_violation = false;
+
+void allocation_guard::seal(const Allocator& allocator)
+{
+	//Same allocator can be sealed more than once (nested scopes), each seal uses a slot
+	for(u32 i = 0; i < MAX_NUM_SEALED_ALLOCATORS; i++)
+	{
+		const Allocator* expected = nullptr;
+
+		if(internal::sealed[i].compare_exchange_strong(expected, &allocator))
+		{
+			internal::num_sealed.fetch_add(1);
+			return;
+		}
+	}
+
+	ASSERT("Too many sealed allocators" && false);
+}
+
+void allocation_guard::unseal(const Allocator& allocator)
+{
+	for(u32 i = 0; i < MAX_NUM_SEALED_ALLOCATORS; i++)
+	{
+		const Allocator* expected = &allocator;
+
+		if(internal::sealed[i].compare_exchange_strong(expected, nullptr))
+		{
+			internal::num_sealed.fetch_sub(1);
+			return;
+		}
+	}
+
+	ASSERT("Allocator isn't sealed" && false);
+}
+
+void allocation_guard::sealThread()
+{
+	internal::thread_seal_depth++;
+}
+
+void allocation_guard::unsealThread()
+{
+	ASSERT("Thread isn't sealed" && internal::thread_seal_depth > 0);
+
+	internal::thread_seal_depth--;
+}
+
+void allocation_guard::setAssertOnViolation(bool value)
+{
+	assert_on_violation = value;
+}
+
+u32 allocation_guard::getNumViolations()
+{
+	return num_violations.load();
+}
+
+u32 allocation_guard::getNumRecordedViolations()
+{
+	u32 n = num_violations.load();
+
+	return n < MAX_NUM_VIOLATIONS ? n : MAX_NUM_VIOLATIONS;
+}
+
+const AllocationViolation& allocation_guard::getViolation(u32 index)
+{
+	ASSERT(index < getNumRecordedViolations());
+
+	return violations[index];
+}
+
+void allocation_guard::clearViolations()
+{
+	std::lock_guard<std::mutex> lock(violations_mutex);
+
+	num_violations.store(0);
+}
+
+void allocation_guard::recordViolation(const Allocator& allocator, size_t size)
+{
+	void* stack_trace[VIOLATION_STACK_DEPTH];
+
+	//Skip recordViolation
+	u32 num_frames = stack_trace::capture(stack_trace, VIOLATION_STACK_DEPTH, 1);
+
+	{
+		std::lock_guard<std::mutex> lock(violations_mutex);
+
+		u32 index = num_violations.fetch_add(1);
+
+		if(index < MAX_NUM_VIOLATIONS)
+		{
+			AllocationViolation& violation = violations[index];
+
+			violation.allocator  = &allocator;
+			violation.size       = size;
+			violation.frame      = allocator_telemetry::getFrame();
+			violation.thread_id  = THREAD_ID;
+			violation.num_frames = num_frames;
+
+			for(u32 i = 0; i < num_frames; i++)
+				violation.stack_trace[i] = stack_trace[i];
+
+			//Only recorded violations are logged (same allocation every frame would flood the log)
+			Logger::get().write(MESSAGE_LEVEL::ERROR_MESSAGE, CHANNEL::GENERAL,
+								"Allocation in sealed scope: %llu bytes, allocator: %p, thread: %u, frame: %u, call stack: %p %p %p %p",
+								(u64)size, &allocator, (u32)violation.thread_id, violation.frame,
+								num_frames > 0 ? stack_trace[0] : nullptr, num_frames > 1 ? stack_trace[1] : nullptr,
+								num_frames > 2 ? stack_trace[2] : nullptr, num_frames > 3 ? stack_trace[3] : nullptr);
+		}
+	}
+
+	ASSERT("Allocation in sealed scope" && !assert_on_violation);
+}
+
+AllocationSealScope::AllocationSealScope(const Allocator& allocator) : _allocator(allocator)
+{
+	allocation_guard::seal(_allocator);
+}
+
+AllocationSealScope::~AllocationSealScope()
+{
+	allocation_guard::unseal(_allocator);
+}
+
+ThreadAllocationSealScope::ThreadAllocationSealScope()
+{
+	allocation_guard::sealThread();
+}
+
+ThreadAllocationSealScope::~ThreadAllocationSealScope()
+{
+	allocation_guard::unsealThread();
+}
+
+#endif
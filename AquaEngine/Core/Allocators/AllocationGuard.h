@@ -0,0 +1,118 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "..\..\AquaTypes.h"
+
+#include <atomic>
+
+#if AQUA_DEBUG || AQUA_DEVELOPMENT
+#define AQUA_ALLOCATION_GUARD 1
+#endif
+
+#if AQUA_ALLOCATION_GUARD
+//Called at the start of allocate() by allocators that can be sealed (FreeListAllocator, SmallBlockAllocator, TLSFAllocator)
+#define CHECK_ALLOCATION_GUARD(allocator, size) aqua::allocation_guard::check(allocator, size)
+#else
+#define CHECK_ALLOCATION_GUARD(allocator, size)
+#endif
+
+namespace aqua
+{
+#if AQUA_ALLOCATION_GUARD
+	class Allocator;
+
+	static const u32 MAX_NUM_SEALED_ALLOCATORS = 16;
+	static const u32 MAX_NUM_VIOLATIONS        = 64;  //recorded with stack trace, all are counted
+	static const u32 VIOLATION_STACK_DEPTH     = 16;
+
+	struct AllocationViolation
+	{
+		const Allocator* allocator;
+		size_t           size;
+		u32              frame;       //allocator_telemetry::getFrame()
+		u8               thread_id;
+		u32              num_frames;
+		void*            stack_trace[VIOLATION_STACK_DEPTH];
+	};
+
+	//Hot path allocation guard.
+	//Sealed allocators must not allocate: allocations made while an allocator is sealed (every thread) or while the
+	//calling thread is sealed (every guarded allocator) are recorded with a stack trace, logged and optionally assert.
+	//Only exists in debug and development builds, use the scopes below.
+	namespace allocation_guard
+	{
+		void seal(const Allocator& allocator);
+		void unseal(const Allocator& allocator);
+
+		void sealThread();
+		void unsealThread();
+
+		void setAssertOnViolation(bool value);
+
+		u32                        getNumViolations();
+		u32                        getNumRecordedViolations();
+		const AllocationViolation& getViolation(u32 index);
+		void                       clearViolations();
+
+		void recordViolation(const Allocator& allocator, size_t size);
+
+		namespace internal
+		{
+			extern std::atomic<u32>                 num_sealed;
+			extern std::atomic<const Allocator*>    sealed[MAX_NUM_SEALED_ALLOCATORS];
+			extern __declspec(thread) u32           thread_seal_depth;
+		};
+
+		inline void check(const Allocator& allocator, size_t size)
+		{
+			if(internal::thread_seal_depth > 0)
+			{
+				recordViolation(allocator, size);
+				return;
+			}
+
+			//Fast path: nothing sealed
+			if(internal::num_sealed.load(std::memory_order_relaxed) == 0)
+				return;
+
+			for(u32 i = 0; i < MAX_NUM_SEALED_ALLOCATORS; i++)
+			{
+				if(internal::sealed[i].load(std::memory_order_relaxed) == &allocator)
+				{
+					recordViolation(allocator, size);
+					return;
+				}
+			}
+		}
+	};
+
+	//Seals an allocator (every thread) until the end of the scope
+	class AllocationSealScope
+	{
+	public:
+		AllocationSealScope(const Allocator& allocator);
+		~AllocationSealScope();
+
+	private:
+		AllocationSealScope(const AllocationSealScope&);
+		AllocationSealScope& operator=(const AllocationSealScope&);
+
+		const Allocator& _allocator;
+	};
+
+	//Seals every guarded allocator for the calling thread until the end of the scope
+	class ThreadAllocationSealScope
+	{
+	public:
+		ThreadAllocationSealScope();
+		~ThreadAllocationSealScope();
+
+	private:
+		ThreadAllocationSealScope(const ThreadAllocationSealScope&);
+		ThreadAllocationSealScope& operator=(const ThreadAllocationSealScope&);
+	};
+#endif
+};
@@ -0,0 +1,133 @@
+#include "FrameRingAllocator.h"
+
+#include "..\..\Utilities\Debug.h"
+
+#include <cstring>
+
+using namespace aqua;
+
+static const u8 GENERATION_ALIGNMENT = 64;
+
+FrameRingAllocator::FrameRingAllocator(Allocator& backing_allocator, u8 num_generations, size_t generation_size)
+	: Allocator(num_generations * generation_size), _backing_allocator(backing_allocator), _num_generations(num_generations),
+	  _current_generation(nullptr), _current_frame(INVALID_FRAME)
+{
+	ASSERT(num_generations >= 2);
+
+	//Keep every generation cache line aligned
+	_generation_size = (generation_size + GENERATION_ALIGNMENT - 1) & ~(size_t)(GENERATION_ALIGNMENT - 1);
+	_size            = _generation_size * num_generations;
+
+	_memory      = _backing_allocator.allocate(_size, GENERATION_ALIGNMENT);
+	_generations = (Generation*)_backing_allocator.allocate(sizeof(Generation) * num_generations, __alignof(Generation));
+
+	ASSERT(_memory != nullptr && _generations != nullptr);
+
+	for(u8 i = 0; i < num_generations; i++)
+	{
+		new (&_generations[i]) Generation();
+
+		_generations[i].start = (u8*)pointer_math::add(_memory, _generation_size * i);
+		_generations[i].used_memory.store(0, std::memory_order_relaxed);
+		_generations[i].frame.store(INVALID_FRAME, std::memory_order_relaxed);
+	}
+
+	#if AQUA_DEBUG || AQUA_DEVELOPMENT
+		memset(_memory, POISON, _size);
+	#endif
+}
+
+FrameRingAllocator::~FrameRingAllocator()
+{
+	for(u8 i = 0; i < _num_generations; i++)
+		_generations[i].~Generation();
+
+	_backing_allocator.deallocate(_generations);
+	_backing_allocator.deallocate(_memory);
+}
+
+void* FrameRingAllocator::allocate(size_t size, u8 alignment)
+{
+	ASSERT(size != 0 && alignment != 0);
+	ASSERT("beginFrame() not called" && _current_generation != nullptr);
+
+	Generation& generation = *_current_generation;
+
+	size_t used_memory = generation.used_memory.load(std::memory_order_relaxed);
+
+	while(true)
+	{
+		u8 adjustment = pointer_math::alignForwardAdjustment(generation.start + used_memory, alignment);
+
+		size_t new_used_memory = used_memory + adjustment + size;
+
+		if(new_used_memory > _generation_size)
+			return nullptr;
+
+		if(generation.used_memory.compare_exchange_weak(used_memory, new_used_memory, std::memory_order_relaxed))
+			return generation.start + used_memory + adjustment;
+	}
+}
+
+void FrameRingAllocator::deallocate(void* p)
+{
+}
+
+bool FrameRingAllocator::beginFrame(u64 frame)
+{
+	ASSERT("Frames must increase" && (_current_frame == INVALID_FRAME || frame > _current_frame));
+
+	Generation& generation = _generations[frame % _num_generations];
+
+	//Acquire: pairs with retireFrame(), the consumer's reads of frame - num_generations happen before the
+	//generation is reused
+	if(generation.frame.load(std::memory_order_acquire) != INVALID_FRAME)
+		return false;
+
+	generation.used_memory.store(0, std::memory_order_relaxed);
+	generation.frame.store(frame, std::memory_order_relaxed);
+
+	_current_generation = &generation;
+	_current_frame      = frame;
+
+	return true;
+}
+
+void FrameRingAllocator::retireFrame(u64 frame)
+{
+	Generation& generation = _generations[frame % _num_generations];
+
+	ASSERT("Frame isn't live" && generation.frame.load(std::memory_order_relaxed) == frame);
+
+	#if AQUA_DEBUG || AQUA_DEVELOPMENT
+		memset(generation.start, POISON, generation.used_memory.load(std::memory_order_relaxed));
+	#endif
+
+	//Release: consumer's reads of the frame's data happen before the generation is reused
+	generation.frame.store(INVALID_FRAME, std::memory_order_release);
+}
+
+bool FrameRingAllocator::canBeginFrame(u64 frame) const
+{
+	return _generations[frame % _num_generations].frame.load(std::memory_order_acquire) == INVALID_FRAME;
+}
+
+bool FrameRingAllocator::isRetired(u64 frame) const
+{
+	return _generations[frame % _num_generations].frame.load(std::memory_order_acquire) != frame;
+}
+
+u64 FrameRingAllocator::getCurrentFrame() const
+{
+	return _current_frame;
+}
+
+size_t FrameRingAllocator::getFrameUsedMemory(u64 frame) const
+{
+	const Generation& generation = _generations[frame % _num_generations];
+
+	if(generation.frame.load(std::memory_order_acquire) != frame)
+		return 0;
+
+	return generation.used_memory.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Allocator.h"
+
+#include "..\..\AquaTypes.h"
+
+#include <atomic>
+
+namespace aqua
+{
+	//Linear allocator with num_generations generations of generation_size bytes, used by pipelined frames.
+	//Frame n allocates from generation n % num_generations, its memory stays valid until retireFrame(n) (called
+	//by the last consumer of the frame's data, eg: render submission), so a producer can be up to
+	//num_generations - 1 frames ahead of the consumer.
+	//beginFrame(n) fails (returns false) until frame n - num_generations is retired, canBeginFrame()/isRetired() can
+	//be used as fences.
+	//In debug builds retired generations are filled with POISON.
+	//
+	//allocate() is lock free and can be called from several threads during the frame. beginFrame() must be called
+	//by one thread when no allocations are in flight, retireFrame() can be called from another thread.
+	//Allocator::getUsedMemory() isn't updated, use getFrameUsedMemory().
+	class FrameRingAllocator : public Allocator
+	{
+	public:
+		static const u8  POISON        = 0xDD;
+		static const u64 INVALID_FRAME = (u64)-1;
+
+		FrameRingAllocator(Allocator& backing_allocator, u8 num_generations, size_t generation_size);
+		~FrameRingAllocator();
+
+		//Current frame's generation
+		void* allocate(size_t size, u8 alignment = DEFAULT_ALIGNMENT) override;
+
+		//NoOp - Memory is freed by retireFrame()
+		void deallocate(void* p) override;
+
+		//Returns false (and the current frame doesn't change) if the frame's generation is still in use
+		bool beginFrame(u64 frame);
+		void retireFrame(u64 frame);
+
+		//Frame's generation is free
+		bool canBeginFrame(u64 frame) const;
+
+		//Frame's data was retired (or the generation was reused by a newer frame)
+		bool isRetired(u64 frame) const;
+
+		u64    getCurrentFrame() const;
+		size_t getFrameUsedMemory(u64 frame) const;
+
+	private:
+		FrameRingAllocator(const FrameRingAllocator&);
+		FrameRingAllocator& operator=(const FrameRingAllocator&);
+
+		struct Generation
+		{
+			u8*                 start;
+			std::atomic<size_t> used_memory;
+			std::atomic<u64>    frame;       //INVALID_FRAME = retired
+		};
+
+		Allocator&  _backing_allocator;
+		void*       _memory;
+		Generation* _generations;
+		u8          _num_generations;
+		size_t      _generation_size;
+
+		Generation* _current_generation;
+		u64         _current_frame;
+	};
+};
@@ -0,0 +1,77 @@
+#include "FrameScratchAllocators.h"
+
+#include "..\..\Utilities\Debug.h"
+
+using namespace aqua;
+
+FrameScratchAllocators::FrameScratchAllocators(Allocator& allocator, u8 num_threads, size_t reserve_size, size_t decommit_threshold)
+	: _allocators(allocator, num_threads), _num_threads(num_threads), _frame(0)
+{
+	//ThreadLocalArray doesn't construct its elements
+	for(u8 i = 0; i < num_threads; i++)
+		new (&_allocators[i]) VirtualLinearAllocator(reserve_size, VirtualLinearAllocator::DEFAULT_COMMIT_GRANULARITY, decommit_threshold);
+}
+
+FrameScratchAllocators::~FrameScratchAllocators()
+{
+	for(u8 i = 0; i < _num_threads; i++)
+	{
+		_allocators[i].clear();
+		_allocators[i].~VirtualLinearAllocator();
+	}
+}
+
+LinearAllocator& FrameScratchAllocators::get()
+{
+	ASSERT("THREAD_ID out of range" && THREAD_ID < _num_threads);
+
+	return _allocators.get();
+}
+
+LinearAllocator& FrameScratchAllocators::get(u8 thread_id)
+{
+	ASSERT(thread_id < _num_threads);
+
+	return _allocators[thread_id];
+}
+
+void FrameScratchAllocators::reset()
+{
+	for(u8 i = 0; i < _num_threads; i++)
+		_allocators[i].clear();
+
+	_frame++;
+}
+
+ScratchHandoff FrameScratchAllocators::handoff(void* data, size_t size) const
+{
+	ScratchHandoff handoff;
+	handoff.data      = data;
+	handoff.size      = size;
+	handoff.frame     = _frame;
+	handoff.thread_id = THREAD_ID;
+
+	return handoff;
+}
+
+void* FrameScratchAllocators::receive(const ScratchHandoff& handoff) const
+{
+	ASSERT("Scratch memory from a previous frame" && (handoff.data == nullptr || handoff.frame == _frame));
+
+	return handoff.data;
+}
+
+u32 FrameScratchAllocators::getFrame() const
+{
+	return _frame;
+}
+
+size_t FrameScratchAllocators::getHighWaterMark() const
+{
+	size_t high_water_mark = 0;
+
+	for(u8 i = 0; i < _num_threads; i++)
+		high_water_mark += _allocators[i].getHighWaterMark();
+
+	return high_water_mark;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "VirtualLinearAllocator.h"
+
+#include "..\ThreadLocalArray.h"
+
+#include "..\..\AquaTypes.h"
+
+namespace aqua
+{
+	//Scratch memory passed from the job that produced it to a consumer (possibly on another thread).
+	//Valid until the next FrameScratchAllocators::reset()
+	struct ScratchHandoff
+	{
+		void*  data;
+		size_t size;
+		u32    frame;
+		u8     thread_id;
+	};
+
+	//One linear scratch allocator per thread (indexed by THREAD_ID) so jobs can allocate temporary per frame data
+	//without locks. Memory is only freed by reset() at the frame boundary, so pointers can be read by any thread
+	//during the frame.
+	//Notes:
+	//	- THREAD_ID 0 is shared by every non worker thread, only the main thread should use it
+	//	- A job can resume on a different worker after wait(), don't keep get()'s result across waits and don't
+	//	  rewind memory allocated before a wait
+	//	- Create after JobManager::init(), the number of workers is fixed at construction
+	class FrameScratchAllocators
+	{
+	public:
+		static const size_t DEFAULT_RESERVE_SIZE = 64 * 1024 * 1024;
+
+		FrameScratchAllocators(Allocator& allocator, u8 num_threads, size_t reserve_size = DEFAULT_RESERVE_SIZE,
+							   size_t decommit_threshold = VirtualLinearAllocator::NO_DECOMMIT);
+		~FrameScratchAllocators();
+
+		//Calling thread's allocator
+		LinearAllocator& get();
+		LinearAllocator& get(u8 thread_id);
+
+		//Clears every allocator and starts a new frame. No job can be using scratch memory
+		void reset();
+
+		ScratchHandoff handoff(void* data, size_t size) const;
+
+		//Returns the handed off data (asserts it's from the current frame)
+		void* receive(const ScratchHandoff& handoff) const;
+
+		u32    getFrame() const;
+
+		//Sum of every thread's high water mark
+		size_t getHighWaterMark() const;
+
+	private:
+		FrameScratchAllocators(const FrameScratchAllocators&);
+		FrameScratchAllocators& operator=(const FrameScratchAllocators&);
+
+		ThreadLocalArray<VirtualLinearAllocator> _allocators;
+		u8                                       _num_threads;
+		u32                                      _frame;
+	};
+};
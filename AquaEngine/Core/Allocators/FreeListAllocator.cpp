@@ -1,4 +1,5 @@
 #include "FreeListAllocator.h"
+#include "AllocationGuard.h"
 #include "..\..\Utilities\Debug.h"
 
 using namespace aqua;
@@ -28,6 +29,8 @@ void* FreeListAllocator::allocate(size_t size, u8 alignment)
 {
 	ASSERT(size != 0 && alignment != 0);
 
+	CHECK_ALLOCATION_GUARD(*this, size);
+
 	FreeBlock* prev_free_block = nullptr;
 	FreeBlock* free_block      = _free_blocks;
 
@@ -0,0 +1,165 @@
+#include "HugePageAllocator.h"
+
+#include "..\VirtualMemory.h"
+
+#include "..\..\Utilities\Debug.h"
+
+using namespace aqua;
+
+static size_t roundUp(size_t size, size_t granularity)
+{
+	return (size + granularity - 1) / granularity * granularity;
+}
+
+HugePageAllocator::HugePageAllocator(size_t size, bool use_large_pages)
+	: Allocator(size), _use_large_pages(use_large_pages), _num_failed_large_pages(0)
+{
+	_large_page_size = virtual_memory::getLargePageSize();
+
+	for(u32 i = 0; i < MAX_NUM_ALLOCATIONS; i++)
+		_mappings[i].address = nullptr;
+}
+
+HugePageAllocator::~HugePageAllocator()
+{
+}
+
+void* HugePageAllocator::allocate(size_t size, u8 alignment)
+{
+	ASSERT(size != 0 && alignment != 0);
+
+	size_t mapped_size = roundUp(size, _large_page_size);
+
+	if(_used_memory + mapped_size > _size)
+		return nullptr;
+
+	Mapping* mapping = nullptr;
+
+	for(u32 i = 0; i < MAX_NUM_ALLOCATIONS; i++)
+	{
+		if(_mappings[i].address == nullptr)
+		{
+			mapping = &_mappings[i];
+			break;
+		}
+	}
+
+	ASSERT("Too many huge page allocations" && mapping != nullptr);
+
+	if(mapping == nullptr)
+		return nullptr;
+
+	void* address = nullptr;
+
+	if(_use_large_pages)
+	{
+		address = virtual_memory::allocateLargePages(mapped_size);
+
+		if(address != nullptr)
+		{
+			mapping->base          = address;
+			mapping->reserved_size = mapped_size;
+			mapping->large_pages   = true;
+		}
+		else
+		{
+			_num_failed_large_pages++;
+		}
+	}
+
+	if(address == nullptr)
+	{
+		//Reserve an extra large page so the committed range can start at a large page boundary
+		//(transparent huge pages are only used for aligned ranges)
+		size_t reserved_size = mapped_size + _large_page_size;
+
+		void* base = virtual_memory::reserve(reserved_size);
+
+		if(base == nullptr)
+			return nullptr;
+
+		address = (void*)roundUp((uptr)base, _large_page_size);
+
+		if(!virtual_memory::commit(address, mapped_size))
+		{
+			virtual_memory::release(base, reserved_size);
+			return nullptr;
+		}
+
+		if(_use_large_pages)
+			virtual_memory::adviseLargePages(address, mapped_size);
+
+		mapping->base          = base;
+		mapping->reserved_size = reserved_size;
+		mapping->large_pages   = false;
+	}
+
+	ASSERT(pointer_math::isAligned(address, alignment));
+
+	mapping->address = address;
+	mapping->size    = mapped_size;
+
+	_used_memory += mapped_size;
+	_num_allocations++;
+
+	return address;
+}
+
+void HugePageAllocator::deallocate(void* p)
+{
+	for(u32 i = 0; i < MAX_NUM_ALLOCATIONS; i++)
+	{
+		Mapping& mapping = _mappings[i];
+
+		if(mapping.address == p)
+		{
+			if(mapping.large_pages)
+				virtual_memory::freeLargePages(mapping.base, mapping.reserved_size);
+			else
+				virtual_memory::release(mapping.base, mapping.reserved_size);
+
+			_used_memory -= mapping.size;
+			_num_allocations--;
+
+			mapping.address = nullptr;
+
+			return;
+		}
+	}
+
+	ASSERT("Invalid huge page allocation" && false);
+}
+
+HugePageAllocatorStats HugePageAllocator::getStats() const
+{
+	HugePageAllocatorStats stats = {};
+
+	stats.num_failed_large_pages = _num_failed_large_pages;
+
+	for(u32 i = 0; i < MAX_NUM_ALLOCATIONS; i++)
+	{
+		const Mapping& mapping = _mappings[i];
+
+		if(mapping.address == nullptr)
+			continue;
+
+		stats.num_allocations++;
+		stats.mapped_size += mapping.size;
+
+		if(mapping.large_pages)
+		{
+			stats.num_large_page_allocations++;
+			stats.large_page_backed_size += mapping.size;
+		}
+		else
+		{
+			stats.num_fallback_allocations++;
+			stats.large_page_backed_size += virtual_memory::getLargePageBackedSize(mapping.address, mapping.size);
+		}
+	}
+
+	stats.num_large_pages = stats.mapped_size / _large_page_size;
+	stats.num_small_pages = stats.mapped_size / virtual_memory::getPageSize();
+
+	return stats;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Allocator.h"
+
+#include "..\..\AquaTypes.h"
+
+namespace aqua
+{
+	struct HugePageAllocatorStats
+	{
+		u32    num_allocations;
+		u32    num_large_page_allocations;    //locked large pages (MAP_HUGETLB/MEM_LARGE_PAGES)
+		u32    num_fallback_allocations;      //normal pages, transparent huge pages requested where supported
+		u32    num_failed_large_pages;        //large pages were requested but the OS couldn't provide them
+
+		size_t mapped_size;                   //rounded up to large pages
+		size_t large_page_backed_size;        //bytes actually backed by large pages
+
+		//TLB entries needed to map every allocation with large pages and with normal pages
+		size_t num_large_pages;
+		size_t num_small_pages;
+	};
+
+	//Arena for big long lived buffers (component managers SoA data).
+	//Every allocation gets its own mapping rounded up to and aligned to large pages (2MB) so a buffer with
+	//hundreds of thousands of instances is covered by a few TLB entries instead of thousands.
+	//Locked large pages are used when available, otherwise the mapping uses normal pages and asks for transparent
+	//huge pages (Linux). Allocations are OS calls so it's meant for buffers that grow rarely (doubling).
+	//size is the maximum memory mapped at the same time.
+	class HugePageAllocator : public Allocator
+	{
+	public:
+		static const u32 MAX_NUM_ALLOCATIONS = 64;
+
+		HugePageAllocator(size_t size, bool use_large_pages = true);
+		~HugePageAllocator();
+
+		void* allocate(size_t size, u8 alignment = DEFAULT_ALIGNMENT) override;
+
+		void deallocate(void* p) override;
+
+		//Queries the OS, don't call every frame
+		HugePageAllocatorStats getStats() const;
+
+	private:
+		HugePageAllocator(const HugePageAllocator&);
+		HugePageAllocator& operator=(const HugePageAllocator&);
+
+		struct Mapping
+		{
+			void*  address;                   //returned to the user, large page aligned
+			void*  base;                      //fallback mappings reserve an extra large page for alignment
+			size_t size;
+			size_t reserved_size;
+			bool   large_pages;
+		};
+
+		Mapping _mappings[MAX_NUM_ALLOCATIONS];
+
+		size_t  _large_page_size;
+		bool    _use_large_pages;
+
+		u32     _num_failed_large_pages;
+	};
+};
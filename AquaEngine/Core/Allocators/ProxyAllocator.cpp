@@ -2,19 +2,172 @@
 
 #include "..\..\Utilities\Debug.h"
 
+#if AQUA_ALLOCATOR_TELEMETRY
+#include "..\..\Utilities\Logger.h"
+
+#include <atomic>
+#include <mutex>
+#include <fstream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define RETURN_ADDRESS() _ReturnAddress()
+#else
+#define RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+#endif
+
 using namespace aqua;
 
-ProxyAllocator::ProxyAllocator(Allocator& allocator)
-	: Allocator(allocator.getSize()), _allocator(allocator)
+#if AQUA_ALLOCATOR_TELEMETRY
+
+static const u32 INVALID_FRAME          = (u32)-1;
+static const u32 MAX_NUM_LEAKS_REPORTED = 32;
+static const u32 CALL_SITE_LOOKUP_SIZE  = MAX_NUM_CALL_SITES * 2;
+
+struct ProxyAllocator::AllocationHeader
+{
+	AllocationHeader* prev;
+	AllocationHeader* next;
+	size_t            size;
+	const char*       tag;
+	void*             call_site;
+	u32               frame;
+	u32               offset;    //distance from the start of the backing allocation
+};
+
+struct ProxyAllocator::TelemetryData
+{
+	AllocationHeader*  allocations;    //live allocations list
+
+	size_t             peak_used_memory;
+	size_t             budget;
+	bool               over_budget;
+
+	u64                total_allocations;
+	u64                num_untracked_allocations;
+
+	u32                frame;
+	u32                frame_allocations;
+	u32                last_frame_allocations;
+	u32                max_frame_allocations;
+
+	u64                size_histogram[NUM_TELEMETRY_BUCKETS];
+	u64                lifetime_histogram[NUM_TELEMETRY_BUCKETS];
+
+	AllocationCallSite call_sites[MAX_NUM_CALL_SITES];
+	u32                num_call_sites;
+	u8                 call_site_lookup[CALL_SITE_LOOKUP_SIZE]; //open addressing by address, index + 1 in call_sites
+
+	ProxyAllocator*    prev_proxy;     //registered proxies (allocator_telemetry::writeJSON)
+	ProxyAllocator*    next_proxy;
+};
+
+static std::atomic<u32> current_frame(0);
+
+static __declspec(thread) const char* current_tag = nullptr;
+
+static std::mutex       proxies_mutex;
+static ProxyAllocator*  first_proxy = nullptr;
+
+//Bucket 0: value < first_bucket_size, bucket i: [first_bucket_size << (i - 1), first_bucket_size << i)
+static u32 getBucket(u64 value, u64 first_bucket_size)
+{
+	u32 bucket = 0;
+
+	while(value >= first_bucket_size && bucket < NUM_TELEMETRY_BUCKETS - 1)
+	{
+		value >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+AllocationTagScope::AllocationTagScope(const char* tag) : _previous_tag(current_tag)
 {
+	current_tag = tag;
+}
 
+AllocationTagScope::~AllocationTagScope()
+{
+	current_tag = _previous_tag;
+}
+
+void allocator_telemetry::nextFrame()
+{
+	current_frame.fetch_add(1, std::memory_order_relaxed);
+}
+
+u32 allocator_telemetry::getFrame()
+{
+	return current_frame.load(std::memory_order_relaxed);
+}
+
+#endif
+
+ProxyAllocator::ProxyAllocator(Allocator& allocator, const char* name)
+	: Allocator(allocator.getSize()), _allocator(allocator), _name(name), _telemetry(nullptr)
+{
+#if AQUA_ALLOCATOR_TELEMETRY
+	_telemetry = allocator::allocateNew<TelemetryData>(_allocator);
+
+	ASSERT(_telemetry != nullptr);
+
+	_telemetry->allocations               = nullptr;
+	_telemetry->peak_used_memory          = 0;
+	_telemetry->budget                    = 0;
+	_telemetry->over_budget               = false;
+	_telemetry->total_allocations         = 0;
+	_telemetry->num_untracked_allocations = 0;
+	_telemetry->frame                     = allocator_telemetry::getFrame();
+	_telemetry->frame_allocations         = 0;
+	_telemetry->last_frame_allocations    = 0;
+	_telemetry->max_frame_allocations     = 0;
+	_telemetry->num_call_sites            = 0;
+
+	for(u32 i = 0; i < NUM_TELEMETRY_BUCKETS; i++)
+	{
+		_telemetry->size_histogram[i]     = 0;
+		_telemetry->lifetime_histogram[i] = 0;
+	}
+
+	for(u32 i = 0; i < CALL_SITE_LOOKUP_SIZE; i++)
+		_telemetry->call_site_lookup[i] = 0;
+
+	std::lock_guard<std::mutex> lock(proxies_mutex);
+
+	_telemetry->prev_proxy = nullptr;
+	_telemetry->next_proxy = first_proxy;
+
+	if(first_proxy != nullptr)
+		first_proxy->_telemetry->prev_proxy = this;
+
+	first_proxy = this;
+#endif
 }
 
 ProxyAllocator::~ProxyAllocator()
 {
+#if AQUA_ALLOCATOR_TELEMETRY
+	reportLeaks();
+
+	std::lock_guard<std::mutex> lock(proxies_mutex);
+
+	if(_telemetry->prev_proxy != nullptr)
+		_telemetry->prev_proxy->_telemetry->next_proxy = _telemetry->next_proxy;
+	else
+		first_proxy = _telemetry->next_proxy;
 
+	if(_telemetry->next_proxy != nullptr)
+		_telemetry->next_proxy->_telemetry->prev_proxy = _telemetry->prev_proxy;
+
+	allocator::deallocateDelete(_allocator, _telemetry);
+#endif
 }
 
+#if !AQUA_ALLOCATOR_TELEMETRY
+
 void* ProxyAllocator::allocate(size_t size, u8 alignment)
 {
 	ASSERT(size != 0);
@@ -39,4 +192,314 @@ void ProxyAllocator::deallocate(void* p)
 	_allocator.deallocate(p);
 
 	_used_memory -= mem - _allocator.getUsedMemory();
-}
\ No newline at end of file
+}
+
+#else
+
+void* ProxyAllocator::allocate(size_t size, u8 alignment)
+{
+	ASSERT(size != 0);
+
+	void* call_site = RETURN_ADDRESS();
+
+	//Header goes right before the returned pointer
+	u8 header_alignment = alignment > __alignof(AllocationHeader) ? alignment : __alignof(AllocationHeader);
+
+	size_t header_space = (sizeof(AllocationHeader) + header_alignment - 1) & ~(size_t)(header_alignment - 1);
+
+	size_t mem = _allocator.getUsedMemory();
+
+	void* block = _allocator.allocate(size + header_space, header_alignment);
+
+	if(block == nullptr)
+		return nullptr;
+
+	_used_memory += _allocator.getUsedMemory() - mem;
+	_num_allocations++;
+
+	void* p = pointer_math::add(block, header_space);
+
+	u32 frame = allocator_telemetry::getFrame();
+
+	const char* tag = current_tag != nullptr ? current_tag : _name;
+
+	AllocationHeader* header = (AllocationHeader*)p - 1;
+	header->size             = size;
+	header->tag              = tag;
+	header->call_site        = call_site;
+	header->frame            = frame;
+	header->offset           = (u32)header_space;
+
+	header->prev = nullptr;
+	header->next = _telemetry->allocations;
+
+	if(_telemetry->allocations != nullptr)
+		_telemetry->allocations->prev = header;
+
+	_telemetry->allocations = header;
+
+	//Stats
+	updateFrame(frame);
+
+	_telemetry->total_allocations++;
+	_telemetry->frame_allocations++;
+
+	if(_telemetry->frame_allocations > _telemetry->max_frame_allocations)
+		_telemetry->max_frame_allocations = _telemetry->frame_allocations;
+
+	if(_used_memory > _telemetry->peak_used_memory)
+		_telemetry->peak_used_memory = _used_memory;
+
+	_telemetry->size_histogram[getBucket(size, 16)]++;
+
+	trackCallSite(call_site, tag, size, frame);
+
+	if(_telemetry->budget != 0 && _used_memory > _telemetry->budget && !_telemetry->over_budget)
+	{
+		_telemetry->over_budget = true;
+
+		Logger::get().write(MESSAGE_LEVEL::WARNING_MESSAGE, CHANNEL::GENERAL,
+							"Allocator '%s' over budget: %llu of %llu bytes (tag: %s)",
+							_name, (u64)_used_memory, (u64)_telemetry->budget, tag);
+	}
+
+	return p;
+}
+
+void ProxyAllocator::deallocate(void* p)
+{
+	ASSERT(p != nullptr);
+
+	AllocationHeader* header = (AllocationHeader*)p - 1;
+
+	if(header->prev != nullptr)
+		header->prev->next = header->next;
+	else
+		_telemetry->allocations = header->next;
+
+	if(header->next != nullptr)
+		header->next->prev = header->prev;
+
+	u32 frame = allocator_telemetry::getFrame();
+
+	updateFrame(frame);
+
+	_telemetry->lifetime_histogram[getBucket(frame - header->frame, 1)]++;
+
+	_num_allocations--;
+
+	size_t mem = _allocator.getUsedMemory();
+
+	_allocator.deallocate(pointer_math::subtract(p, header->offset));
+
+	_used_memory -= mem - _allocator.getUsedMemory();
+
+	if(_telemetry->budget != 0 && _used_memory <= _telemetry->budget)
+		_telemetry->over_budget = false;
+}
+
+void ProxyAllocator::setBudget(size_t budget)
+{
+	_telemetry->budget      = budget;
+	_telemetry->over_budget = false;
+}
+
+AllocatorTelemetry ProxyAllocator::getTelemetry() const
+{
+	AllocatorTelemetry telemetry;
+
+	telemetry.used_memory               = _used_memory;
+	telemetry.peak_used_memory          = _telemetry->peak_used_memory;
+	telemetry.budget                    = _telemetry->budget;
+	telemetry.num_allocations           = _num_allocations;
+	telemetry.total_allocations         = _telemetry->total_allocations;
+	telemetry.max_frame_allocations     = _telemetry->max_frame_allocations;
+	telemetry.num_untracked_allocations = _telemetry->num_untracked_allocations;
+
+	//Counters are only rolled over by allocations, account for frames without them
+	u32 frame = allocator_telemetry::getFrame();
+
+	if(frame == _telemetry->frame)
+	{
+		telemetry.frame_allocations      = _telemetry->frame_allocations;
+		telemetry.last_frame_allocations = _telemetry->last_frame_allocations;
+	}
+	else
+	{
+		telemetry.frame_allocations      = 0;
+		telemetry.last_frame_allocations = frame == _telemetry->frame + 1 ? _telemetry->frame_allocations : 0;
+	}
+
+	for(u32 i = 0; i < NUM_TELEMETRY_BUCKETS; i++)
+	{
+		telemetry.size_histogram[i]     = _telemetry->size_histogram[i];
+		telemetry.lifetime_histogram[i] = _telemetry->lifetime_histogram[i];
+	}
+
+	return telemetry;
+}
+
+u32 ProxyAllocator::getNumCallSites() const
+{
+	return _telemetry->num_call_sites;
+}
+
+const AllocationCallSite& ProxyAllocator::getCallSite(u32 index) const
+{
+	ASSERT(index < _telemetry->num_call_sites);
+
+	return _telemetry->call_sites[index];
+}
+
+void ProxyAllocator::writeJSON(std::ostream& out) const
+{
+	AllocatorTelemetry telemetry = getTelemetry();
+
+	out << "{ \"name\": \"" << _name << "\", \"used_memory\": " << telemetry.used_memory
+		<< ", \"peak_used_memory\": " << telemetry.peak_used_memory << ", \"budget\": " << telemetry.budget
+		<< ", \"num_allocations\": " << telemetry.num_allocations << ", \"total_allocations\": " << telemetry.total_allocations
+		<< ", \"last_frame_allocations\": " << telemetry.last_frame_allocations
+		<< ", \"max_frame_allocations\": " << telemetry.max_frame_allocations
+		<< ", \"untracked_allocations\": " << telemetry.num_untracked_allocations;
+
+	out << ",\n\t\t  \"size_histogram\": [";
+
+	for(u32 i = 0; i < NUM_TELEMETRY_BUCKETS; i++)
+		out << (i > 0 ? ", " : "") << telemetry.size_histogram[i];
+
+	out << "],\n\t\t  \"lifetime_histogram\": [";
+
+	for(u32 i = 0; i < NUM_TELEMETRY_BUCKETS; i++)
+		out << (i > 0 ? ", " : "") << telemetry.lifetime_histogram[i];
+
+	out << "],\n\t\t  \"call_sites\": [";
+
+	for(u32 i = 0; i < _telemetry->num_call_sites; i++)
+	{
+		const AllocationCallSite& call_site = _telemetry->call_sites[i];
+
+		out << (i > 0 ? "," : "") << "\n\t\t\t{ \"address\": \"" << call_site.address << "\", \"tag\": \"" << call_site.tag
+			<< "\", \"allocations\": " << call_site.num_allocations << ", \"bytes\": " << call_site.num_bytes
+			<< ", \"max_consecutive_frames\": " << call_site.max_consecutive_frames << " }";
+	}
+
+	out << "] }";
+}
+
+void ProxyAllocator::updateFrame(u32 frame)
+{
+	if(frame == _telemetry->frame)
+		return;
+
+	_telemetry->last_frame_allocations = frame == _telemetry->frame + 1 ? _telemetry->frame_allocations : 0;
+	_telemetry->frame_allocations      = 0;
+	_telemetry->frame                  = frame;
+}
+
+void ProxyAllocator::trackCallSite(void* address, const char* tag, size_t size, u32 frame)
+{
+	u32 slot = (u32)(((uptr)address >> 2) * 2654435761u) % CALL_SITE_LOOKUP_SIZE;
+
+	TelemetryData& telemetry = *_telemetry;
+
+	//Linear probing, lookup is never full (twice the size of call_sites)
+	while(telemetry.call_site_lookup[slot] != 0 && telemetry.call_sites[telemetry.call_site_lookup[slot] - 1].address != address)
+		slot = (slot + 1) % CALL_SITE_LOOKUP_SIZE;
+
+	AllocationCallSite* call_site;
+
+	if(telemetry.call_site_lookup[slot] != 0)
+	{
+		call_site = &telemetry.call_sites[telemetry.call_site_lookup[slot] - 1];
+	}
+	else
+	{
+		if(telemetry.num_call_sites == MAX_NUM_CALL_SITES)
+		{
+			telemetry.num_untracked_allocations++;
+			return;
+		}
+
+		telemetry.call_site_lookup[slot] = (u8)(telemetry.num_call_sites + 1);
+
+		call_site                         = &telemetry.call_sites[telemetry.num_call_sites++];
+		call_site->address                = address;
+		call_site->tag                    = tag;
+		call_site->num_allocations        = 0;
+		call_site->num_bytes              = 0;
+		call_site->last_frame             = INVALID_FRAME;
+		call_site->num_consecutive_frames = 0;
+		call_site->max_consecutive_frames = 0;
+	}
+
+	call_site->num_allocations++;
+	call_site->num_bytes += size;
+
+	if(call_site->last_frame != frame)
+	{
+		if(call_site->last_frame != INVALID_FRAME && call_site->last_frame + 1 == frame)
+			call_site->num_consecutive_frames++;
+		else
+			call_site->num_consecutive_frames = 1;
+
+		if(call_site->num_consecutive_frames > call_site->max_consecutive_frames)
+			call_site->max_consecutive_frames = call_site->num_consecutive_frames;
+
+		call_site->last_frame = frame;
+	}
+}
+
+void ProxyAllocator::reportLeaks() const
+{
+	if(_telemetry->allocations == nullptr)
+		return;
+
+	u32 num_leaks = 0;
+	u64 num_bytes = 0;
+
+	for(AllocationHeader* header = _telemetry->allocations; header != nullptr; header = header->next)
+	{
+		if(num_leaks < MAX_NUM_LEAKS_REPORTED)
+		{
+			Logger::get().write(MESSAGE_LEVEL::ERROR_MESSAGE, CHANNEL::GENERAL,
+								"Allocator '%s' leak: %llu bytes, tag: %s, call site: %p, frame: %u",
+								_name, (u64)header->size, header->tag, header->call_site, header->frame);
+		}
+
+		num_leaks++;
+		num_bytes += header->size;
+	}
+
+	Logger::get().write(MESSAGE_LEVEL::ERROR_MESSAGE, CHANNEL::GENERAL,
+						"Allocator '%s': %u leaks (%llu bytes)", _name, num_leaks, num_bytes);
+}
+
+bool allocator_telemetry::writeJSON(const char* filename)
+{
+	std::ofstream file(filename);
+
+	if(!file.is_open())
+		return false;
+
+	std::lock_guard<std::mutex> lock(proxies_mutex);
+
+	file << "{\n\t\"frame\": " << getFrame() << ",\n\t\"allocators\": [\n";
+
+	for(ProxyAllocator* proxy = first_proxy; proxy != nullptr; proxy = proxy->_telemetry->next_proxy)
+	{
+		file << "\t\t";
+		proxy->writeJSON(file);
+		file << (proxy->_telemetry->next_proxy != nullptr ? ",\n" : "\n");
+	}
+
+	file << "\t]\n}\n";
+
+	return true;
+}
+
+#endif
+
+const char* ProxyAllocator::getName() const
+{
+	return _name;
+}
@@ -8,22 +8,130 @@
 
 #include "..\..\AquaTypes.h"
 
+#include <iosfwd>
+
+#if AQUA_DEBUG || AQUA_DEVELOPMENT
+#define AQUA_ALLOCATOR_TELEMETRY 1
+#endif
+
+#if AQUA_ALLOCATOR_TELEMETRY
+#define ALLOCATION_TAG_NAME2(line) allocation_tag_##line
+#define ALLOCATION_TAG_NAME(line) ALLOCATION_TAG_NAME2(line)
+
+//Tags allocations made by the calling thread until the end of the scope (eg: ALLOCATION_TAG("culling");)
+#define ALLOCATION_TAG(tag) aqua::AllocationTagScope ALLOCATION_TAG_NAME(__LINE__)(tag)
+#else
+#define ALLOCATION_TAG(tag)
+#endif
+
 namespace aqua
 {
+#if AQUA_ALLOCATOR_TELEMETRY
+	static const u32 NUM_TELEMETRY_BUCKETS = 16;
+	static const u32 MAX_NUM_CALL_SITES    = 128;
+
+	class AllocationTagScope
+	{
+	public:
+		AllocationTagScope(const char* tag);
+		~AllocationTagScope();
+
+	private:
+		const char* _previous_tag;
+	};
+
+	struct AllocationCallSite
+	{
+		void*       address;                //return address of the allocate() call
+		const char* tag;                    //tag of the first allocation
+		u64         num_allocations;
+		u64         num_bytes;
+		u32         last_frame;
+		u32         num_consecutive_frames;
+		u32         max_consecutive_frames; //high values = allocates every frame
+	};
+
+	struct AllocatorTelemetry
+	{
+		size_t used_memory;
+		size_t peak_used_memory;
+		size_t budget;                      //0 = no budget
+
+		u64    num_allocations;             //live
+		u64    total_allocations;
+
+		u32    frame_allocations;           //current frame
+		u32    last_frame_allocations;
+		u32    max_frame_allocations;
+
+		u64    num_untracked_allocations;   //call site table was full
+
+		//Bucket 0: < 16 bytes, bucket i: [16 << (i - 1), 16 << i), last bucket: everything bigger
+		u64    size_histogram[NUM_TELEMETRY_BUCKETS];
+
+		//Frames between allocate and deallocate. Bucket 0: same frame, bucket i: [1 << (i - 1), 1 << i)
+		u64    lifetime_histogram[NUM_TELEMETRY_BUCKETS];
+	};
+
+	namespace allocator_telemetry
+	{
+		//Call once per frame (per frame counts and allocation lifetimes)
+		void nextFrame();
+		u32  getFrame();
+
+		//Every ProxyAllocator alive
+		bool writeJSON(const char* filename);
+	};
+#endif
+
+	//Forwards allocations to another allocator and tracks the memory used by a subsystem.
+	//With AQUA_ALLOCATOR_TELEMETRY (debug and development builds) it also records the tag (ALLOCATION_TAG) and
+	//call site of every allocation, allocations per frame, peak usage, size and lifetime histograms and reports
+	//leaks when destroyed. A header is added in front of each allocation to do this.
 	class ProxyAllocator : public Allocator
 	{
 	public:
-		ProxyAllocator(Allocator& allocator);
+		ProxyAllocator(Allocator& allocator, const char* name = "unnamed");
 		~ProxyAllocator();
 
-		void* allocate(size_t size, u8 alignment) override;
+		void* allocate(size_t size, u8 alignment = DEFAULT_ALIGNMENT) override;
 
 		void deallocate(void* p) override;
 
+		const char* getName() const;
+
+#if AQUA_ALLOCATOR_TELEMETRY
+		//Logs a warning when used memory goes over budget (0 = no budget)
+		void setBudget(size_t budget);
+
+		AllocatorTelemetry getTelemetry() const;
+
+		u32                       getNumCallSites() const;
+		const AllocationCallSite& getCallSite(u32 index) const;
+
+		void writeJSON(std::ostream& out) const;
+#endif
+
 	private:
 		ProxyAllocator(const ProxyAllocator&);
 		ProxyAllocator& operator=(const ProxyAllocator&);
 
-		Allocator& _allocator;
+		//Telemetry lives behind a pointer (allocated from the backing allocator) so the class has the same layout
+		//in every configuration, projects that don't define AQUA_DEBUG/AQUA_DEVELOPMENT can still create proxies
+		struct TelemetryData;
+
+		Allocator&     _allocator;
+		const char*    _name;
+		TelemetryData* _telemetry; //nullptr without AQUA_ALLOCATOR_TELEMETRY
+
+#if AQUA_ALLOCATOR_TELEMETRY
+		struct AllocationHeader;
+
+		void updateFrame(u32 frame);
+		void trackCallSite(void* address, const char* tag, size_t size, u32 frame);
+		void reportLeaks() const;
+
+		friend bool allocator_telemetry::writeJSON(const char* filename);
+#endif
 	};
-};
\ No newline at end of file
+};
@@ -1,4 +1,5 @@
 #include "SmallBlockAllocator.h"
+#include "AllocationGuard.h"
 #include "..\..\Utilities\Debug.h"
 
 using namespace aqua;
@@ -28,6 +29,8 @@ void* SmallBlockAllocator::allocate(size_t size, u8 alignment)
 {
 	ASSERT(size != 0 && alignment != 0 && size <= _block_size - sizeof(AllocationHeader));
 
+	CHECK_ALLOCATION_GUARD(*this, size);
+
 	FreeBlock* prev_free_block = nullptr;
 	FreeBlock* free_block      = _free_blocks;
 
@@ -134,7 +137,8 @@ void SmallBlockAllocator::deallocate(void* p)
 	size_t block_size  = header->size;
 	uptr   block_end   = block_start + block_size;
 
-	FreeBlock* prev_free_block = nullptr;
+	FreeBlock* prev_prev_free_block = nullptr; //needed to unlink a block that became completely free
+	FreeBlock* prev_free_block      = nullptr;
 
 	FreeBlock* free_block = _free_blocks;
 
@@ -143,8 +147,9 @@ void SmallBlockAllocator::deallocate(void* p)
 		if((uptr)free_block >= block_end)
 			break;
 
-		prev_free_block = free_block;
-		free_block      = free_block->next;
+		prev_prev_free_block = prev_free_block;
+		prev_free_block      = free_block;
+		free_block           = free_block->next;
 	}
 
 	if(prev_free_block == nullptr)
@@ -166,6 +171,7 @@ void SmallBlockAllocator::deallocate(void* p)
 		temp->next            = prev_free_block->next;
 
 		prev_free_block->next = temp;
+		prev_prev_free_block  = prev_free_block;
 		prev_free_block       = temp;
 	}
 
@@ -177,6 +183,12 @@ void SmallBlockAllocator::deallocate(void* p)
 
 	if(prev_free_block->size == _block_size)
 	{
+		//Remove the block from the free list before returning it
+		if(prev_prev_free_block != nullptr)
+			prev_prev_free_block->next = prev_free_block->next;
+		else
+			_free_blocks = prev_free_block->next;
+
 		_backing_allocator.deallocate(prev_free_block);
 		_size -= _block_size;
 	}
@@ -0,0 +1,438 @@
+#include "TLSFAllocator.h"
+#include "AllocationGuard.h"
+#include "..\..\Utilities\Debug.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace aqua;
+
+static const u32 ALLOCATION_MAGIC_NUMBER = 0xAEF01762;
+
+//Index of the lowest/highest set bit (x != 0)
+static inline u32 findFirstSet(u32 x)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, x);
+	return index;
+#else
+	return __builtin_ctz(x);
+#endif
+}
+
+static inline u32 findLastSet(u32 x)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, x);
+	return index;
+#else
+	return 31 - __builtin_clz(x);
+#endif
+}
+
+TLSFAllocator::TLSFAllocator(size_t size, void* start)
+	: Allocator(size), _fl_bitmap(0)
+{
+	for(u32 i = 0; i < FL_INDEX_COUNT; i++)
+	{
+		_sl_bitmaps[i] = 0;
+
+		for(u32 j = 0; j < SL_INDEX_COUNT; j++)
+			_free_lists[i][j] = nullptr;
+	}
+
+	u8 adjustment = pointer_math::alignForwardAdjustment(start, ALIGN_SIZE);
+
+	ASSERT(size > adjustment + 2 * sizeof(BlockHeader) + MIN_BLOCK_SIZE);
+
+	//One free block with all the memory followed by an empty used block so the last block always has a next block
+	size_t block_size = (size - adjustment - 2 * sizeof(BlockHeader)) & ~(size_t)(ALIGN_SIZE - 1);
+
+	ASSERT("Memory too big" && block_size < ((size_t)1 << FL_INDEX_MAX));
+
+	_first_block                = (BlockHeader*)pointer_math::add(start, adjustment);
+	_first_block->prev_physical = nullptr;
+	_first_block->size          = block_size;
+
+	BlockHeader* sentinel   = getNextPhysical(_first_block);
+	sentinel->prev_physical = _first_block;
+	sentinel->size          = 0;
+
+	#if AQUA_DEBUG || AQUA_DEVELOPMENT
+		_first_block->magic_number = ALLOCATION_MAGIC_NUMBER;
+		sentinel->magic_number     = ALLOCATION_MAGIC_NUMBER;
+	#endif
+
+	insertFreeBlock(_first_block);
+}
+
+TLSFAllocator::~TLSFAllocator()
+{
+	_first_block = nullptr;
+}
+
+void* TLSFAllocator::allocate(size_t size, u8 alignment)
+{
+	ASSERT(size != 0 && alignment != 0);
+
+	CHECK_ALLOCATION_GUARD(*this, size);
+
+	size_t adjusted_size = (size + ALIGN_SIZE - 1) & ~(size_t)(ALIGN_SIZE - 1);
+
+	if(adjusted_size < MIN_BLOCK_SIZE)
+		adjusted_size = MIN_BLOCK_SIZE;
+
+	//Blocks are ALIGN_SIZE aligned, bigger alignments need space for a free block in front of the aligned block
+	size_t gap_size = alignment > ALIGN_SIZE ? alignment + sizeof(FreeBlock) : 0;
+
+	if(adjusted_size + gap_size >= ((size_t)1 << FL_INDEX_MAX))
+		return nullptr;
+
+	u32 fl, sl;
+	mappingSearch(adjusted_size + gap_size, fl, sl);
+
+	FreeBlock* free_block = findFreeBlock(fl, sl);
+
+	if(free_block == nullptr)
+		return nullptr;
+
+	removeFreeBlock(free_block, fl, sl);
+
+	BlockHeader* block = &free_block->header;
+	block->size        = getBlockSize(block);
+
+	if(gap_size != 0)
+	{
+		uptr payload = (uptr)(block + 1);
+		uptr aligned = (uptr)pointer_math::alignForward((void*)payload, alignment);
+
+		//Gap too small for a free block
+		if(aligned != payload && aligned - payload < sizeof(FreeBlock))
+			aligned = (uptr)pointer_math::alignForward((void*)(payload + sizeof(FreeBlock)), alignment);
+
+		size_t gap = aligned - payload;
+
+		if(gap != 0)
+		{
+			BlockHeader* aligned_block   = (BlockHeader*)(aligned - sizeof(BlockHeader));
+			aligned_block->prev_physical = block;
+			aligned_block->size          = block->size - gap;
+
+			#if AQUA_DEBUG || AQUA_DEVELOPMENT
+				aligned_block->magic_number = ALLOCATION_MAGIC_NUMBER;
+			#endif
+
+			getNextPhysical(aligned_block)->prev_physical = aligned_block;
+
+			//Previous physical block can't be free (blocks are coalesced when freed)
+			block->size = gap - sizeof(BlockHeader);
+			insertFreeBlock(block);
+
+			block = aligned_block;
+		}
+	}
+
+	splitBlock(block, adjusted_size);
+
+	#if AQUA_DEBUG || AQUA_DEVELOPMENT
+		block->magic_number = ALLOCATION_MAGIC_NUMBER;
+	#endif
+
+	_used_memory += sizeof(BlockHeader) + getBlockSize(block);
+	_num_allocations++;
+
+	ASSERT(pointer_math::isAligned(block + 1, alignment));
+
+	return block + 1;
+}
+
+void TLSFAllocator::deallocate(void* p)
+{
+	ASSERT(p != nullptr);
+
+	BlockHeader* block = (BlockHeader*)p - 1;
+
+	#if AQUA_DEBUG || AQUA_DEVELOPMENT
+		ASSERT(block->magic_number == ALLOCATION_MAGIC_NUMBER);
+	#endif
+
+	ASSERT("Double free" && !isFree(block));
+
+	size_t size = getBlockSize(block);
+
+	_used_memory -= sizeof(BlockHeader) + size;
+	_num_allocations--;
+
+	//Coalesce with previous block
+	BlockHeader* prev = block->prev_physical;
+
+	if(prev != nullptr && isFree(prev))
+	{
+		removeFreeBlock((FreeBlock*)prev);
+
+		size += sizeof(BlockHeader) + getBlockSize(prev);
+		block = prev;
+	}
+
+	//Coalesce with next block
+	BlockHeader* next = (BlockHeader*)pointer_math::add(block + 1, size);
+
+	if(isFree(next))
+	{
+		removeFreeBlock((FreeBlock*)next);
+
+		size += sizeof(BlockHeader) + getBlockSize(next);
+	}
+
+	block->size = size;
+
+	getNextPhysical(block)->prev_physical = block;
+
+	insertFreeBlock(block);
+}
+
+size_t TLSFAllocator::getLargestFreeBlock() const
+{
+	if(_fl_bitmap == 0)
+		return 0;
+
+	u32 fl = findLastSet(_fl_bitmap);
+	u32 sl = findLastSet(_sl_bitmaps[fl]);
+
+	size_t largest = 0;
+
+	for(const FreeBlock* block = _free_lists[fl][sl]; block != nullptr; block = block->next_free)
+	{
+		if(getBlockSize(&block->header) > largest)
+			largest = getBlockSize(&block->header);
+	}
+
+	return largest;
+}
+
+size_t TLSFAllocator::getBlockSize(const BlockHeader* block)
+{
+	return block->size & ~BLOCK_FREE;
+}
+
+bool TLSFAllocator::isFree(const BlockHeader* block)
+{
+	return (block->size & BLOCK_FREE) != 0;
+}
+
+TLSFAllocator::BlockHeader* TLSFAllocator::getNextPhysical(const BlockHeader* block)
+{
+	return (BlockHeader*)pointer_math::add(block + 1, getBlockSize(block));
+}
+
+//Size class of a block
+void TLSFAllocator::mapping(size_t size, u32& fl, u32& sl)
+{
+	if(size < SMALL_BLOCK_SIZE)
+	{
+		fl = 0;
+		sl = (u32)size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
+	}
+	else
+	{
+		u32 t = findLastSet((u32)size);
+
+		sl = (u32)(size >> (t - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+		fl = t - (FL_INDEX_SHIFT - 1);
+	}
+}
+
+//First size class where every block is big enough
+void TLSFAllocator::mappingSearch(size_t size, u32& fl, u32& sl)
+{
+	if(size >= SMALL_BLOCK_SIZE)
+		size += ((size_t)1 << (findLastSet((u32)size) - SL_INDEX_COUNT_LOG2)) - 1;
+
+	mapping(size, fl, sl);
+}
+
+TLSFAllocator::FreeBlock* TLSFAllocator::findFreeBlock(u32& fl, u32& sl)
+{
+	if(fl >= FL_INDEX_COUNT)
+		return nullptr;
+
+	u32 sl_map = _sl_bitmaps[fl] & (~0u << sl);
+
+	if(sl_map == 0)
+	{
+		//Next non empty first level class
+		u32 fl_map = fl + 1 < 32 ? _fl_bitmap & (~0u << (fl + 1)) : 0;
+
+		if(fl_map == 0)
+			return nullptr;
+
+		fl     = findFirstSet(fl_map);
+		sl_map = _sl_bitmaps[fl];
+	}
+
+	ASSERT(sl_map != 0);
+
+	sl = findFirstSet(sl_map);
+
+	return _free_lists[fl][sl];
+}
+
+void TLSFAllocator::insertFreeBlock(BlockHeader* block)
+{
+	size_t size = getBlockSize(block);
+
+	ASSERT(size >= MIN_BLOCK_SIZE);
+
+	u32 fl, sl;
+	mapping(size, fl, sl);
+
+	block->size = size | BLOCK_FREE;
+
+	FreeBlock* free_block = (FreeBlock*)block;
+	FreeBlock* head       = _free_lists[fl][sl];
+
+	free_block->next_free = head;
+	free_block->prev_free = nullptr;
+
+	if(head != nullptr)
+		head->prev_free = free_block;
+
+	_free_lists[fl][sl] = free_block;
+
+	_fl_bitmap      |= 1u << fl;
+	_sl_bitmaps[fl] |= 1u << sl;
+}
+
+void TLSFAllocator::removeFreeBlock(FreeBlock* block, u32 fl, u32 sl)
+{
+	if(block->next_free != nullptr)
+		block->next_free->prev_free = block->prev_free;
+
+	if(block->prev_free != nullptr)
+		block->prev_free->next_free = block->next_free;
+
+	if(_free_lists[fl][sl] == block)
+	{
+		_free_lists[fl][sl] = block->next_free;
+
+		if(_free_lists[fl][sl] == nullptr)
+		{
+			_sl_bitmaps[fl] &= ~(1u << sl);
+
+			if(_sl_bitmaps[fl] == 0)
+				_fl_bitmap &= ~(1u << fl);
+		}
+	}
+}
+
+void TLSFAllocator::removeFreeBlock(FreeBlock* block)
+{
+	u32 fl, sl;
+	mapping(getBlockSize(&block->header), fl, sl);
+
+	removeFreeBlock(block, fl, sl);
+}
+
+void TLSFAllocator::splitBlock(BlockHeader* block, size_t size)
+{
+	size_t block_size = getBlockSize(block);
+
+	//Remaining memory can't hold a free block
+	if(block_size < size + sizeof(FreeBlock))
+		return;
+
+	BlockHeader* remaining   = (BlockHeader*)pointer_math::add(block + 1, size);
+	remaining->prev_physical = block;
+	remaining->size          = block_size - size - sizeof(BlockHeader);
+
+	#if AQUA_DEBUG || AQUA_DEVELOPMENT
+		remaining->magic_number = ALLOCATION_MAGIC_NUMBER;
+	#endif
+
+	block->size = size;
+
+	BlockHeader* next = getNextPhysical(remaining);
+
+	if(isFree(next))
+	{
+		removeFreeBlock((FreeBlock*)next);
+
+		remaining->size += sizeof(BlockHeader) + getBlockSize(next);
+
+		next = getNextPhysical(remaining);
+	}
+
+	next->prev_physical = remaining;
+
+	insertFreeBlock(remaining);
+}
+
+#if AQUA_DEBUG || AQUA_DEVELOPMENT
+void TLSFAllocator::checkBlocks()
+{
+	size_t num_free_blocks = 0;
+	size_t used_memory     = 0;
+
+	BlockHeader* prev  = nullptr;
+	BlockHeader* block = _first_block;
+
+	//Walk the physical block list until the sentinel
+	while(true)
+	{
+		ASSERT(block->magic_number == ALLOCATION_MAGIC_NUMBER);
+		ASSERT(block->prev_physical == prev);
+
+		if(getBlockSize(block) == 0)
+			break;
+
+		if(isFree(block))
+		{
+			ASSERT("Free blocks not coalesced" && (prev == nullptr || !isFree(prev)));
+
+			u32 fl, sl;
+			mapping(getBlockSize(block), fl, sl);
+
+			ASSERT((_fl_bitmap & (1u << fl)) != 0 && (_sl_bitmaps[fl] & (1u << sl)) != 0);
+
+			num_free_blocks++;
+		}
+		else
+		{
+			used_memory += sizeof(BlockHeader) + getBlockSize(block);
+		}
+
+		prev  = block;
+		block = getNextPhysical(block);
+	}
+
+	ASSERT(used_memory == _used_memory);
+
+	//Every block in the free lists is free and in the right list
+	for(u32 i = 0; i < FL_INDEX_COUNT; i++)
+	{
+		ASSERT(((_fl_bitmap & (1u << i)) != 0) == (_sl_bitmaps[i] != 0));
+
+		for(u32 j = 0; j < SL_INDEX_COUNT; j++)
+		{
+			ASSERT(((_sl_bitmaps[i] & (1u << j)) != 0) == (_free_lists[i][j] != nullptr));
+
+			for(FreeBlock* free_block = _free_lists[i][j]; free_block != nullptr; free_block = free_block->next_free)
+			{
+				ASSERT(isFree(&free_block->header));
+
+				u32 fl, sl;
+				mapping(getBlockSize(&free_block->header), fl, sl);
+
+				ASSERT(fl == i && sl == j);
+
+				num_free_blocks--;
+			}
+		}
+	}
+
+	ASSERT(num_free_blocks == 0);
+}
+#endif
@@ -0,0 +1,96 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Allocator.h"
+
+#include "..\..\AquaTypes.h"
+
+namespace aqua
+{
+	//Two-Level Segregated Fit allocator.
+	//Free blocks are kept in size class lists (first level: power of 2, second level: SL_INDEX_COUNT linear
+	//subdivisions) with bitmaps of the non empty lists, so allocate and deallocate are O(1) no matter how many
+	//free blocks there are. Freed blocks are immediately coalesced with their free physical neighbours.
+	class TLSFAllocator : public Allocator
+	{
+	public:
+		TLSFAllocator(size_t size, void* start);
+		~TLSFAllocator();
+
+		void* allocate(size_t size, u8 alignment = DEFAULT_ALIGNMENT) override;
+
+		void deallocate(void* p) override;
+
+		//Size of the biggest free block (not O(1), walks one free list)
+		size_t getLargestFreeBlock() const;
+
+#if AQUA_DEBUG || AQUA_DEVELOPMENT
+		//Checks the physical block list, the free lists and the bitmaps
+		void checkBlocks();
+#endif
+
+	private:
+		TLSFAllocator(const TLSFAllocator&);
+		TLSFAllocator& operator=(const TLSFAllocator&);
+
+		static const u32 ALIGN_SIZE_LOG2     = 3;
+		static const u32 ALIGN_SIZE          = 1 << ALIGN_SIZE_LOG2;
+
+		static const u32 SL_INDEX_COUNT_LOG2 = 5;
+		static const u32 SL_INDEX_COUNT      = 1 << SL_INDEX_COUNT_LOG2;
+
+		static const u32 FL_INDEX_MAX        = 31;                                     //blocks up to 2GB
+		static const u32 FL_INDEX_SHIFT      = SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2;
+		static const u32 FL_INDEX_COUNT      = FL_INDEX_MAX - FL_INDEX_SHIFT + 1;
+
+		static const u32 SMALL_BLOCK_SIZE    = 1 << FL_INDEX_SHIFT;                    //linear size classes below this
+
+		static const size_t BLOCK_FREE       = 1;                                      //flag in the low bit of size
+
+		struct BlockHeader
+		{
+			BlockHeader* prev_physical;
+			size_t       size;              //size of the block after the header | BLOCK_FREE
+			#if AQUA_DEBUG || AQUA_DEVELOPMENT
+			size_t       magic_number;
+			#endif
+		};
+
+		//Free blocks store the free list links after the header
+		struct FreeBlock
+		{
+			BlockHeader header;
+			FreeBlock*  next_free;
+			FreeBlock*  prev_free;
+		};
+
+		static const size_t MIN_BLOCK_SIZE = sizeof(FreeBlock) - sizeof(BlockHeader);
+
+		static_assert(sizeof(BlockHeader) % ALIGN_SIZE == 0, "sizeof(BlockHeader) not multiple of ALIGN_SIZE");
+
+		static size_t       getBlockSize(const BlockHeader* block);
+		static bool         isFree(const BlockHeader* block);
+		static BlockHeader* getNextPhysical(const BlockHeader* block);
+
+		static void mapping(size_t size, u32& fl, u32& sl);
+		static void mappingSearch(size_t size, u32& fl, u32& sl);
+
+		FreeBlock* findFreeBlock(u32& fl, u32& sl);
+
+		void insertFreeBlock(BlockHeader* block);
+		void removeFreeBlock(FreeBlock* block, u32 fl, u32 sl);
+		void removeFreeBlock(FreeBlock* block);
+
+		//Splits the end of block into a new free block if there's enough space
+		void splitBlock(BlockHeader* block, size_t size);
+
+		u32        _fl_bitmap;
+		u32        _sl_bitmaps[FL_INDEX_COUNT];
+		FreeBlock* _free_lists[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+		BlockHeader* _first_block;
+	};
+};
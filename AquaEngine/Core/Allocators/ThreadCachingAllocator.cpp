@@ -0,0 +1,406 @@
+#include "ThreadCachingAllocator.h"
+
+#include "..\..\Utilities\Debug.h"
+
+#include <cstring>
+
+using namespace aqua;
+
+static const u32 BLOCK_MAGIC_NUMBER = 0x7CA1B10C;
+
+static const u32 BATCH_BYTES    = 8 * 1024; //memory moved between a bin and its central list at once
+static const u32 MIN_BATCH_SIZE = 4;
+static const u32 MAX_BATCH_SIZE = 64;
+
+const u32 ThreadCachingAllocator::SIZE_CLASSES[NUM_SIZE_CLASSES] =
+{
+	32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256,
+	320, 384, 448, 512,
+	640, 768, 896, 1024,
+	1280, 1536, 1792, 2048
+};
+
+ThreadCachingAllocator::ThreadCachingAllocator(Allocator& backing_allocator, u8 num_threads, size_t span_size)
+	: Allocator(backing_allocator.getSize()), _backing_allocator(backing_allocator), _spans(nullptr), _span_size(span_size),
+	  _num_threads(num_threads), _caches(backing_allocator, num_threads), _num_contentions(0)
+{
+	ASSERT("Span too small for the biggest size class" && span_size >= SIZE_CLASSES[NUM_SIZE_CLASSES - 1] + BLOCK_ALIGNMENT);
+	ASSERT(SIZE_CLASSES[NUM_SIZE_CLASSES - 1] == MAX_CACHED_SIZE + sizeof(BlockHeader));
+
+	for(u8 i = 0; i < num_threads; i++)
+		memset(&_caches[i], 0, sizeof(ThreadCache));
+
+	for(u32 i = 0; i < NUM_SIZE_CLASSES; i++)
+	{
+		_central_lists[i].blocks     = nullptr;
+		_central_lists[i].num_blocks = 0;
+
+		u32 batch_size = BATCH_BYTES / SIZE_CLASSES[i];
+
+		if(batch_size < MIN_BATCH_SIZE)
+			batch_size = MIN_BATCH_SIZE;
+		else if(batch_size > MAX_BATCH_SIZE)
+			batch_size = MAX_BATCH_SIZE;
+
+		_batch_sizes[i] = batch_size;
+	}
+
+	u8 size_class = 0;
+
+	for(u32 i = 0; i < sizeof(_size_class_lookup); i++)
+	{
+		while(SIZE_CLASSES[size_class] < i * BLOCK_ALIGNMENT)
+			size_class++;
+
+		_size_class_lookup[i] = size_class;
+	}
+}
+
+ThreadCachingAllocator::~ThreadCachingAllocator()
+{
+	ThreadCachingAllocatorStats stats = getStats();
+
+	u64 num_deallocations = 0;
+
+	for(u8 i = 0; i < _num_threads; i++)
+		num_deallocations += _caches[i].num_deallocations;
+
+	ASSERT("Memory leak" && stats.num_allocations == num_deallocations);
+
+	//Blocks in the bins and central lists live in the spans
+	while(_spans != nullptr)
+	{
+		Span* next = _spans->next;
+
+		_backing_allocator.deallocate(_spans);
+
+		_spans = next;
+	}
+
+	_used_memory = 0;
+}
+
+void* ThreadCachingAllocator::allocate(size_t size, u8 alignment)
+{
+	ASSERT(size != 0 && alignment != 0);
+	ASSERT("THREAD_ID out of range" && THREAD_ID < _num_threads);
+
+	if(THREAD_ID == 0)
+	{
+		lock(_external_cache_mutex);
+		std::lock_guard<std::mutex> lock(_external_cache_mutex, std::adopt_lock);
+
+		return allocateFromCache(_caches[0], size, alignment);
+	}
+
+	return allocateFromCache(_caches.get(), size, alignment);
+}
+
+void ThreadCachingAllocator::deallocate(void* p)
+{
+	ASSERT(p != nullptr);
+	ASSERT("THREAD_ID out of range" && THREAD_ID < _num_threads);
+
+	if(THREAD_ID == 0)
+	{
+		lock(_external_cache_mutex);
+		std::lock_guard<std::mutex> lock(_external_cache_mutex, std::adopt_lock);
+
+		deallocateToCache(_caches[0], p);
+		return;
+	}
+
+	deallocateToCache(_caches.get(), p);
+}
+
+void* ThreadCachingAllocator::allocateFromCache(ThreadCache& cache, size_t size, u8 alignment)
+{
+	cache.num_allocations++;
+
+	if(size > MAX_CACHED_SIZE || alignment > BLOCK_ALIGNMENT)
+		return allocateLarge(cache, size, alignment);
+
+	u8   size_class = getSizeClass(size);
+	Bin& bin        = cache.bins[size_class];
+
+	if(bin.blocks != nullptr)
+	{
+		cache.num_hits++;
+	}
+	else
+	{
+		cache.num_refills++;
+
+		refill(bin, size_class);
+
+		if(bin.blocks == nullptr)
+		{
+			cache.num_allocations--;
+			return nullptr;
+		}
+	}
+
+	FreeBlock* block = bin.blocks;
+	bin.blocks       = block->next;
+	bin.num_blocks--;
+
+	BlockHeader* header  = (BlockHeader*)block;
+	header->size_class   = size_class;
+	header->thread       = THREAD_ID;
+	header->magic_number = BLOCK_MAGIC_NUMBER;
+	header->offset       = 0;
+
+	return header + 1;
+}
+
+void ThreadCachingAllocator::deallocateToCache(ThreadCache& cache, void* p)
+{
+	BlockHeader* header = (BlockHeader*)p - 1;
+
+	ASSERT("Invalid pointer or double free" && header->magic_number == BLOCK_MAGIC_NUMBER);
+
+	cache.num_deallocations++;
+
+	if(header->size_class == LARGE_SIZE_CLASS)
+	{
+		deallocateLarge(header);
+		return;
+	}
+
+	if(header->thread != THREAD_ID)
+		cache.num_cross_thread_frees++;
+
+	u8   size_class = header->size_class;
+	Bin& bin        = cache.bins[size_class];
+
+	//Overwrites the magic number
+	FreeBlock* block = (FreeBlock*)header;
+	block->next      = bin.blocks;
+	bin.blocks       = block;
+	bin.num_blocks++;
+
+	//Keep up to 2 batches per bin so alternating allocations and frees don't flush every time
+	if(bin.num_blocks > 2 * _batch_sizes[size_class])
+	{
+		cache.num_flushes++;
+
+		flush(bin, size_class, _batch_sizes[size_class]);
+	}
+}
+
+void* ThreadCachingAllocator::allocateLarge(ThreadCache& cache, size_t size, u8 alignment)
+{
+	cache.num_large_allocations++;
+
+	if(alignment < BLOCK_ALIGNMENT)
+		alignment = BLOCK_ALIGNMENT;
+
+	size_t total_size = size + sizeof(BlockHeader) + alignment;
+
+	lock(_backing_mutex);
+	std::lock_guard<std::mutex> lock(_backing_mutex, std::adopt_lock);
+
+	size_t used_memory = _backing_allocator.getUsedMemory();
+
+	void* memory = _backing_allocator.allocate(total_size, DEFAULT_ALIGNMENT);
+
+	if(memory == nullptr)
+	{
+		cache.num_allocations--;
+		return nullptr;
+	}
+
+	_used_memory += _backing_allocator.getUsedMemory() - used_memory;
+
+	void* p = pointer_math::alignForward(pointer_math::add(memory, sizeof(BlockHeader)), alignment);
+
+	BlockHeader* header  = (BlockHeader*)p - 1;
+	header->size_class   = LARGE_SIZE_CLASS;
+	header->thread       = THREAD_ID;
+	header->magic_number = BLOCK_MAGIC_NUMBER;
+	header->offset       = (uptr)p - (uptr)memory;
+
+	return p;
+}
+
+void ThreadCachingAllocator::deallocateLarge(BlockHeader* header)
+{
+	void* memory = pointer_math::subtract(header + 1, (size_t)header->offset);
+
+	header->magic_number = 0;
+
+	lock(_backing_mutex);
+	std::lock_guard<std::mutex> lock(_backing_mutex, std::adopt_lock);
+
+	size_t used_memory = _backing_allocator.getUsedMemory();
+
+	_backing_allocator.deallocate(memory);
+
+	_used_memory -= used_memory - _backing_allocator.getUsedMemory();
+}
+
+void ThreadCachingAllocator::refill(Bin& bin, u8 size_class)
+{
+	CentralList& central_list = _central_lists[size_class];
+	u32          batch_size   = _batch_sizes[size_class];
+
+	lock(central_list.mutex);
+	std::lock_guard<std::mutex> lock(central_list.mutex, std::adopt_lock);
+
+	if(central_list.num_blocks < batch_size)
+		allocateSpan(size_class);
+
+	if(central_list.blocks == nullptr)
+		return;
+
+	//Move up to batch_size blocks
+	FreeBlock* first = central_list.blocks;
+	FreeBlock* last  = first;
+	u32        count = 1;
+
+	while(count < batch_size && last->next != nullptr)
+	{
+		last = last->next;
+		count++;
+	}
+
+	central_list.blocks      = last->next;
+	central_list.num_blocks -= count;
+
+	last->next     = bin.blocks;
+	bin.blocks     = first;
+	bin.num_blocks += count;
+}
+
+void ThreadCachingAllocator::flush(Bin& bin, u8 size_class, u32 count)
+{
+	if(count == 0 || bin.blocks == nullptr)
+		return;
+
+	FreeBlock* first = bin.blocks;
+	FreeBlock* last  = first;
+	u32        n     = 1;
+
+	while(n < count && last->next != nullptr)
+	{
+		last = last->next;
+		n++;
+	}
+
+	bin.blocks      = last->next;
+	bin.num_blocks -= n;
+
+	CentralList& central_list = _central_lists[size_class];
+
+	lock(central_list.mutex);
+	std::lock_guard<std::mutex> lock(central_list.mutex, std::adopt_lock);
+
+	last->next               = central_list.blocks;
+	central_list.blocks      = first;
+	central_list.num_blocks += n;
+}
+
+//Central list must be locked
+bool ThreadCachingAllocator::allocateSpan(u8 size_class)
+{
+	void* memory;
+
+	{
+		lock(_backing_mutex);
+		std::lock_guard<std::mutex> lock(_backing_mutex, std::adopt_lock);
+
+		size_t used_memory = _backing_allocator.getUsedMemory();
+
+		memory = _backing_allocator.allocate(_span_size, BLOCK_ALIGNMENT);
+
+		if(memory == nullptr)
+			return false;
+
+		_used_memory += _backing_allocator.getUsedMemory() - used_memory;
+
+		Span* span = (Span*)memory;
+		span->next = _spans;
+		_spans     = span;
+	}
+
+	//Carve the span in blocks (first 16 bytes used by the span header)
+	u32 block_size = SIZE_CLASSES[size_class];
+	u32 num_blocks = (u32)((_span_size - BLOCK_ALIGNMENT) / block_size);
+
+	CentralList& central_list = _central_lists[size_class];
+
+	u8* block = (u8*)memory + BLOCK_ALIGNMENT;
+
+	for(u32 i = 0; i < num_blocks; i++)
+	{
+		FreeBlock* free_block = (FreeBlock*)block;
+		free_block->next      = central_list.blocks;
+		central_list.blocks   = free_block;
+
+		block += block_size;
+	}
+
+	central_list.num_blocks += num_blocks;
+
+	return true;
+}
+
+void ThreadCachingAllocator::flushThreadCache()
+{
+	ASSERT("THREAD_ID out of range" && THREAD_ID < _num_threads);
+
+	std::unique_lock<std::mutex> external_lock;
+
+	if(THREAD_ID == 0)
+		external_lock = std::unique_lock<std::mutex>(_external_cache_mutex);
+
+	ThreadCache& cache = _caches.get();
+
+	for(u8 i = 0; i < NUM_SIZE_CLASSES; i++)
+	{
+		if(cache.bins[i].num_blocks > 0)
+		{
+			cache.num_flushes++;
+
+			flush(cache.bins[i], i, cache.bins[i].num_blocks);
+		}
+	}
+}
+
+ThreadCachingAllocatorStats ThreadCachingAllocator::getStats() const
+{
+	ThreadCachingAllocatorStats stats = {};
+
+	for(u8 i = 0; i < _num_threads; i++)
+	{
+		const ThreadCache& cache = _caches[i];
+
+		stats.num_allocations        += cache.num_allocations;
+		stats.num_hits               += cache.num_hits;
+		stats.num_refills            += cache.num_refills;
+		stats.num_flushes            += cache.num_flushes;
+		stats.num_cross_thread_frees += cache.num_cross_thread_frees;
+		stats.num_large_allocations  += cache.num_large_allocations;
+	}
+
+	stats.num_contentions = _num_contentions.load(std::memory_order_relaxed);
+	stats.backing_memory  = _used_memory;
+
+	return stats;
+}
+
+u8 ThreadCachingAllocator::getSizeClass(size_t size) const
+{
+	return _size_class_lookup[(size + sizeof(BlockHeader) + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT];
+}
+
+void ThreadCachingAllocator::lock(std::mutex& mutex)
+{
+	if(!mutex.try_lock())
+	{
+		_num_contentions.fetch_add(1, std::memory_order_relaxed);
+
+		mutex.lock();
+	}
+}
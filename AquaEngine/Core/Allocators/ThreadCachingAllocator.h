@@ -0,0 +1,143 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Allocator.h"
+
+#include "..\ThreadLocalArray.h"
+
+#include "..\..\AquaTypes.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace aqua
+{
+	struct ThreadCachingAllocatorStats
+	{
+		u64 num_allocations;
+		u64 num_hits;            //allocations served by the thread's cache
+		u64 num_refills;         //batches taken from the central lists
+		u64 num_flushes;         //batches returned to the central lists
+		u64 num_cross_thread_frees;
+		u64 num_large_allocations; //too big or too aligned for the caches, go straight to the backing allocator
+		u64 num_contentions;     //times a lock was already taken
+
+		size_t backing_memory;   //memory taken from the backing allocator
+	};
+
+	//Thread safe front-end for single threaded allocators (eg: FreeListAllocator).
+	//Small allocations (<= MAX_CACHED_SIZE, alignment <= 16) are served without locks from per thread bins indexed by
+	//THREAD_ID. Bins are refilled from (and flushed to) central lists in batches, central lists get memory from the
+	//backing allocator in spans that are only returned when the allocator is destroyed.
+	//Blocks freed by a thread other than the one that allocated them go to the freeing thread's bins.
+	//THREAD_ID 0 is shared by every thread that isn't a JobManager worker so its bins are locked.
+	class ThreadCachingAllocator : public Allocator
+	{
+	public:
+		ThreadCachingAllocator(Allocator& backing_allocator, u8 num_threads, size_t span_size = DEFAULT_SPAN_SIZE);
+		~ThreadCachingAllocator();
+
+		void* allocate(size_t size, u8 alignment = DEFAULT_ALIGNMENT) override;
+
+		void deallocate(void* p) override;
+
+		//Returns every block in the calling thread's bins to the central lists
+		void flushThreadCache();
+
+		//Exact only while no other thread is using the allocator
+		ThreadCachingAllocatorStats getStats() const;
+
+		static const size_t DEFAULT_SPAN_SIZE = 64 * 1024;
+		static const size_t MAX_CACHED_SIZE   = 2048 - 16;
+
+	private:
+		ThreadCachingAllocator(const ThreadCachingAllocator&);
+		ThreadCachingAllocator& operator=(const ThreadCachingAllocator&);
+
+		static const u32 NUM_SIZE_CLASSES = 23;
+		static const u8  LARGE_SIZE_CLASS = 0xFF;
+		static const u8  BLOCK_ALIGNMENT  = 16;
+
+		//In front of every block, keeps blocks 16 bytes aligned
+		struct BlockHeader
+		{
+			u8  size_class;
+			u8  thread;     //THREAD_ID of the allocating thread
+			u16 padding;
+			u32 magic_number;
+			u64 offset;     //large allocations: distance from the start of the backing allocation
+		};
+
+		static_assert(sizeof(BlockHeader) == 16, "sizeof(BlockHeader) != 16");
+
+		struct FreeBlock
+		{
+			FreeBlock* next;
+		};
+
+		struct Bin
+		{
+			FreeBlock* blocks;
+			u32        num_blocks;
+		};
+
+		struct ThreadCache
+		{
+			Bin bins[NUM_SIZE_CLASSES];
+
+			u64 num_allocations;
+			u64 num_deallocations;
+			u64 num_hits;
+			u64 num_refills;
+			u64 num_flushes;
+			u64 num_cross_thread_frees;
+			u64 num_large_allocations;
+		};
+
+		struct CentralList
+		{
+			std::mutex mutex;
+			FreeBlock* blocks;
+			u32        num_blocks;
+		};
+
+		struct Span
+		{
+			Span* next;
+		};
+
+		u8    getSizeClass(size_t size) const;
+
+		void* allocateFromCache(ThreadCache& cache, size_t size, u8 alignment);
+		void  deallocateToCache(ThreadCache& cache, void* p);
+
+		void* allocateLarge(ThreadCache& cache, size_t size, u8 alignment);
+		void  deallocateLarge(BlockHeader* header);
+
+		void  refill(Bin& bin, u8 size_class);
+		void  flush(Bin& bin, u8 size_class, u32 count);
+		bool  allocateSpan(u8 size_class);
+
+		void  lock(std::mutex& mutex);
+
+		static const u32 SIZE_CLASSES[NUM_SIZE_CLASSES]; //block sizes including the header
+
+		Allocator&                    _backing_allocator;
+		std::mutex                    _backing_mutex;
+		Span*                         _spans;
+		size_t                        _span_size;
+
+		u8                            _num_threads;
+		ThreadLocalArray<ThreadCache> _caches;
+		std::mutex                    _external_cache_mutex; //THREAD_ID 0
+
+		CentralList                   _central_lists[NUM_SIZE_CLASSES];
+		u32                           _batch_sizes[NUM_SIZE_CLASSES];
+		u8                            _size_class_lookup[(MAX_CACHED_SIZE + sizeof(BlockHeader)) / BLOCK_ALIGNMENT + 1]; //indexed by (size + header) / 16 rounded up
+
+		std::atomic<u64>              _num_contentions;
+	};
+};
@@ -0,0 +1,114 @@
+#include "VirtualLinearAllocator.h"
+
+#include "..\VirtualMemory.h"
+
+#include "..\..\Utilities\Debug.h"
+
+using namespace aqua;
+
+static size_t roundUp(size_t size, size_t granularity)
+{
+	return (size + granularity - 1) / granularity * granularity;
+}
+
+VirtualLinearAllocator::VirtualLinearAllocator(size_t reserve_size, size_t commit_granularity, size_t decommit_threshold)
+	: LinearAllocator(reserve_size, nullptr), _committed_size(0), _decommit_threshold(decommit_threshold), _high_water_mark(0)
+{
+	_commit_granularity = roundUp(commit_granularity, virtual_memory::getPageSize());
+	_size               = roundUp(reserve_size, _commit_granularity);
+
+	_start       = virtual_memory::reserve(_size);
+	_current_pos = _start;
+
+	ASSERT("Failed to reserve address space" && _start != nullptr);
+}
+
+VirtualLinearAllocator::~VirtualLinearAllocator()
+{
+	if(_start != nullptr)
+		virtual_memory::release(_start, _size);
+
+	_start       = nullptr;
+	_current_pos = nullptr;
+}
+
+void* VirtualLinearAllocator::allocate(size_t size, u8 alignment)
+{
+	ASSERT(size != 0 && alignment != 0);
+
+	if(_start == nullptr)
+		return nullptr;
+
+	u8 adjustment = pointer_math::alignForwardAdjustment(_current_pos, alignment);
+
+	size_t new_used_memory = _used_memory + adjustment + size;
+
+	if(new_used_memory > _size)
+		return nullptr;
+
+	if(new_used_memory > _committed_size)
+	{
+		size_t commit_size = roundUp(new_used_memory - _committed_size, _commit_granularity);
+
+		if(!virtual_memory::commit(pointer_math::add(_start, _committed_size), commit_size))
+			return nullptr;
+
+		_committed_size += commit_size;
+	}
+
+	void* aligned_address = pointer_math::add(_current_pos, adjustment);
+
+	_current_pos = pointer_math::add(aligned_address, size);
+	_used_memory = new_used_memory;
+
+	if(_used_memory > _high_water_mark)
+		_high_water_mark = _used_memory;
+
+	return aligned_address;
+}
+
+void VirtualLinearAllocator::rewind(void* p)
+{
+	ASSERT(p >= _start && p <= _current_pos);
+
+	_current_pos = p;
+	_used_memory = (uptr)_current_pos - (uptr)_start;
+
+	decommitUnused();
+}
+
+void VirtualLinearAllocator::clear()
+{
+	_num_allocations = 0;
+	_used_memory     = 0;
+
+	_current_pos = _start;
+
+	decommitUnused();
+}
+
+size_t VirtualLinearAllocator::getCommittedSize() const
+{
+	return _committed_size;
+}
+
+size_t VirtualLinearAllocator::getHighWaterMark() const
+{
+	return _high_water_mark;
+}
+
+void VirtualLinearAllocator::decommitUnused()
+{
+	if(_decommit_threshold == NO_DECOMMIT)
+		return;
+
+	size_t keep_size = _used_memory > _decommit_threshold ? _used_memory : _decommit_threshold;
+	keep_size        = roundUp(keep_size, _commit_granularity);
+
+	if(_committed_size > keep_size)
+	{
+		virtual_memory::decommit(pointer_math::add(_start, keep_size), _committed_size - keep_size);
+
+		_committed_size = keep_size;
+	}
+}
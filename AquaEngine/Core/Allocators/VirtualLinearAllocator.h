@@ -0,0 +1,49 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "LinearAllocator.h"
+
+#include "..\..\AquaTypes.h"
+
+namespace aqua
+{
+	//Linear allocator that reserves reserve_size bytes of address space and commits pages as it grows
+	//(commit_granularity bytes at a time), so memory stays contiguous and there are no blocks to chain.
+	//rewind() and clear() are O(1). If decommit_threshold != NO_DECOMMIT, committed memory above
+	//max(decommit_threshold, used memory) is returned to the OS when rewinding, so a spike doesn't keep its memory.
+	class VirtualLinearAllocator : public LinearAllocator
+	{
+	public:
+		static const size_t DEFAULT_COMMIT_GRANULARITY = 64 * 1024;
+		static const size_t NO_DECOMMIT                = (size_t)-1;
+
+		VirtualLinearAllocator(size_t reserve_size, size_t commit_granularity = DEFAULT_COMMIT_GRANULARITY,
+							   size_t decommit_threshold = NO_DECOMMIT);
+		~VirtualLinearAllocator() override final;
+
+		void* allocate(size_t size, u8 alignment = DEFAULT_ALIGNMENT) override final;
+
+		void rewind(void* mark) override final;
+
+		void clear() override final;
+
+		size_t getCommittedSize() const;
+
+		//Peak used memory
+		size_t getHighWaterMark() const;
+
+	private:
+		VirtualLinearAllocator(const VirtualLinearAllocator&);
+		VirtualLinearAllocator& operator=(const VirtualLinearAllocator&);
+
+		void decommitUnused();
+
+		size_t _committed_size;
+		size_t _commit_granularity;
+		size_t _decommit_threshold;
+		size_t _high_water_mark;
+	};
+};
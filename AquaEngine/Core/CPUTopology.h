@@ -0,0 +1,69 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "..\AquaTypes.h"
+
+namespace aqua
+{
+	static const u32 MAX_NUM_CPUS = 256;
+
+	struct CPUSet
+	{
+		u64 bits[MAX_NUM_CPUS / 64];
+
+		void clear()
+		{
+			for(u32 i = 0; i < MAX_NUM_CPUS / 64; i++)
+				bits[i] = 0;
+		}
+
+		void add(u32 cpu)
+		{
+			bits[cpu / 64] |= (u64)1 << (cpu % 64);
+		}
+
+		bool contains(u32 cpu) const
+		{
+			return (bits[cpu / 64] & ((u64)1 << (cpu % 64))) != 0;
+		}
+
+		bool empty() const
+		{
+			for(u32 i = 0; i < MAX_NUM_CPUS / 64; i++)
+			{
+				if(bits[i] != 0)
+					return false;
+			}
+
+			return true;
+		}
+	};
+
+	//Logical CPUs the process is allowed to run on
+	struct CPUTopology
+	{
+		struct LogicalCPU
+		{
+			u16 id;   //OS id (used for affinity)
+			u16 core; //Index of the physical core (SMT siblings share it)
+			u16 node; //NUMA node (OS id, ids might not be contiguous)
+		};
+
+		u32        num_cpus;
+		u32        num_cores;
+		u32        num_nodes; //nodes with CPUs the process can use
+		LogicalCPU cpus[MAX_NUM_CPUS]; //Sorted by core
+	};
+
+	namespace cpu_topology
+	{
+		//Returns false if the topology couldn't be read (out contains every CPU as a separate core in node 0)
+		bool query(CPUTopology& out);
+
+		//Restricts the calling thread to the CPUs in set
+		bool setThreadAffinity(const CPUSet& set);
+	};
+};
@@ -0,0 +1,203 @@
+#ifdef __linux__
+
+#include "CPUTopology.h"
+
+#include <sched.h>
+#include <pthread.h>
+
+#include <cstdio>
+#include <cstring>
+
+using namespace aqua;
+
+//Topology is read from sysfs, only CPUs in the process affinity mask (sched_getaffinity) are used
+
+static bool readU32(const char* path, u32& out)
+{
+	FILE* file = fopen(path, "r");
+
+	if(file == nullptr)
+		return false;
+
+	bool ok = fscanf(file, "%u", &out) == 1;
+
+	fclose(file);
+
+	return ok;
+}
+
+//Parses cpu lists like "0-3,8-11"
+static bool readCPUList(const char* path, CPUSet& out)
+{
+	FILE* file = fopen(path, "r");
+
+	if(file == nullptr)
+		return false;
+
+	out.clear();
+
+	u32 first;
+
+	while(fscanf(file, "%u", &first) == 1)
+	{
+		u32 last = first;
+
+		int c = fgetc(file);
+
+		if(c == '-')
+		{
+			if(fscanf(file, "%u", &last) != 1)
+				break;
+
+			c = fgetc(file);
+		}
+
+		for(u32 i = first; i <= last && i < MAX_NUM_CPUS; i++)
+			out.add(i);
+
+		if(c != ',')
+			break;
+	}
+
+	fclose(file);
+
+	return true;
+}
+
+bool cpu_topology::query(CPUTopology& out)
+{
+	cpu_set_t process_set;
+	CPU_ZERO(&process_set);
+
+	if(sched_getaffinity(0, sizeof(process_set), &process_set) != 0)
+		CPU_SET(0, &process_set);
+
+	//Fallback: every allowed CPU is a core in node 0
+	out.num_cpus  = 0;
+	out.num_cores = 0;
+	out.num_nodes = 1;
+
+	for(u32 i = 0; i < MAX_NUM_CPUS && i < CPU_SETSIZE; i++)
+	{
+		if(CPU_ISSET(i, &process_set))
+		{
+			CPUTopology::LogicalCPU& cpu = out.cpus[out.num_cpus++];
+			cpu.id   = (u16)i;
+			cpu.core = (u16)out.num_cores++;
+			cpu.node = 0;
+		}
+	}
+
+	//(package, core_id) of each allowed cpu
+	u32 package_ids[MAX_NUM_CPUS];
+	u32 core_ids[MAX_NUM_CPUS];
+
+	char path[128];
+
+	for(u32 i = 0; i < out.num_cpus; i++)
+	{
+		sprintf(path, "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", out.cpus[i].id);
+
+		if(!readU32(path, package_ids[i]))
+			return false;
+
+		sprintf(path, "/sys/devices/system/cpu/cpu%u/topology/core_id", out.cpus[i].id);
+
+		if(!readU32(path, core_ids[i]))
+			return false;
+	}
+
+	//Nodes keep their OS ids, which don't have to be contiguous (eg: 0 and 2), so every online node is checked.
+	//Machines without NUMA support don't have the node directory
+	u16 cpu_nodes[MAX_NUM_CPUS];
+	memset(cpu_nodes, 0, sizeof(cpu_nodes));
+
+	u32 num_nodes = 0;
+
+	CPUSet online_nodes; //same list format as cpus
+
+	if(readCPUList("/sys/devices/system/node/online", online_nodes))
+	{
+		for(u32 node = 0; node < MAX_NUM_CPUS; node++)
+		{
+			if(!online_nodes.contains(node))
+				continue;
+
+			CPUSet node_set;
+
+			sprintf(path, "/sys/devices/system/node/node%u/cpulist", node);
+
+			if(!readCPUList(path, node_set))
+				continue;
+
+			bool used = false;
+
+			for(u32 i = 0; i < out.num_cpus; i++)
+			{
+				if(node_set.contains(out.cpus[i].id))
+				{
+					cpu_nodes[i] = (u16)node;
+					used         = true;
+				}
+			}
+
+			if(used)
+				num_nodes++;
+		}
+	}
+
+	//Assign core indices and sort by core so SMT siblings are next to each other
+	CPUTopology::LogicalCPU cpus[MAX_NUM_CPUS];
+	bool                    assigned[MAX_NUM_CPUS];
+	memset(assigned, 0, sizeof(assigned));
+
+	u32 num_cpus  = 0;
+	u32 num_cores = 0;
+
+	for(u32 i = 0; i < out.num_cpus; i++)
+	{
+		if(assigned[i])
+			continue;
+
+		for(u32 j = i; j < out.num_cpus; j++)
+		{
+			if(!assigned[j] && package_ids[j] == package_ids[i] && core_ids[j] == core_ids[i])
+			{
+				CPUTopology::LogicalCPU& cpu = cpus[num_cpus++];
+				cpu.id   = out.cpus[j].id;
+				cpu.core = (u16)num_cores;
+				cpu.node = cpu_nodes[j];
+
+				assigned[j] = true;
+			}
+		}
+
+		num_cores++;
+	}
+
+	memcpy(out.cpus, cpus, sizeof(CPUTopology::LogicalCPU) * num_cpus);
+
+	out.num_cores = num_cores;
+	out.num_nodes = num_nodes > 0 ? num_nodes : 1;
+
+	return true;
+}
+
+bool cpu_topology::setThreadAffinity(const CPUSet& set)
+{
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+
+	for(u32 i = 0; i < MAX_NUM_CPUS && i < CPU_SETSIZE; i++)
+	{
+		if(set.contains(i))
+			CPU_SET(i, &cpu_set);
+	}
+
+	if(CPU_COUNT(&cpu_set) == 0)
+		return false;
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifdef _WIN32
+
+#include "CPUTopology.h"
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif //WIN32_LEAN_AND_MEAN
+
+#include <Windows.h>
+
+#include <vector>
+
+using namespace aqua;
+
+//Only processor group 0 is used (up to 64 logical CPUs), threads can't be placed in other groups with SetThreadAffinityMask
+
+static void fallbackTopology(CPUTopology& out, DWORD_PTR process_mask)
+{
+	out.num_cpus  = 0;
+	out.num_cores = 0;
+	out.num_nodes = 1;
+
+	for(u32 i = 0; i < sizeof(DWORD_PTR) * 8; i++)
+	{
+		if(process_mask & ((DWORD_PTR)1 << i))
+		{
+			CPUTopology::LogicalCPU& cpu = out.cpus[out.num_cpus++];
+			cpu.id   = (u16)i;
+			cpu.core = (u16)out.num_cores++;
+			cpu.node = 0;
+		}
+	}
+}
+
+bool cpu_topology::query(CPUTopology& out)
+{
+	DWORD_PTR process_mask;
+	DWORD_PTR system_mask;
+
+	if(!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask) || process_mask == 0)
+		process_mask = 1;
+
+	fallbackTopology(out, process_mask);
+
+	DWORD length = 0;
+	GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+
+	if(GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+		return false;
+
+	std::vector<u8> buffer(length);
+
+	if(!GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buffer.data(), &length))
+		return false;
+
+	u16 cpu_core[64];
+	u16 cpu_node[64];
+
+	memset(cpu_core, 0xFF, sizeof(cpu_core));
+	memset(cpu_node, 0, sizeof(cpu_node));
+
+	u32 num_cores = 0;
+	u32 num_nodes = 0;
+
+	for(DWORD offset = 0; offset < length;)
+	{
+		const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX* info = (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)(buffer.data() + offset);
+
+		if(info->Relationship == RelationProcessorCore)
+		{
+			const GROUP_AFFINITY& group = info->Processor.GroupMask[0];
+
+			if(group.Group == 0 && (group.Mask & process_mask) != 0)
+			{
+				for(u32 i = 0; i < 64; i++)
+				{
+					if(group.Mask & process_mask & ((KAFFINITY)1 << i))
+						cpu_core[i] = (u16)num_cores;
+				}
+
+				num_cores++;
+			}
+		}
+		else if(info->Relationship == RelationNumaNode)
+		{
+			const GROUP_AFFINITY& group = info->NumaNode.GroupMask;
+
+			if(group.Group == 0 && (group.Mask & process_mask) != 0)
+			{
+				for(u32 i = 0; i < 64; i++)
+				{
+					if(group.Mask & ((KAFFINITY)1 << i))
+						cpu_node[i] = (u16)info->NumaNode.NodeNumber; //OS id, might not be contiguous
+				}
+
+				num_nodes++;
+			}
+		}
+
+		offset += info->Size;
+	}
+
+	if(num_cores == 0)
+		return false;
+
+	//Sort by core so SMT siblings are next to each other
+	out.num_cpus  = 0;
+	out.num_cores = num_cores;
+	out.num_nodes = num_nodes > 0 ? num_nodes : 1;
+
+	for(u32 core = 0; core < num_cores; core++)
+	{
+		for(u32 i = 0; i < 64; i++)
+		{
+			if(cpu_core[i] == core)
+			{
+				CPUTopology::LogicalCPU& cpu = out.cpus[out.num_cpus++];
+				cpu.id   = (u16)i;
+				cpu.core = (u16)core;
+				cpu.node = cpu_node[i];
+			}
+		}
+	}
+
+	return true;
+}
+
+bool cpu_topology::setThreadAffinity(const CPUSet& set)
+{
+	DWORD_PTR mask = (DWORD_PTR)set.bits[0];
+
+	if(mask == 0)
+		return false;
+
+	return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+
+#endif
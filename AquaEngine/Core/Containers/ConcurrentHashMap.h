@@ -0,0 +1,456 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "..\Allocators\Allocator.h"
+#include "..\ThreadLocalArray.h"
+
+#include "..\..\AquaTypes.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace aqua
+{
+	//Hash map for read-mostly data shared between threads (eg: entity lookups from jobs while the main thread
+	//creates entities).
+	//Reads are lock-free and only write the reader counter of their thread. Writers are serialized with a mutex.
+	//Open addressing (linear probing) where a slot goes EMPTY -> FILLED -> DELETED and is never reused, so a
+	//reader that sees a FILLED slot always reads the key it was filled with. Values are atomic so updates are
+	//seen whole.
+	//When FILLED + DELETED slots reach 3/4 of the table it's rebuilt (same capacity if most of them are tombstones)
+	//and the new table is published. The old table is freed once every reader that could be using it has finished:
+	//readers register in the counter of the current epoch parity, the writer increments the epoch and waits for the
+	//counters of the previous parity to drain (rebuilds are rare and read sections are short).
+	//Reader counters are indexed by THREAD_ID (non worker threads share counter 0, which is still correct).
+	//K must be convertible to u64 and V trivially copyable (lookup returns a copy).
+	//The allocator is only used by writers, with the map's lock held.
+	template<class K, class V>
+	class ConcurrentHashMap
+	{
+	public:
+		ConcurrentHashMap(Allocator& allocator, size_t initial_capacity = 64);
+		~ConcurrentHashMap();
+
+		//Readers: any thread, lock-free
+
+		bool has(K key) const;
+
+		V lookup(K key, const V& default_value) const;
+
+		//out[i] = lookup(keys[i], default_value) in a single read section
+		void lookupBatch(const K* keys, size_t n, V* out, const V& default_value) const;
+
+		//Writers: any thread, serialized
+
+		//Replaces the value if the key already exists
+		void insert(K key, const V& value);
+
+		bool remove(K key);
+
+		void reserve(size_t size);
+
+		void clear();
+
+		size_t size() const;
+
+		u32 getNumRebuilds() const;
+
+	private:
+		ConcurrentHashMap(const ConcurrentHashMap&);
+		ConcurrentHashMap& operator=(const ConcurrentHashMap&);
+
+		static const u8 MAX_NUM_READER_SLOTS = 64;
+
+		enum State : u8
+		{
+			EMPTY,
+			FILLED,
+			DELETED
+		};
+
+		struct Slot
+		{
+			std::atomic<u8> state;
+			K               key;
+			std::atomic<V>  value;
+		};
+
+		struct Table
+		{
+			size_t capacity;   //power of 2
+			size_t num_used;   //FILLED + DELETED slots
+			Slot*  slots;
+		};
+
+		struct ReaderCounters
+		{
+			std::atomic<u32> count[2]; //readers that started in an even/odd epoch
+		};
+
+		static u64 hash(K key);
+
+		static size_t getMaxLoad(size_t capacity);
+
+		u32  beginRead() const;
+		void endRead(u32 parity) const;
+
+		//Returns when no reader can still be using a table unpublished before the call
+		void synchronize();
+
+		Table* allocateTable(size_t capacity);
+		void   deallocateTable(Table* table);
+
+		static const Slot* find(const Table* table, K key);
+
+		//FILLED slot with key or EMPTY slot where it must be inserted
+		static Slot* findInsertSlot(Table* table, K key);
+
+		//Writer lock must be held
+		void rebuild(size_t capacity);
+		void publish(Table* table);
+
+		Allocator&                               _allocator;
+
+		std::atomic<Table*>                      _table;
+		std::atomic<u32>                         _epoch;
+
+		mutable ThreadLocalArray<ReaderCounters> _readers;
+
+		std::mutex                               _write_mutex;
+
+		std::atomic<size_t>                      _size;
+		std::atomic<u32>                         _num_rebuilds;
+
+		size_t                                   _initial_capacity;
+	};
+
+	//Definitions
+
+	template<class K, class V>
+	ConcurrentHashMap<K, V>::ConcurrentHashMap(Allocator& allocator, size_t initial_capacity)
+		: _allocator(allocator), _epoch(0), _readers(allocator, MAX_NUM_READER_SLOTS), _size(0), _num_rebuilds(0)
+	{
+		_initial_capacity = 16;
+
+		while(_initial_capacity < initial_capacity)
+			_initial_capacity *= 2;
+
+		//ThreadLocalArray doesn't construct its elements
+		for(u32 i = 0; i < MAX_NUM_READER_SLOTS; i++)
+		{
+			_readers[i].count[0].store(0, std::memory_order_relaxed);
+			_readers[i].count[1].store(0, std::memory_order_relaxed);
+		}
+
+		_table.store(allocateTable(_initial_capacity));
+	}
+
+	template<class K, class V>
+	ConcurrentHashMap<K, V>::~ConcurrentHashMap()
+	{
+		deallocateTable(_table.load());
+	}
+
+	template<class K, class V>
+	u64 ConcurrentHashMap<K, V>::hash(K key)
+	{
+		//Murmur3 finalizer
+		u64 h = (u64)key;
+
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ULL;
+		h ^= h >> 33;
+
+		return h;
+	}
+
+	template<class K, class V>
+	size_t ConcurrentHashMap<K, V>::getMaxLoad(size_t capacity)
+	{
+		return capacity - capacity / 4;
+	}
+
+	template<class K, class V>
+	u32 ConcurrentHashMap<K, V>::beginRead() const
+	{
+		ReaderCounters& counters = _readers[THREAD_ID % MAX_NUM_READER_SLOTS];
+
+		while(true)
+		{
+			u32 epoch = _epoch.load();
+
+			counters.count[epoch & 1].fetch_add(1);
+
+			//If the epoch changed the writer might have checked our counter before the increment, retry in the new epoch
+			if(_epoch.load() == epoch)
+				return epoch & 1;
+
+			counters.count[epoch & 1].fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	template<class K, class V>
+	void ConcurrentHashMap<K, V>::endRead(u32 parity) const
+	{
+		_readers[THREAD_ID % MAX_NUM_READER_SLOTS].count[parity].fetch_sub(1, std::memory_order_release);
+	}
+
+	template<class K, class V>
+	void ConcurrentHashMap<K, V>::synchronize()
+	{
+		u32 parity = _epoch.fetch_add(1) & 1;
+
+		//Readers that started before the increment are counted in the previous parity
+		for(u32 i = 0; i < MAX_NUM_READER_SLOTS; i++)
+		{
+			while(_readers[i].count[parity].load() != 0)
+				std::this_thread::yield();
+		}
+	}
+
+	template<class K, class V>
+	typename ConcurrentHashMap<K, V>::Table* ConcurrentHashMap<K, V>::allocateTable(size_t capacity)
+	{
+		static const u8 ALIGNMENT = 64;
+
+		size_t slots_offset = (sizeof(Table) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+		Table* table = (Table*)_allocator.allocate(slots_offset + capacity * sizeof(Slot), ALIGNMENT);
+
+		ASSERT(table != nullptr);
+
+		table->capacity = capacity;
+		table->num_used = 0;
+		table->slots    = (Slot*)((u8*)table + slots_offset);
+
+		for(size_t i = 0; i < capacity; i++)
+			table->slots[i].state.store(EMPTY, std::memory_order_relaxed);
+
+		return table;
+	}
+
+	template<class K, class V>
+	void ConcurrentHashMap<K, V>::deallocateTable(Table* table)
+	{
+		_allocator.deallocate(table);
+	}
+
+	template<class K, class V>
+	const typename ConcurrentHashMap<K, V>::Slot* ConcurrentHashMap<K, V>::find(const Table* table, K key)
+	{
+		size_t mask = table->capacity - 1;
+
+		//There's always an EMPTY slot
+		for(size_t i = (size_t)hash(key) & mask; ; i = (i + 1) & mask)
+		{
+			const Slot& slot = table->slots[i];
+
+			u8 state = slot.state.load(std::memory_order_acquire);
+
+			if(state == EMPTY)
+				return nullptr;
+
+			if(state == FILLED && slot.key == key)
+				return &slot;
+		}
+	}
+
+	template<class K, class V>
+	typename ConcurrentHashMap<K, V>::Slot* ConcurrentHashMap<K, V>::findInsertSlot(Table* table, K key)
+	{
+		size_t mask = table->capacity - 1;
+
+		for(size_t i = (size_t)hash(key) & mask; ; i = (i + 1) & mask)
+		{
+			Slot& slot = table->slots[i];
+
+			u8 state = slot.state.load(std::memory_order_relaxed);
+
+			if(state == EMPTY || (state == FILLED && slot.key == key))
+				return &slot;
+		}
+	}
+
+	template<class K, class V>
+	bool ConcurrentHashMap<K, V>::has(K key) const
+	{
+		u32 parity = beginRead();
+
+		bool result = find(_table.load(), key) != nullptr;
+
+		endRead(parity);
+
+		return result;
+	}
+
+	template<class K, class V>
+	V ConcurrentHashMap<K, V>::lookup(K key, const V& default_value) const
+	{
+		u32 parity = beginRead();
+
+		const Slot* slot = find(_table.load(), key);
+
+		V value = slot != nullptr ? slot->value.load(std::memory_order_acquire) : default_value;
+
+		endRead(parity);
+
+		return value;
+	}
+
+	template<class K, class V>
+	void ConcurrentHashMap<K, V>::lookupBatch(const K* keys, size_t n, V* out, const V& default_value) const
+	{
+		u32 parity = beginRead();
+
+		const Table* table = _table.load();
+
+		for(size_t i = 0; i < n; i++)
+		{
+			const Slot* slot = find(table, keys[i]);
+
+			out[i] = slot != nullptr ? slot->value.load(std::memory_order_acquire) : default_value;
+		}
+
+		endRead(parity);
+	}
+
+	template<class K, class V>
+	void ConcurrentHashMap<K, V>::insert(K key, const V& value)
+	{
+		std::lock_guard<std::mutex> lock(_write_mutex);
+
+		Table* table = _table.load(std::memory_order_relaxed);
+		Slot*  slot  = findInsertSlot(table, key);
+
+		if(slot->state.load(std::memory_order_relaxed) == FILLED)
+		{
+			slot->value.store(value, std::memory_order_release);
+			return;
+		}
+
+		if(table->num_used + 1 > getMaxLoad(table->capacity))
+		{
+			//Rebuild with live entries using at most half of the max load (same capacity if most slots are tombstones)
+			size_t num_entries = _size.load(std::memory_order_relaxed) + 1;
+			size_t capacity    = table->capacity;
+
+			while(num_entries > getMaxLoad(capacity) / 2)
+				capacity *= 2;
+
+			rebuild(capacity);
+
+			table = _table.load(std::memory_order_relaxed);
+			slot  = findInsertSlot(table, key);
+		}
+
+		slot->key = key;
+		slot->value.store(value, std::memory_order_relaxed);
+		slot->state.store(FILLED, std::memory_order_release);
+
+		table->num_used++;
+
+		_size.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	template<class K, class V>
+	bool ConcurrentHashMap<K, V>::remove(K key)
+	{
+		std::lock_guard<std::mutex> lock(_write_mutex);
+
+		Slot* slot = (Slot*)find(_table.load(std::memory_order_relaxed), key);
+
+		if(slot == nullptr)
+			return false;
+
+		//Stays a tombstone until the next rebuild, readers never see the slot with another key
+		slot->state.store(DELETED, std::memory_order_release);
+
+		_size.fetch_sub(1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	template<class K, class V>
+	void ConcurrentHashMap<K, V>::reserve(size_t size)
+	{
+		std::lock_guard<std::mutex> lock(_write_mutex);
+
+		size_t capacity = _table.load(std::memory_order_relaxed)->capacity;
+
+		if(size <= getMaxLoad(capacity))
+			return;
+
+		while(size > getMaxLoad(capacity))
+			capacity *= 2;
+
+		rebuild(capacity);
+	}
+
+	template<class K, class V>
+	void ConcurrentHashMap<K, V>::clear()
+	{
+		std::lock_guard<std::mutex> lock(_write_mutex);
+
+		publish(allocateTable(_initial_capacity));
+
+		_size.store(0, std::memory_order_relaxed);
+	}
+
+	template<class K, class V>
+	size_t ConcurrentHashMap<K, V>::size() const
+	{
+		return _size.load(std::memory_order_relaxed);
+	}
+
+	template<class K, class V>
+	u32 ConcurrentHashMap<K, V>::getNumRebuilds() const
+	{
+		return _num_rebuilds.load(std::memory_order_relaxed);
+	}
+
+	template<class K, class V>
+	void ConcurrentHashMap<K, V>::rebuild(size_t capacity)
+	{
+		Table* old_table = _table.load(std::memory_order_relaxed);
+		Table* table     = allocateTable(capacity);
+
+		for(size_t i = 0; i < old_table->capacity; i++)
+		{
+			const Slot& old_slot = old_table->slots[i];
+
+			if(old_slot.state.load(std::memory_order_relaxed) != FILLED)
+				continue;
+
+			Slot* slot = findInsertSlot(table, old_slot.key);
+
+			slot->key = old_slot.key;
+			slot->value.store(old_slot.value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			slot->state.store(FILLED, std::memory_order_relaxed);
+
+			table->num_used++;
+		}
+
+		publish(table);
+
+		_num_rebuilds.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	template<class K, class V>
+	void ConcurrentHashMap<K, V>::publish(Table* table)
+	{
+		Table* old_table = _table.load(std::memory_order_relaxed);
+
+		//Readers that load the table after this see the new table completely initialized
+		_table.store(table);
+
+		synchronize();
+
+		deallocateTable(old_table);
+	}
+};
@@ -0,0 +1,302 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "..\Allocators\Allocator.h"
+
+#include "..\..\AquaTypes.h"
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace aqua
+{
+	//-----------------------------------------------------------------
+	//-- MPMC QUEUE
+	//-----------------------------------------------------------------
+
+	//Bounded lock-free multi-producer/multi-consumer ring (Dmitry Vyukov's queue) to pass work between threads.
+	//Every cell has a sequence number: cell i is free for the push at position pos when sequence == pos and holds the
+	//value pushed at pos when sequence == pos + 1. Producers/consumers claim a position with a CAS on tail/head and
+	//publish the cell by updating its sequence, so there's no shared counter of elements.
+	//tryPush/tryPop fail instead of waiting when the queue is full/empty.
+	template<class T>
+	class MPMCQueue
+	{
+	public:
+		//capacity is rounded up to a power of 2
+		MPMCQueue(Allocator& allocator, size_t capacity);
+		~MPMCQueue();
+
+		//Any thread. Returns false if the queue is full
+		bool tryPush(const T& value);
+
+		//Any thread. Returns false if the queue is empty
+		bool tryPop(T& out);
+
+		size_t capacity() const;
+
+	private:
+		MPMCQueue(const MPMCQueue&);
+		MPMCQueue& operator=(const MPMCQueue&);
+
+		static const u8 CACHE_LINE_SIZE = 64;
+
+		struct Cell
+		{
+			std::atomic<size_t>                                          sequence;
+			typename std::aligned_storage<sizeof(T), __alignof(T)>::type value;
+		};
+
+		Allocator&          _allocator;
+		Cell*               _cells;
+		size_t              _mask;
+
+		//tail (producers) and head (consumers) in different cache lines (whole lines of padding because the queue
+		//itself might not be cache line aligned)
+		u8                  _padding0[CACHE_LINE_SIZE];
+		std::atomic<size_t> _tail;
+		u8                  _padding1[CACHE_LINE_SIZE];
+		std::atomic<size_t> _head;
+		u8                  _padding2[CACHE_LINE_SIZE];
+	};
+
+	//Definitions
+
+	template<class T>
+	MPMCQueue<T>::MPMCQueue(Allocator& allocator, size_t capacity) : _allocator(allocator), _tail(0), _head(0)
+	{
+		size_t size = 2;
+
+		while(size < capacity)
+			size *= 2;
+
+		_mask  = size - 1;
+		_cells = (Cell*)_allocator.allocate(size * sizeof(Cell), CACHE_LINE_SIZE);
+
+		ASSERT(_cells != nullptr);
+
+		for(size_t i = 0; i < size; i++)
+			_cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	template<class T>
+	MPMCQueue<T>::~MPMCQueue()
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+
+		for(size_t i = _head.load(std::memory_order_relaxed); i != tail; i++)
+			((T*)&_cells[i & _mask].value)->~T();
+
+		_allocator.deallocate(_cells);
+	}
+
+	template<class T>
+	bool MPMCQueue<T>::tryPush(const T& value)
+	{
+		size_t pos = _tail.load(std::memory_order_relaxed);
+		Cell*  cell;
+
+		while(true)
+		{
+			cell = &_cells[pos & _mask];
+
+			size_t    sequence = cell->sequence.load(std::memory_order_acquire);
+			ptrdiff_t diff     = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+
+			if(diff == 0)
+			{
+				//Cell free, claim the position (pos is updated if another producer claimed it first)
+				if(_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if(diff < 0)
+			{
+				//Cell still holds the value pushed one lap ago
+				return false;
+			}
+			else
+			{
+				pos = _tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		new (&cell->value) T(value);
+
+		cell->sequence.store(pos + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	template<class T>
+	bool MPMCQueue<T>::tryPop(T& out)
+	{
+		size_t pos = _head.load(std::memory_order_relaxed);
+		Cell*  cell;
+
+		while(true)
+		{
+			cell = &_cells[pos & _mask];
+
+			size_t    sequence = cell->sequence.load(std::memory_order_acquire);
+			ptrdiff_t diff     = (ptrdiff_t)sequence - (ptrdiff_t)(pos + 1);
+
+			if(diff == 0)
+			{
+				if(_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if(diff < 0)
+			{
+				//Nothing pushed at pos yet
+				return false;
+			}
+			else
+			{
+				pos = _head.load(std::memory_order_relaxed);
+			}
+		}
+
+		T* value = (T*)&cell->value;
+
+		out = *value;
+		value->~T();
+
+		//Free for the push one lap later
+		cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	template<class T>
+	size_t MPMCQueue<T>::capacity() const
+	{
+		return _mask + 1;
+	}
+
+	//-----------------------------------------------------------------
+	//-- SPSC QUEUE
+	//-----------------------------------------------------------------
+
+	//Bounded lock-free ring for exactly one producer thread and one consumer thread.
+	//No CAS: the producer owns tail and the consumer owns head, each keeps a cached copy of the other index and only
+	//reloads it when the ring looks full/empty, so in the common case push and pop don't touch the other thread's
+	//cache line.
+	template<class T>
+	class SPSCQueue
+	{
+	public:
+		//capacity is rounded up to a power of 2
+		SPSCQueue(Allocator& allocator, size_t capacity);
+		~SPSCQueue();
+
+		//Producer thread only. Returns false if the queue is full
+		bool tryPush(const T& value);
+
+		//Consumer thread only. Returns false if the queue is empty
+		bool tryPop(T& out);
+
+		size_t capacity() const;
+
+	private:
+		SPSCQueue(const SPSCQueue&);
+		SPSCQueue& operator=(const SPSCQueue&);
+
+		static const u8 CACHE_LINE_SIZE = 64;
+
+		typedef typename std::aligned_storage<sizeof(T), __alignof(T)>::type Slot;
+
+		Allocator&          _allocator;
+		Slot*               _slots;
+		size_t              _mask;
+
+		u8                  _padding0[CACHE_LINE_SIZE];
+		std::atomic<size_t> _tail;
+		size_t              _cached_head; //producer's copy of _head
+		u8                  _padding1[CACHE_LINE_SIZE];
+		std::atomic<size_t> _head;
+		size_t              _cached_tail; //consumer's copy of _tail
+		u8                  _padding2[CACHE_LINE_SIZE];
+	};
+
+	//Definitions
+
+	template<class T>
+	SPSCQueue<T>::SPSCQueue(Allocator& allocator, size_t capacity)
+		: _allocator(allocator), _tail(0), _cached_head(0), _head(0), _cached_tail(0)
+	{
+		size_t size = 2;
+
+		while(size < capacity)
+			size *= 2;
+
+		_mask  = size - 1;
+		_slots = (Slot*)_allocator.allocate(size * sizeof(Slot), CACHE_LINE_SIZE);
+
+		ASSERT(_slots != nullptr);
+	}
+
+	template<class T>
+	SPSCQueue<T>::~SPSCQueue()
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+
+		for(size_t i = _head.load(std::memory_order_relaxed); i != tail; i++)
+			((T*)&_slots[i & _mask])->~T();
+
+		_allocator.deallocate(_slots);
+	}
+
+	template<class T>
+	bool SPSCQueue<T>::tryPush(const T& value)
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+
+		if(tail - _cached_head > _mask)
+		{
+			_cached_head = _head.load(std::memory_order_acquire);
+
+			if(tail - _cached_head > _mask)
+				return false;
+		}
+
+		new (&_slots[tail & _mask]) T(value);
+
+		_tail.store(tail + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	template<class T>
+	bool SPSCQueue<T>::tryPop(T& out)
+	{
+		size_t head = _head.load(std::memory_order_relaxed);
+
+		if(head == _cached_tail)
+		{
+			_cached_tail = _tail.load(std::memory_order_acquire);
+
+			if(head == _cached_tail)
+				return false;
+		}
+
+		T* value = (T*)&_slots[head & _mask];
+
+		out = *value;
+		value->~T();
+
+		_head.store(head + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	template<class T>
+	size_t SPSCQueue<T>::capacity() const
+	{
+		return _mask + 1;
+	}
+};
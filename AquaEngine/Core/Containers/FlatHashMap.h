@@ -0,0 +1,497 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "..\Allocators\Allocator.h"
+
+#include "..\..\Utilities\PointerMath.h"
+
+#include "..\..\AquaTypes.h"
+
+#include <utility>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define AQUA_FLAT_HASH_MAP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace aqua
+{
+	//Open addressing hash map (Swiss table): a control byte per slot stores 7 bits of the hash (or EMPTY/DELETED)
+	//and lookups compare 16 control bytes at once (SSE2), so keys are only compared on a likely match.
+	//Keys are hashed (clustered entity ids don't cluster in the table), capacity is a power of 2 and groups of 16
+	//slots are probed quadratically. Max load is 7/8. Removing leaves a tombstone only if the group is full, and
+	//if most of the load is tombstones the table is rehashed at the same capacity instead of growing.
+	//Same API as HashMap but insert() replaces the value if the key already exists.
+	//K must be convertible to u64.
+	template<class K, class V>
+	class FlatHashMap
+	{
+	public:
+		FlatHashMap(Allocator& allocator);
+		~FlatHashMap();
+
+		bool has(K key) const;
+
+		// Returns the value stored for the specified key, or default_value if the key
+		// does not exist in the hash.
+		const V& lookup(K key, const V& default_value) const;
+
+		// Looks up n keys and stores the values in out (default_value for missing keys).
+		// Hashes LOOKUP_BATCH_SIZE keys and prefetches their first group (control bytes and slots)
+		// before resolving them, so the cache misses overlap.
+		void lookupBatch(const K* keys, size_t n, V* out, const V& default_value) const;
+
+		void insert(K key, const V& value);
+
+		bool remove(K key);
+
+		void reserve(size_t size);
+
+		void clear();
+
+		size_t size() const;
+		size_t capacity() const;
+
+		struct Iterator
+		{
+			size_t index;
+			K      key;
+			V*     value;
+		};
+
+		Iterator begin();
+		Iterator next(const Iterator& it);
+		Iterator end();
+
+	private:
+		FlatHashMap(const FlatHashMap&);
+		FlatHashMap& operator=(const FlatHashMap&);
+
+		static const u32 GROUP_SIZE        = 16;
+		static const u32 LOOKUP_BATCH_SIZE = 16;
+
+		//Control bytes: FULL = 0xxxxxxx (7 bits of the hash), EMPTY and DELETED have the high bit set
+		static const u8  EMPTY             = 0x80;
+		static const u8  DELETED           = 0xFE;
+
+		struct Slot
+		{
+			K key;
+			V value;
+		};
+
+		static u64 hash(K key);
+
+		//Bit i set = control byte i of the group matches
+		static u32 matchByte(const u8* group, u8 value);
+		static u32 matchEmpty(const u8* group);
+		static u32 matchEmptyOrDeleted(const u8* group);
+
+		static u32 findFirstSet(u32 mask);
+
+		size_t find(K key, u64 h) const;        //slot index or capacity
+		size_t findInsertSlot(u64 h) const;     //first EMPTY or DELETED slot of the probe sequence
+
+		void rehash(size_t capacity);
+
+		size_t getMaxLoad() const;
+
+		Allocator* _allocator;
+
+		u8*        _control;
+		Slot*      _slots;
+
+		size_t     _capacity;       //0 or a multiple of GROUP_SIZE (power of 2)
+		size_t     _size;
+		size_t     _num_deleted;
+	};
+
+	//Definitions
+
+	template<class K, class V>
+	FlatHashMap<K, V>::FlatHashMap(Allocator& allocator)
+		: _allocator(&allocator), _control(nullptr), _slots(nullptr), _capacity(0), _size(0), _num_deleted(0)
+	{
+	}
+
+	template<class K, class V>
+	FlatHashMap<K, V>::~FlatHashMap()
+	{
+		clear();
+
+		if(_control != nullptr)
+			_allocator->deallocate(_control);
+	}
+
+	template<class K, class V>
+	u64 FlatHashMap<K, V>::hash(K key)
+	{
+		//Murmur3 finalizer, every bit of the key affects the group (high bits) and the control byte (low 7 bits)
+		u64 h = (u64)key;
+
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ULL;
+		h ^= h >> 33;
+
+		return h;
+	}
+
+#if AQUA_FLAT_HASH_MAP_SSE2
+	template<class K, class V>
+	u32 FlatHashMap<K, V>::matchByte(const u8* group, u8 value)
+	{
+		__m128i control = _mm_load_si128((const __m128i*)group);
+
+		return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8((char)value)));
+	}
+
+	template<class K, class V>
+	u32 FlatHashMap<K, V>::matchEmptyOrDeleted(const u8* group)
+	{
+		//High bit set
+		return (u32)_mm_movemask_epi8(_mm_load_si128((const __m128i*)group));
+	}
+#else
+	template<class K, class V>
+	u32 FlatHashMap<K, V>::matchByte(const u8* group, u8 value)
+	{
+		u32 mask = 0;
+
+		for(u32 i = 0; i < GROUP_SIZE; i++)
+			mask |= (u32)(group[i] == value) << i;
+
+		return mask;
+	}
+
+	template<class K, class V>
+	u32 FlatHashMap<K, V>::matchEmptyOrDeleted(const u8* group)
+	{
+		u32 mask = 0;
+
+		for(u32 i = 0; i < GROUP_SIZE; i++)
+			mask |= (u32)(group[i] >> 7) << i;
+
+		return mask;
+	}
+#endif
+
+	template<class K, class V>
+	u32 FlatHashMap<K, V>::matchEmpty(const u8* group)
+	{
+		return matchByte(group, EMPTY);
+	}
+
+	template<class K, class V>
+	u32 FlatHashMap<K, V>::findFirstSet(u32 mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+
+		return index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	template<class K, class V>
+	size_t FlatHashMap<K, V>::find(K key, u64 h) const
+	{
+		if(_capacity == 0)
+			return 0;
+
+		size_t group_mask = _capacity / GROUP_SIZE - 1;
+		size_t group      = (size_t)(h >> 7) & group_mask;
+		u8     h2         = (u8)(h & 0x7F);
+
+		//Triangular probing visits every group
+		for(size_t i = 1; ; i++)
+		{
+			const u8* control = _control + group * GROUP_SIZE;
+
+			u32 match = matchByte(control, h2);
+
+			while(match != 0)
+			{
+				size_t index = group * GROUP_SIZE + findFirstSet(match);
+
+				if(_slots[index].key == key)
+					return index;
+
+				match &= match - 1;
+			}
+
+			//A group with an EMPTY slot ends every probe sequence that reaches it
+			if(matchEmpty(control) != 0)
+				return _capacity;
+
+			group = (group + i) & group_mask;
+		}
+	}
+
+	template<class K, class V>
+	size_t FlatHashMap<K, V>::findInsertSlot(u64 h) const
+	{
+		size_t group_mask = _capacity / GROUP_SIZE - 1;
+		size_t group      = (size_t)(h >> 7) & group_mask;
+
+		for(size_t i = 1; ; i++)
+		{
+			u32 match = matchEmptyOrDeleted(_control + group * GROUP_SIZE);
+
+			if(match != 0)
+				return group * GROUP_SIZE + findFirstSet(match);
+
+			group = (group + i) & group_mask;
+		}
+	}
+
+	template<class K, class V>
+	size_t FlatHashMap<K, V>::getMaxLoad() const
+	{
+		return _capacity - _capacity / 8;
+	}
+
+	template<class K, class V>
+	bool FlatHashMap<K, V>::has(K key) const
+	{
+		return find(key, hash(key)) < _capacity;
+	}
+
+	template<class K, class V>
+	const V& FlatHashMap<K, V>::lookup(K key, const V& default_value) const
+	{
+		size_t index = find(key, hash(key));
+
+		if(index < _capacity)
+			return _slots[index].value;
+
+		return default_value;
+	}
+
+	template<class K, class V>
+	void FlatHashMap<K, V>::lookupBatch(const K* keys, size_t n, V* out, const V& default_value) const
+	{
+		u64 hashes[LOOKUP_BATCH_SIZE];
+
+		size_t group_mask = _capacity / GROUP_SIZE - 1;
+
+		for(size_t first = 0; first < n; first += LOOKUP_BATCH_SIZE)
+		{
+			size_t count = n - first < LOOKUP_BATCH_SIZE ? n - first : LOOKUP_BATCH_SIZE;
+
+			for(size_t i = 0; i < count; i++)
+			{
+				hashes[i] = hash(keys[first + i]);
+
+				if(_capacity > 0)
+				{
+					size_t group = (size_t)(hashes[i] >> 7) & group_mask;
+
+					pointer_math::prefetch(_control + group * GROUP_SIZE);
+					pointer_math::prefetch(_slots + group * GROUP_SIZE);
+				}
+			}
+
+			for(size_t i = 0; i < count; i++)
+			{
+				size_t index = find(keys[first + i], hashes[i]);
+
+				out[first + i] = index < _capacity ? _slots[index].value : default_value;
+			}
+		}
+	}
+
+	template<class K, class V>
+	void FlatHashMap<K, V>::insert(K key, const V& value)
+	{
+		u64 h = hash(key);
+
+		size_t index = find(key, h);
+
+		if(index < _capacity)
+		{
+			_slots[index].value = value;
+			return;
+		}
+
+		if(_size + _num_deleted >= getMaxLoad())
+		{
+			//Mostly tombstones: clean them up without growing
+			if(_capacity > 0 && _size * 2 < getMaxLoad())
+				rehash(_capacity);
+			else
+				rehash(_capacity == 0 ? GROUP_SIZE : _capacity * 2);
+		}
+
+		index = findInsertSlot(h);
+
+		if(_control[index] == DELETED)
+			_num_deleted--;
+
+		_control[index] = (u8)(h & 0x7F);
+
+		new (&_slots[index].key) K(key);
+		new (&_slots[index].value) V(value);
+
+		_size++;
+	}
+
+	template<class K, class V>
+	bool FlatHashMap<K, V>::remove(K key)
+	{
+		size_t index = find(key, hash(key));
+
+		if(index >= _capacity)
+			return false;
+
+		_slots[index].key.~K();
+		_slots[index].value.~V();
+
+		//If the group still has an EMPTY slot no probe sequence goes past it, so the slot can be EMPTY too
+		if(matchEmpty(_control + index / GROUP_SIZE * GROUP_SIZE) != 0)
+		{
+			_control[index] = EMPTY;
+		}
+		else
+		{
+			_control[index] = DELETED;
+			_num_deleted++;
+		}
+
+		_size--;
+
+		return true;
+	}
+
+	template<class K, class V>
+	void FlatHashMap<K, V>::reserve(size_t size)
+	{
+		size_t capacity = GROUP_SIZE;
+
+		while(capacity - capacity / 8 < size)
+			capacity *= 2;
+
+		if(capacity > _capacity)
+			rehash(capacity);
+	}
+
+	template<class K, class V>
+	void FlatHashMap<K, V>::clear()
+	{
+		for(size_t i = 0; i < _capacity; i++)
+		{
+			if((_control[i] & 0x80) == 0)
+			{
+				_slots[i].key.~K();
+				_slots[i].value.~V();
+			}
+
+			_control[i] = EMPTY;
+		}
+
+		_size        = 0;
+		_num_deleted = 0;
+	}
+
+	template<class K, class V>
+	size_t FlatHashMap<K, V>::size() const
+	{
+		return _size;
+	}
+
+	template<class K, class V>
+	size_t FlatHashMap<K, V>::capacity() const
+	{
+		return _capacity;
+	}
+
+	template<class K, class V>
+	void FlatHashMap<K, V>::rehash(size_t capacity)
+	{
+		ASSERT(capacity % GROUP_SIZE == 0 && (capacity & (capacity - 1)) == 0 && capacity - capacity / 8 > _size);
+
+		u8*    old_control  = _control;
+		Slot*  old_slots    = _slots;
+		size_t old_capacity = _capacity;
+
+		//Control bytes (16 byte aligned for SSE2 loads) followed by the slots
+		static const u8 ALIGNMENT = __alignof(Slot) > GROUP_SIZE ? __alignof(Slot) : GROUP_SIZE;
+
+		size_t slots_offset = (capacity + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+		_control     = (u8*)_allocator->allocate(slots_offset + capacity * sizeof(Slot), ALIGNMENT);
+		_slots       = (Slot*)(_control + slots_offset);
+		_capacity    = capacity;
+		_num_deleted = 0;
+
+		ASSERT(_control != nullptr);
+
+		for(size_t i = 0; i < capacity; i++)
+			_control[i] = EMPTY;
+
+		for(size_t i = 0; i < old_capacity; i++)
+		{
+			if((old_control[i] & 0x80) != 0)
+				continue;
+
+			Slot& slot = old_slots[i];
+
+			u64 h = hash(slot.key);
+
+			size_t index = findInsertSlot(h);
+
+			_control[index] = (u8)(h & 0x7F);
+
+			new (&_slots[index].key) K(std::move(slot.key));
+			new (&_slots[index].value) V(std::move(slot.value));
+
+			slot.key.~K();
+			slot.value.~V();
+		}
+
+		if(old_control != nullptr)
+			_allocator->deallocate(old_control);
+	}
+
+	template<class K, class V>
+	typename FlatHashMap<K, V>::Iterator FlatHashMap<K, V>::begin()
+	{
+		Iterator it = { (size_t)-1, K(), nullptr };
+
+		return next(it);
+	}
+
+	template<class K, class V>
+	typename FlatHashMap<K, V>::Iterator FlatHashMap<K, V>::next(const Iterator& it)
+	{
+		for(size_t i = it.index + 1; i < _capacity; i++)
+		{
+			if((_control[i] & 0x80) == 0)
+			{
+				Iterator result = { i, _slots[i].key, &_slots[i].value };
+
+				return result;
+			}
+		}
+
+		return end();
+	}
+
+	template<class K, class V>
+	typename FlatHashMap<K, V>::Iterator FlatHashMap<K, V>::end()
+	{
+		Iterator it = { _capacity, K(), nullptr };
+
+		return it;
+	}
+};
@@ -2,6 +2,8 @@
 
 #include "Array.h"
 
+#include "..\..\Utilities\PointerMath.h"
+
 #include "..\..\AquaTypes.h"
 
 namespace aqua
@@ -18,6 +20,11 @@ namespace aqua
 		// does not exist in the hash.
 		const V& lookup(K key, const V& default) const;
 
+		// Looks up n keys and stores the values in out (default for missing keys).
+		// The buckets of LOOKUP_BATCH_SIZE keys are prefetched before any of them is
+		// resolved, so their cache misses overlap instead of happening one after the other.
+		void lookupBatch(const K* keys, size_t n, V* out, const V& default) const;
+
 		void insert(K key, const V& value);
 
 		bool remove(K key);
@@ -41,6 +48,11 @@ namespace aqua
 
 	private:
 
+		static const size_t LOOKUP_BATCH_SIZE = 16;
+
+		// Value of key searching from bucket start, nullptr if the key does not exist
+		const V* find(K key, size_t start) const;
+
 		void rehash(size_t size);
 
 		enum State : u8
@@ -132,7 +144,15 @@ namespace aqua
 		if(size == 0)
 			return default;
 
-		size_t start = key % size;
+		const V* value = find(key, key % size);
+
+		return value != nullptr ? *value : default;
+	}
+
+	template<class K, class V>
+	const V* HashMap<K, V>::find(K key, size_t start) const
+	{
+		size_t size = _buckets.size();
 
 		u8 hash6 = key & 0x3F;
 
@@ -144,11 +164,11 @@ namespace aqua
 			switch(bucket->state)
 			{
 			case State::EMPTY:
-				return default;
+				return nullptr;
 
 			case State::FILLED:
 				if(hash6 == bucket->hash && _keys[i] == key)
-					return _values[i];
+					return &_values[i];
 				break;
 			default:
 				break;
@@ -162,18 +182,56 @@ namespace aqua
 			switch(bucket->state)
 			{
 			case State::EMPTY:
-				return default;
+				return nullptr;
 
 			case State::FILLED:
 				if(hash6 == bucket->hash && _keys[i] == key)
-					return _values[i];
+					return &_values[i];
 				break;
 			default:
 				break;
 			}
 		}
 
-		return default;
+		return nullptr;
+	}
+
+	template<class K, class V>
+	void HashMap<K, V>::lookupBatch(const K* keys, size_t n, V* out, const V& default) const
+	{
+		size_t size = _buckets.size();
+
+		if(size == 0)
+		{
+			for(size_t i = 0; i < n; ++i)
+				out[i] = default;
+
+			return;
+		}
+
+		size_t starts[LOOKUP_BATCH_SIZE];
+
+		for(size_t first = 0; first < n; first += LOOKUP_BATCH_SIZE)
+		{
+			size_t count = n - first < LOOKUP_BATCH_SIZE ? n - first : LOOKUP_BATCH_SIZE;
+
+			// Hash every key and prefetch its starting bucket, key and value
+			for(size_t i = 0; i < count; ++i)
+			{
+				starts[i] = keys[first + i] % size;
+
+				pointer_math::prefetch(&_buckets[starts[i]]);
+				pointer_math::prefetch(&_keys[starts[i]]);
+				pointer_math::prefetch(&_values[starts[i]]);
+			}
+
+			for(size_t i = 0; i < count; ++i)
+			{
+				const V* value = find(keys[first + i], starts[i]);
+
+				out[first + i] = value != nullptr ? *value : default;
+			}
+		}
 	}
 
 	template<class K, class V>
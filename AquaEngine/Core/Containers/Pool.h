@@ -1,82 +1,387 @@
 #pragma once
 
 /////////////////////////////////////////////////////////////////////////////////////////////
-///////////////// Tiago Costa, 2014              
+///////////////// Tiago Costa, 2014
 /////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "..\Allocators\Allocator.h"
 
+#include "..\..\AquaTypes.h"
+
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
 namespace aqua
 {
-	template <class T>
+	//Generation is odd while the object is alive and changes when it's destroyed, so handles to destroyed
+	//objects (or objects that reused the slot) are detected
+	struct PoolHandle
+	{
+		u32 index;
+		u32 generation;
+
+		bool valid() const
+		{
+			return generation != 0;
+		}
+	};
+
+	static const PoolHandle INVALID_POOL_HANDLE = { UINT32_MAX, 0 };
+
+	struct PoolStats
+	{
+		u32 num_chunks;
+		u32 capacity;             //objects in allocated chunks
+		u32 num_live;
+		u32 peak_live;
+		u64 num_stale_accesses;   //get()/destroy() with handles to destroyed objects
+	};
+
+	//Object pool that grows in chunks of objects_per_chunk objects (existing objects never move) up to max_num_chunks.
+	//Objects are accessed with generational handles, get() returns nullptr if the object was destroyed.
+	//If thread_safe is true create/destroy/get can be called from any thread: the free list is a lock-free stack
+	//(tagged head to avoid ABA) and only growing takes a lock. Otherwise there are no atomic RMW operations.
+	template<class T>
 	class Pool
 	{
 	public:
-		Pool(size_t size, Allocator& allocator);
+		Pool(Allocator& allocator, u32 objects_per_chunk = 256, u32 max_num_chunks = 64, bool thread_safe = false);
 		~Pool();
 
-		T* get();
+		//Returns INVALID_POOL_HANDLE if the pool is full
+		template<class... Args>
+		PoolHandle create(Args&&... args);
+
+		void destroy(PoolHandle handle);
 
-		void free(T* p);
+		//nullptr if the handle is invalid or the object was destroyed
+		T* get(PoolHandle handle);
+
+		bool isAlive(PoolHandle handle) const;
+
+		PoolStats getStats() const;
 
 	private:
 		Pool(const Pool&);
 		Pool& operator=(const Pool&);
 
-		Allocator& _allocator;
+		static const u32 INVALID_INDEX = UINT32_MAX;
+
+		struct Slot
+		{
+			typename std::aligned_storage<sizeof(T), __alignof(T)>::type object;
 
-		T*     _start;
-		T**    _free_list;
-		size_t _size;
+			std::atomic<u32> generation;
+			std::atomic<u32> next_free;
+		};
+
+		//Free list head: tag (incremented on every change) in the high 32 bits, slot index in the low 32 bits
+		static u32 getIndex(u64 head)
+		{
+			return (u32)head;
+		}
+
+		static u64 makeHead(u64 old_head, u32 index)
+		{
+			return (((old_head >> 32) + 1) << 32) | index;
+		}
+
+		Slot* getSlot(u32 index) const;
+
+		u32  popFreeSlot();
+		void pushFreeSlots(u32 first, u32 last);
+
+		void addStaleAccess();
+
+		bool grow();
+
+		Allocator&         _allocator;
+
+		Slot**             _chunks;          //max_num_chunks pointers, never reallocated
+		std::atomic<u32>   _num_chunks;
+		u32                _max_num_chunks;
+		u32                _chunk_shift;
+		u32                _chunk_mask;
+
+		std::atomic<u64>   _free_head;
+		std::mutex         _grow_mutex;
+
+		std::atomic<u32>   _num_live;
+		std::atomic<u32>   _peak_live;
+		std::atomic<u64>   _num_stale_accesses;
+
+		bool               _thread_safe;
 	};
 
 	//Definitions
 
 	template<class T>
-	Pool<T>::Pool(size_t size, Allocator& allocator) : _allocator(allocator), _size(size)
+	Pool<T>::Pool(Allocator& allocator, u32 objects_per_chunk, u32 max_num_chunks, bool thread_safe)
+		: _allocator(allocator), _num_chunks(0), _max_num_chunks(max_num_chunks), _free_head(INVALID_INDEX),
+		_num_live(0), _peak_live(0), _num_stale_accesses(0), _thread_safe(thread_safe)
 	{
-		static_assert(sizeof(T) >= sizeof(void*));
+		ASSERT("objects_per_chunk must be a power of 2" && objects_per_chunk > 0 && (objects_per_chunk & (objects_per_chunk - 1)) == 0);
+		ASSERT(max_num_chunks > 0 && (u64)objects_per_chunk * max_num_chunks < INVALID_INDEX);
+
+		_chunk_shift = 0;
+
+		while((1u << _chunk_shift) < objects_per_chunk)
+			_chunk_shift++;
 
-		_free_list = allocator::allocateArray<T>(_allocator, size);
-		_start = _free_list;
+		_chunk_mask = objects_per_chunk - 1;
 
-		T** p = _free_list;
+		_chunks = allocator::allocateArrayNoConstruct<Slot*>(_allocator, max_num_chunks);
+	}
+
+	template<class T>
+	Pool<T>::~Pool()
+	{
+		u32 num_chunks = _num_chunks.load();
 
-		//Initialize free list
-		for(size_t i = 0; i < size - 1; i++)
+		for(u32 i = 0; i < num_chunks; i++)
 		{
-			*p = ((T*)p) + 1;
-			p = (T**)*p;
+			Slot* chunk = _chunks[i];
+
+			//Destroy objects that are still alive
+			for(u32 j = 0; j <= _chunk_mask; j++)
+			{
+				if(chunk[j].generation.load(std::memory_order_relaxed) & 1)
+					((T*)&chunk[j].object)->~T();
+			}
+
+			_allocator.deallocate(chunk);
 		}
 
-		*p = nullptr;
+		allocator::deallocateArrayNoDestruct(_allocator, _chunks);
 	}
 
-	template <class T>
-	Pool<T>::~Pool()
+	template<class T>
+	template<class... Args>
+	PoolHandle Pool<T>::create(Args&&... args)
 	{
-		_free_list = nullptr;
+		u32 index = popFreeSlot();
+
+		while(index == INVALID_INDEX)
+		{
+			if(!grow())
+				return INVALID_POOL_HANDLE;
+
+			index = popFreeSlot();
+		}
+
+		Slot* slot = getSlot(index);
+
+		new (&slot->object) T(std::forward<Args>(args)...);
+
+		//Even -> odd, release so get() on other threads sees the constructed object
+		u32 generation = slot->generation.load(std::memory_order_relaxed) + 1;
+		slot->generation.store(generation, std::memory_order_release);
+
+		if(_thread_safe)
+		{
+			u32 num_live  = _num_live.fetch_add(1, std::memory_order_relaxed) + 1;
+			u32 peak_live = _peak_live.load(std::memory_order_relaxed);
+
+			while(num_live > peak_live && !_peak_live.compare_exchange_weak(peak_live, num_live, std::memory_order_relaxed))
+			{}
+		}
+		else
+		{
+			u32 num_live = _num_live.load(std::memory_order_relaxed) + 1;
+			_num_live.store(num_live, std::memory_order_relaxed);
+
+			if(num_live > _peak_live.load(std::memory_order_relaxed))
+				_peak_live.store(num_live, std::memory_order_relaxed);
+		}
+
+		PoolHandle handle = { index, generation };
+
+		return handle;
 	}
 
-	template <class T>
-	T* Pool<T>::get()
+	template<class T>
+	void Pool<T>::destroy(PoolHandle handle)
 	{
-		if(_free_list == nullptr)
+		Slot* slot = getSlot(handle.index);
+
+		u32  generation = handle.generation;
+		bool valid;
+
+		//Odd -> even, only one thread can destroy a given object
+		if(slot == nullptr)
+			valid = false;
+		else if(_thread_safe)
+			valid = slot->generation.compare_exchange_strong(generation, generation + 1, std::memory_order_acquire);
+		else if((valid = slot->generation.load(std::memory_order_relaxed) == generation))
+			slot->generation.store(generation + 1, std::memory_order_relaxed);
+
+		if(!valid)
+		{
+			ASSERT("Destroying invalid or already destroyed pool object" && false);
+
+			addStaleAccess();
+			return;
+		}
+
+		((T*)&slot->object)->~T();
+
+		if(_thread_safe)
+			_num_live.fetch_sub(1, std::memory_order_relaxed);
+		else
+			_num_live.store(_num_live.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+
+		pushFreeSlots(handle.index, handle.index);
+	}
+
+	template<class T>
+	T* Pool<T>::get(PoolHandle handle)
+	{
+		Slot* slot = getSlot(handle.index);
+
+		if(slot == nullptr || slot->generation.load(std::memory_order_acquire) != handle.generation)
+		{
+			addStaleAccess();
 			return nullptr;
+		}
+
+		return (T*)&slot->object;
+	}
 
-		T* p = _free_list;
+	template<class T>
+	bool Pool<T>::isAlive(PoolHandle handle) const
+	{
+		Slot* slot = getSlot(handle.index);
 
-		_free_list = (T**)(*_free_list);
+		return slot != nullptr && slot->generation.load(std::memory_order_acquire) == handle.generation;
+	}
 
-		return p;
+	template<class T>
+	PoolStats Pool<T>::getStats() const
+	{
+		PoolStats stats;
+		stats.num_chunks         = _num_chunks.load(std::memory_order_relaxed);
+		stats.capacity           = stats.num_chunks << _chunk_shift;
+		stats.num_live           = _num_live.load(std::memory_order_relaxed);
+		stats.peak_live          = _peak_live.load(std::memory_order_relaxed);
+		stats.num_stale_accesses = _num_stale_accesses.load(std::memory_order_relaxed);
+
+		return stats;
 	}
 
-	template <class T>
-	void Pool<T>::free(T* p)
+	template<class T>
+	typename Pool<T>::Slot* Pool<T>::getSlot(u32 index) const
 	{
-		ASSERT(p >= _start && p < _start + _size);
-		*((T**)p) = _free_list;
+		u32 chunk = index >> _chunk_shift;
+
+		if(index == INVALID_INDEX || chunk >= _num_chunks.load(std::memory_order_acquire))
+			return nullptr;
+
+		return &_chunks[chunk][index & _chunk_mask];
+	}
+
+	template<class T>
+	u32 Pool<T>::popFreeSlot()
+	{
+		u64 head = _free_head.load(std::memory_order_acquire);
+
+		if(!_thread_safe)
+		{
+			u32 index = getIndex(head);
+
+			if(index != INVALID_INDEX)
+				_free_head.store(getSlot(index)->next_free.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+			return index;
+		}
+
+		while(true)
+		{
+			u32 index = getIndex(head);
+
+			if(index == INVALID_INDEX)
+				return INVALID_INDEX;
+
+			//Another thread can pop this slot and change next_free before our CAS, the tag makes the CAS fail then
+			u32 next = getSlot(index)->next_free.load(std::memory_order_relaxed);
+
+			if(_free_head.compare_exchange_weak(head, makeHead(head, next), std::memory_order_acquire))
+				return index;
+		}
+	}
 
-		_free_list = (T**)p;
+	template<class T>
+	void Pool<T>::pushFreeSlots(u32 first, u32 last)
+	{
+		Slot* last_slot = getSlot(last);
+
+		u64 head = _free_head.load(std::memory_order_relaxed);
+
+		if(!_thread_safe)
+		{
+			last_slot->next_free.store(getIndex(head), std::memory_order_relaxed);
+			_free_head.store(first, std::memory_order_relaxed);
+			return;
+		}
+
+		do
+		{
+			last_slot->next_free.store(getIndex(head), std::memory_order_relaxed);
+		}
+		while(!_free_head.compare_exchange_weak(head, makeHead(head, first), std::memory_order_release));
+	}
+
+	template<class T>
+	bool Pool<T>::grow()
+	{
+		std::unique_lock<std::mutex> lock(_grow_mutex, std::defer_lock);
+
+		if(_thread_safe)
+		{
+			u32 num_chunks = _num_chunks.load(std::memory_order_relaxed);
+
+			lock.lock();
+
+			//Another thread grew the pool while we waited
+			if(_num_chunks.load(std::memory_order_relaxed) != num_chunks)
+				return true;
+		}
+
+		u32 num_chunks = _num_chunks.load(std::memory_order_relaxed);
+
+		if(num_chunks == _max_num_chunks)
+			return false;
+
+		u32 objects_per_chunk = _chunk_mask + 1;
+
+		Slot* chunk = (Slot*)_allocator.allocate(objects_per_chunk * sizeof(Slot), __alignof(Slot));
+
+		if(chunk == nullptr)
+			return false;
+
+		u32 first = num_chunks << _chunk_shift;
+
+		for(u32 i = 0; i < objects_per_chunk; i++)
+		{
+			chunk[i].generation.store(0, std::memory_order_relaxed);
+			chunk[i].next_free.store(first + i + 1, std::memory_order_relaxed);
+		}
+
+		_chunks[num_chunks] = chunk;
+		_num_chunks.store(num_chunks + 1, std::memory_order_release);
+
+		pushFreeSlots(first, first + objects_per_chunk - 1);
+
+		return true;
+	}
+
+	template<class T>
+	void Pool<T>::addStaleAccess()
+	{
+		if(_thread_safe)
+			_num_stale_accesses.fetch_add(1, std::memory_order_relaxed);
+		else
+			_num_stale_accesses.store(_num_stale_accesses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 	}
-};
\ No newline at end of file
+};
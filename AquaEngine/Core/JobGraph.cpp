@@ -0,0 +1,411 @@
+#include "JobGraph.h"
+
+#include "Timer.h"
+
+#include "Allocators\Allocator.h"
+
+#include "..\Utilities\Logger.h"
+#include "..\Utilities\Debug.h"
+
+#include <fstream>
+
+using namespace aqua;
+
+static const char* LANE_NAMES[NUM_JOB_LANES] = { "normal", "critical", "background" };
+
+JobGraph::JobGraph(Allocator& allocator) : _allocator(allocator), _nodes(allocator), _edges(allocator),
+_successors(allocator), _roots(allocator), _runs(nullptr), _num_runs(0), _built(false),
+_run_job(JobManager::NULL_JOB), _last_run(JobManager::NULL_JOB), _start_ticks(0)
+{
+	_ticks_per_second = Timer::getTicksPerSecond();
+}
+
+JobGraph::~JobGraph()
+{
+	ASSERT("Graph still running" && isFinished());
+
+	destroyRuns();
+}
+
+void JobGraph::destroyRuns()
+{
+	if(_runs != nullptr)
+		allocator::deallocateArray(_allocator, _runs);
+
+	_runs     = nullptr;
+	_num_runs = 0;
+}
+
+u32 JobGraph::addNode(const char* name, JobFunc func, void* data, JobLane lane)
+{
+	ASSERT(func != nullptr);
+
+	Node node;
+	node.name             = name;
+	node.func             = func;
+	node.data             = data;
+	node.lane             = lane;
+	node.num_dependencies = 0;
+	node.first_successor  = 0;
+	node.num_successors   = 0;
+
+	_nodes.push(node);
+
+	_built = false;
+
+	return (u32)_nodes.size() - 1;
+}
+
+void JobGraph::addEdge(u32 before, u32 after)
+{
+	ASSERT("Invalid node" && before < _nodes.size() && after < _nodes.size());
+
+	Edge edge;
+	edge.before = before;
+	edge.after  = after;
+
+	_edges.push(edge);
+
+	_built = false;
+}
+
+void JobGraph::setNodeData(u32 node, void* data)
+{
+	ASSERT("Graph running" && isFinished());
+
+	_nodes[node].data = data;
+}
+
+bool JobGraph::build()
+{
+	ASSERT("Graph running" && isFinished());
+
+	_built = false;
+
+	u32 num_nodes = (u32)_nodes.size();
+
+	for(u32 i = 0; i < num_nodes; i++)
+	{
+		_nodes[i].num_dependencies = 0;
+		_nodes[i].num_successors   = 0;
+	}
+
+	for(u32 i = 0; i < _edges.size(); i++)
+	{
+		_nodes[_edges[i].before].num_successors++;
+		_nodes[_edges[i].after].num_dependencies++;
+	}
+
+	//Successors of each node stored contiguously
+	u32 first_successor = 0;
+
+	for(u32 i = 0; i < num_nodes; i++)
+	{
+		_nodes[i].first_successor = first_successor;
+		first_successor          += _nodes[i].num_successors;
+		_nodes[i].num_successors  = 0;
+	}
+
+	_successors.resize(_edges.size());
+
+	for(u32 i = 0; i < _edges.size(); i++)
+	{
+		Node& before = _nodes[_edges[i].before];
+		_successors[before.first_successor + before.num_successors++] = _edges[i].after;
+	}
+
+	//Check for cycles (Kahn's algorithm)
+	_roots.clear();
+
+	Array<u32> open_dependencies(_allocator);
+	Array<u32> ready(_allocator);
+
+	open_dependencies.resize(num_nodes);
+
+	for(u32 i = 0; i < num_nodes; i++)
+	{
+		open_dependencies[i] = _nodes[i].num_dependencies;
+
+		if(open_dependencies[i] == 0)
+		{
+			_roots.push(i);
+			ready.push(i);
+		}
+	}
+
+	u32 num_sorted = 0;
+
+	while(!ready.empty())
+	{
+		const Node& node = _nodes[ready[ready.size() - 1]];
+		ready.pop();
+		num_sorted++;
+
+		for(u32 i = 0; i < node.num_successors; i++)
+		{
+			u32 successor = _successors[node.first_successor + i];
+
+			if(--open_dependencies[successor] == 0)
+				ready.push(successor);
+		}
+	}
+
+	if(num_sorted != num_nodes)
+	{
+		for(u32 i = 0; i < num_nodes; i++)
+		{
+			if(open_dependencies[i] > 0)
+				Logger::get().write(MESSAGE_LEVEL::ERROR_MESSAGE, CHANNEL::GENERAL, "JobGraph: node '%s' is part of a cycle!", _nodes[i].name);
+		}
+
+		return false;
+	}
+
+	if(_num_runs != num_nodes)
+	{
+		destroyRuns();
+
+		if(num_nodes > 0)
+		{
+			_runs     = allocator::allocateArray<NodeRun>(_allocator, num_nodes);
+			_num_runs = num_nodes;
+		}
+	}
+
+	for(u32 i = 0; i < num_nodes; i++)
+	{
+		_runs[i].node        = i;
+		_runs[i].graph       = this;
+		_runs[i].start_ticks = 0;
+		_runs[i].end_ticks   = 0;
+		_runs[i].thread      = 0;
+	}
+
+	_built = true;
+
+	return true;
+}
+
+JobId JobGraph::submit(JobId parent)
+{
+	ASSERT("Graph not built" && _built);
+	ASSERT("Previous run still running" && isFinished());
+
+	for(u32 i = 0; i < _num_runs; i++)
+		_runs[i].open_dependencies.store(_nodes[i].num_dependencies, std::memory_order_relaxed);
+
+	_start_ticks = Timer::getTicks();
+
+	//Roots are added by a job so the nodes can use its id as parent before it finishes
+	_last_run = JobManager::get().addJob(startJob, this, JobManager::NULL_JOB, parent, JobLane::CRITICAL);
+
+	return _last_run;
+}
+
+bool JobGraph::isFinished() const
+{
+	return _last_run == JobManager::NULL_JOB || JobManager::get().isFinished(_last_run);
+}
+
+void JobGraph::startJob(JobId id, void* data)
+{
+	JobGraph* graph = (JobGraph*)data;
+
+	graph->_run_job = id;
+
+	if(!graph->_roots.empty())
+		graph->addNodeJobs(&graph->_roots[0], (u32)graph->_roots.size());
+}
+
+void JobGraph::nodeJob(JobId id, void* data)
+{
+	NodeRun&    run   = *(NodeRun*)data;
+	JobGraph&   graph = *run.graph;
+	const Node& node  = graph._nodes[run.node];
+
+	run.thread      = THREAD_ID;
+	run.start_ticks = Timer::getTicks();
+
+	node.func(id, node.data);
+
+	run.end_ticks = Timer::getTicks();
+
+	//Add successors whose last dependency was this node
+	u32 ready[MAX_BATCH_SIZE];
+	u32 num_ready = 0;
+
+	for(u32 i = 0; i < node.num_successors; i++)
+	{
+		u32 successor = graph._successors[node.first_successor + i];
+
+		if(graph._runs[successor].open_dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			ready[num_ready++] = successor;
+
+			if(num_ready == MAX_BATCH_SIZE)
+			{
+				graph.addNodeJobs(ready, num_ready);
+				num_ready = 0;
+			}
+		}
+	}
+
+	if(num_ready > 0)
+		graph.addNodeJobs(ready, num_ready);
+}
+
+void JobGraph::addNodeJobs(const u32* nodes, u32 count)
+{
+	JobDesc jobs[MAX_BATCH_SIZE];
+
+	//One batch per lane
+	for(u32 lane = 0; lane < NUM_JOB_LANES; lane++)
+	{
+		u32 num_jobs = 0;
+
+		for(u32 i = 0; i < count; i++)
+		{
+			if((u32)_nodes[nodes[i]].lane != lane)
+				continue;
+
+			jobs[num_jobs].func = nodeJob;
+			jobs[num_jobs].data = &_runs[nodes[i]];
+			num_jobs++;
+
+			if(num_jobs == MAX_BATCH_SIZE)
+			{
+				JobManager::get().addJobs(num_jobs, jobs, nullptr, _run_job, (JobLane)lane);
+				num_jobs = 0;
+			}
+		}
+
+		if(num_jobs > 0)
+			JobManager::get().addJobs(num_jobs, jobs, nullptr, _run_job, (JobLane)lane);
+	}
+}
+
+u32 JobGraph::getNumNodes() const
+{
+	return (u32)_nodes.size();
+}
+
+const char* JobGraph::getNodeName(u32 node) const
+{
+	return _nodes[node].name;
+}
+
+JobGraphNodeTiming JobGraph::getNodeTiming(u32 node) const
+{
+	ASSERT("Graph running" && isFinished());
+	ASSERT(node < _num_runs);
+
+	const NodeRun& run = _runs[node];
+
+	JobGraphNodeTiming timing;
+	timing.thread = run.thread;
+
+	if(run.end_ticks == 0)
+	{
+		timing.start    = 0.0f;
+		timing.duration = 0.0f;
+	}
+	else
+	{
+		timing.start    = (float)((double)(run.start_ticks - _start_ticks) * 1000.0 / _ticks_per_second);
+		timing.duration = (float)((double)(run.end_ticks - run.start_ticks) * 1000.0 / _ticks_per_second);
+	}
+
+	return timing;
+}
+
+float JobGraph::getTotalTime() const
+{
+	ASSERT("Graph running" && isFinished());
+
+	u64 end_ticks = _start_ticks;
+
+	for(u32 i = 0; i < _num_runs; i++)
+	{
+		if(_runs[i].end_ticks > end_ticks)
+			end_ticks = _runs[i].end_ticks;
+	}
+
+	return (float)((double)(end_ticks - _start_ticks) * 1000.0 / _ticks_per_second);
+}
+
+bool JobGraph::writeDOT(const char* filename) const
+{
+	std::ofstream file(filename);
+
+	if(!file.is_open())
+		return false;
+
+	file << "digraph JobGraph\n{\n";
+	file << "\tnode [shape=box];\n";
+
+	for(u32 i = 0; i < _nodes.size(); i++)
+	{
+		file << "\tn" << i << " [label=\"" << _nodes[i].name;
+
+		if(_built)
+		{
+			JobGraphNodeTiming timing = getNodeTiming(i);
+
+			file << "\\n" << timing.duration << " ms (thread " << (u32)timing.thread << ")";
+		}
+
+		file << "\"";
+
+		if(_nodes[i].lane == JobLane::CRITICAL)
+			file << " color=red";
+		else if(_nodes[i].lane == JobLane::BACKGROUND)
+			file << " color=gray";
+
+		file << "];\n";
+	}
+
+	for(u32 i = 0; i < _edges.size(); i++)
+		file << "\tn" << _edges[i].before << " -> n" << _edges[i].after << ";\n";
+
+	file << "}\n";
+
+	return true;
+}
+
+bool JobGraph::writeJSON(const char* filename) const
+{
+	std::ofstream file(filename);
+
+	if(!file.is_open())
+		return false;
+
+	file << "{\n\t\"nodes\": [\n";
+
+	for(u32 i = 0; i < _nodes.size(); i++)
+	{
+		file << "\t\t{ \"id\": " << i << ", \"name\": \"" << _nodes[i].name << "\", \"lane\": \"" << LANE_NAMES[(u32)_nodes[i].lane] << "\"";
+
+		if(_built)
+		{
+			JobGraphNodeTiming timing = getNodeTiming(i);
+
+			file << ", \"thread\": " << (u32)timing.thread << ", \"start_ms\": " << timing.start << ", \"duration_ms\": " << timing.duration;
+		}
+
+		file << " }" << (i + 1 < _nodes.size() ? "," : "") << "\n";
+	}
+
+	file << "\t],\n\t\"edges\": [\n";
+
+	for(u32 i = 0; i < _edges.size(); i++)
+		file << "\t\t[" << _edges[i].before << ", " << _edges[i].after << "]" << (i + 1 < _edges.size() ? "," : "") << "\n";
+
+	file << "\t]";
+
+	if(_built)
+		file << ",\n\t\"total_ms\": " << getTotalTime();
+
+	file << "\n}\n";
+
+	return true;
+}
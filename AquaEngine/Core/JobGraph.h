@@ -0,0 +1,136 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "JobManager.h"
+
+#include "Containers\Array.h"
+
+#include "..\AquaTypes.h"
+
+#include <atomic>
+
+namespace aqua
+{
+	class Allocator;
+
+	struct JobGraphNodeTiming
+	{
+		float start;    //ms since submit
+		float duration; //ms
+		u8    thread;   //THREAD_ID of the thread that ran the node
+	};
+
+	//DAG of jobs built once and submitted every frame.
+	//Dependencies are resolved in build so a submit only resets a counter per node, nodes whose dependencies
+	//finished are added as a batch by the node that finished last.
+	//
+	//	JobGraph graph(allocator);
+	//	u32 physics = graph.addNode("physics", physicsJob, &physics_manager);
+	//	u32 lights  = graph.addNode("lights", lightsJob, &light_manager);
+	//	graph.addEdge(physics, lights);
+	//	graph.build();
+	//	...
+	//	JobManager::get().wait(graph.submit());
+	class JobGraph
+	{
+	public:
+		static const u32 INVALID_NODE = UINT32_MAX;
+
+		JobGraph(Allocator& allocator);
+		~JobGraph();
+
+		//name must stay valid while the graph exists
+		u32  addNode(const char* name, JobFunc func, void* data, JobLane lane = JobLane::NORMAL);
+
+		//after starts when before finishes
+		void addEdge(u32 before, u32 after);
+
+		//Can be changed between runs
+		void setNodeData(u32 node, void* data);
+
+		//Validates the graph (no cycles) and resolves the dependencies.
+		//Must be called again after adding nodes or edges
+		bool build();
+
+		//Returns a job that finishes when every node finishes.
+		//The previous run must have finished
+		JobId submit(JobId parent = JobManager::NULL_JOB);
+
+		bool isFinished() const;
+
+		u32         getNumNodes() const;
+		const char* getNodeName(u32 node) const;
+
+		//Timings of the last run (must have finished)
+		JobGraphNodeTiming getNodeTiming(u32 node) const;
+		float              getTotalTime() const;
+
+		//Graph and timings of the last run, for graphviz and external tools
+		bool writeDOT(const char* filename) const;
+		bool writeJSON(const char* filename) const;
+
+	private:
+		JobGraph(const JobGraph&); //Disable copies
+		JobGraph& operator=(JobGraph);
+
+		static const u32 MAX_BATCH_SIZE = 64;
+
+		struct Node
+		{
+			const char* name;
+			JobFunc     func;
+			void*       data;
+			JobLane     lane;
+
+			//Set in build
+			u32         num_dependencies;
+			u32         first_successor; //index in _successors
+			u32         num_successors;
+		};
+
+		struct Edge
+		{
+			u32 before;
+			u32 after;
+		};
+
+		//Per node state of the current run
+		struct NodeRun
+		{
+			std::atomic<u32> open_dependencies;
+			u32              node;
+			JobGraph*        graph;
+			u64              start_ticks;
+			u64              end_ticks;
+			u8               thread;
+
+			u8               padding[64 - 40]; //keep nodes finishing in different threads in different cache lines
+		};
+
+		static void startJob(JobId id, void* data);
+		static void nodeJob(JobId id, void* data);
+
+		void addNodeJobs(const u32* nodes, u32 count);
+		void destroyRuns();
+
+		Allocator&  _allocator;
+
+		Array<Node> _nodes;
+		Array<Edge> _edges;
+		Array<u32>  _successors;
+		Array<u32>  _roots;
+
+		NodeRun*    _runs;
+		u32         _num_runs;
+
+		bool        _built;
+
+		JobId       _run_job;     //used by the nodes of the current run
+		JobId       _last_run;
+		u64         _start_ticks;
+		u64         _ticks_per_second;
+	};
+};
@@ -1,298 +1,1422 @@
 #include "JobManager.h"
 
-#include <algorithm>
+#include "CPUTopology.h"
+#include "Timer.h"
 
 #include "..\Utilities\Debug.h"
+#include "..\Utilities\Logger.h"
+
+#include <new>
 
 using namespace aqua;
 
 __declspec(thread) u8 aqua::THREAD_ID;
 
-JobManager& JobManager::get()
+static const u32 NO_JOB          = UINT32_MAX;
+static const u32 FINISHED_JOB    = UINT32_MAX - 1; //Marks a closed dependents list
+
+//What the fiber that gains control must do on behalf of the fiber that switched to it
+//(can't be done before switching because another thread could resume the fiber while it's still running)
+enum PostSwitchAction
 {
-	static JobManager manager;
+	NO_ACTION,
+	RELEASE_FIBER, //return previous fiber to the pool
+	DELETE_FIBER,  //previous fiber finished (can't go back to the pool, a worker starting late could pick it up)
+	WAIT,          //resume previous fiber when the wait job finishes
+};
+static const u32 CACHE_LINE_SIZE = 64;
+
+static const u32 NUM_STEALABLE_LANES = 2; //critical and normal lanes use the work stealing queues
+
+//Chase-Lev work stealing deque of job indices.
+//The owner thread pushes and pops from the bottom, other threads steal from the top.
+//When full the owner grows the buffer, old buffers are kept alive until the queue is destroyed
+//because thieves might still be reading them.
+class WorkStealingQueue
+{
+public:
+	static const u32 INITIAL_CAPACITY = 256;
 
-	return manager;
-}
+	WorkStealingQueue() : _top(0), _bottom(0)
+	{
+		_buffer = createBuffer(INITIAL_CAPACITY, nullptr);
+	}
 
-JobManager::JobManager() : _stop(false), _num_workers(std::thread::hardware_concurrency()),
-_num_jobs_in_queue(0), _first_free(0), _next_job(0)
-{
-	if(_num_workers < MIN_NUM_WORKERS)
-		_num_workers = MIN_NUM_WORKERS;
-	else if(_num_workers > MAX_NUM_WORKERS)
-		_num_workers = MAX_NUM_WORKERS;
+	~WorkStealingQueue()
+	{
+		Buffer* buffer = _buffer.load(std::memory_order_relaxed);
+
+		while(buffer != nullptr)
+		{
+			Buffer* previous = buffer->previous;
+
+			delete[] (u8*)buffer;
+
+			buffer = previous;
+		}
+	}
+
+	//Owner only
+	void push(u32 job_index)
+	{
+		push(&job_index, 1);
+	}
 
-	//Init job's ids
-	for(u32 i = 0; i < MAX_NUM_JOBS; i++)
+	//Owner only. Publishes all jobs at once
+	void push(const u32* job_indices, u32 count)
 	{
-		_jobs[i].id = _next_job++ << 32;
-		_jobs[i].id |= i;
+		s64 bottom = _bottom.load(std::memory_order_relaxed);
+		s64 top    = _top.load(std::memory_order_acquire);
 
-		_free_list[i] = i;
+		Buffer* buffer = _buffer.load(std::memory_order_relaxed);
+
+		while(bottom - top + count > buffer->mask + 1)
+			buffer = grow(buffer, top, bottom);
+
+		for(u32 i = 0; i < count; i++)
+			buffer->entries[(bottom + i) & buffer->mask].store(job_indices[i], std::memory_order_relaxed);
+
+		_bottom.store(bottom + count, std::memory_order_release);
 	}
 
-	//Create worker threads
-	for(unsigned int i = 0; i < _num_workers; ++i)
-		_workers[i] = std::thread([this](int thread_id)
+	//Owner only
+	u32 pop()
 	{
-		//init THREAD_ID
-		THREAD_ID = thread_id;
+		s64 bottom = _bottom.load(std::memory_order_relaxed) - 1;
+
+		Buffer* buffer = _buffer.load(std::memory_order_relaxed);
+
+		_bottom.store(bottom, std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		s64 top = _top.load(std::memory_order_relaxed);
 
-		while(true)
+		if(top > bottom)
 		{
-			std::unique_lock<std::mutex> queue_lock(_jobs_queue_mutex);
+			//Queue is empty
+			_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return NO_JOB;
+		}
 
-			while(!_stop && _num_jobs_in_queue == 0) //Check spurious wakeup
-			{
-				_condition.wait(queue_lock);
-			}
+		u32 job_index = buffer->entries[bottom & buffer->mask].load(std::memory_order_relaxed);
 
-			if(_stop)
-			{
-				queue_lock.unlock();
-				return;
-			}
-				
+		if(top == bottom)
+		{
+			//Last entry in queue, race against thieves
+			if(!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				job_index = NO_JOB;
 
-			//Get job with highest priority
-			Job& job = _jobs[_jobs_queue[0]];
+			_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
 
-			std::pop_heap(std::begin(_jobs_queue), _jobs_queue + _num_jobs_in_queue, [this](const u32 x, const u32 y)
-			{
-				return _jobs[x].priority < _jobs[y].priority;
-			});
+		return job_index;
+	}
 
-			_num_jobs_in_queue--;
+	//Any thread
+	u32 steal()
+	{
+		s64 top = _top.load(std::memory_order_acquire);
 
-			queue_lock.unlock();
+		std::atomic_thread_fence(std::memory_order_seq_cst);
 
-			/*
-			//Wait for dependency
-			if(job.dependency != NULL_JOB)
-			{
-				wait(job.dependency);
-			}
-			*/
+		s64 bottom = _bottom.load(std::memory_order_acquire);
 
-			//Run job
+		if(top >= bottom)
+			return NO_JOB;
 
-			job.func(job.id, job.data);
+		Buffer* buffer = _buffer.load(std::memory_order_acquire);
 
-			finishJob(job.id);
-		}
-	}, i+1);
-}
+		u32 job_index = buffer->entries[top & buffer->mask].load(std::memory_order_relaxed);
 
-JobManager::~JobManager()
+		if(!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return NO_JOB; //Lost race against owner or another thief
+
+		return job_index;
+	}
+
+	bool empty() const
+	{
+		return _bottom.load(std::memory_order_relaxed) <= _top.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Buffer
+	{
+		s64              mask;
+		Buffer*          previous;
+		std::atomic<u32> entries[1];
+	};
+
+	static Buffer* createBuffer(u32 capacity, Buffer* previous)
+	{
+		ASSERT("WorkStealingQueue capacity must be a power of 2" && (capacity & (capacity - 1)) == 0);
+
+		u8* memory = new u8[sizeof(Buffer) + (capacity - 1) * sizeof(std::atomic<u32>)];
+
+		Buffer* buffer   = (Buffer*)memory;
+		buffer->mask     = capacity - 1;
+		buffer->previous = previous;
+
+		return buffer;
+	}
+
+	//Owner only
+	Buffer* grow(Buffer* buffer, s64 top, s64 bottom)
+	{
+		Buffer* new_buffer = createBuffer((u32)(buffer->mask + 1) * 2, buffer);
+
+		for(s64 i = top; i < bottom; i++)
+			new_buffer->entries[i & new_buffer->mask].store(buffer->entries[i & buffer->mask].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+		_buffer.store(new_buffer, std::memory_order_release);
+
+		return new_buffer;
+	}
+
+	//top and bottom in different cache lines to prevent false sharing between owner and thieves
+	std::atomic<s64>     _top;
+	u8                   _padding0[CACHE_LINE_SIZE - sizeof(std::atomic<s64>)];
+	std::atomic<s64>     _bottom;
+	std::atomic<Buffer*> _buffer;
+	u8                   _padding1[CACHE_LINE_SIZE - sizeof(std::atomic<s64>) - sizeof(std::atomic<Buffer*>)];
+};
+
+struct JobManager::WorkerQueues
 {
-	ASSERT(_stop);
+	WorkerQueues() : thread_fiber(nullptr), post_switch_action(NO_ACTION), post_switch_fiber(nullptr),
+		post_switch_job(NULL_JOB), num_critical_in_a_row(0), num_jobs_since_background(0), num_jobs_added(0),
+		num_jobs_executed(0), num_jobs_stolen(0), num_failed_steals(0), num_suspended_waits(0), num_blocking_waits(0),
+		wait_spin_ticks(0)
+	{}
+
+	WorkStealingQueue queues[NUM_STEALABLE_LANES];
+
+	void* thread_fiber;
+
+	u32   post_switch_action;
+	void* post_switch_fiber;
+	JobId post_switch_job;
+
+	//Starvation protection
+	u32 num_critical_in_a_row;
+	u32 num_jobs_since_background;
+
+	std::atomic<u64> num_jobs_added;
+	std::atomic<u64> num_jobs_executed;
+	std::atomic<u64> num_jobs_stolen;
+	std::atomic<u64> num_failed_steals;
+	std::atomic<u64> num_suspended_waits;
+	std::atomic<u64> num_blocking_waits;
+	u64              wait_spin_ticks;
+
+	CPUSet affinity; //empty = not pinned
+
+	u8 padding[CACHE_LINE_SIZE];
+};
+
+JobManager& JobManager::get()
+{
+	static JobManager manager;
+
+	return manager;
 }
 
-JobId JobManager::addJob(JobFunc func, void* data, JobId dependency, JobId parent, u32 priority)
+JobManager::JobManager() : _stop(false), _num_workers(0),
+_num_job_chunks(0), _free_list(NO_JOB), _next_job(0), _resumable_jobs(NO_JOB), _num_resumable_jobs(0),
+_free_fibers(nullptr), _free_fibers_capacity(0), _num_free_fibers(0), _num_fibers(0), _spin_waits(false), _num_total_queued_jobs(0), _background_head(NO_JOB), _background_tail(NO_JOB),
+_num_running_background_jobs(0), _num_sleeping_workers(0)
 {
-	/*
-	u32 index;
+	for(u32 i = 0; i < INITIAL_NUM_CHUNKS; i++)
+		addJobChunk();
 
-	//Get free job from free list
+	for(u32 i = 0; i < NUM_JOB_LANES; i++)
 	{
-		std::lock_guard<std::mutex> queue_lock(_jobs_mutex);
+		_num_queued_jobs[i] = 0;
+		_max_queued_jobs[i] = 0;
+	}
 
-		ASSERT("JobManager full!" && _first_free < MAX_NUM_JOBS);
+	startWorkers(JobManagerConfig());
+}
 
-		index = _free_list[_first_free++];
-	}
-	*/
+void JobManager::init(const JobManagerConfig& config)
+{
+	stop();
 
-	u32 first_free = _first_free++;
-	
-	ASSERT("JobManager full!" && first_free < MAX_NUM_JOBS);
+	ASSERT("Jobs still queued" && _num_total_queued_jobs == 0 && _background_head == NO_JOB);
 
-	u32 index = _free_list[first_free];
+	delete[] _queues;
 
-	Job& job            = _jobs[index];
-	job.func            = func;
-	job.data            = data;
-	job.parent          = parent;
-	job.open_jobs       = 1;
-	//job.dependency    = dependency;
-	job.priority        = priority;
-	job.first_dependent = NULL_JOB & INDEX_MASK;
-	job.sibling         = NULL_JOB & INDEX_MASK;
+	_stop = false;
 
-	if(parent != NULL_JOB)
+	startWorkers(config);
+}
+
+//Picks the number of workers and the CPUs each one can run on
+static u32 placeWorkers(const JobManagerConfig& config, const CPUTopology& topology, CPUSet* out_affinities, u32 max_num_workers)
+{
+	//Free cores are taken from the start, where the OS and the main thread usually run
+	u32 first_core = config.num_free_cores < topology.num_cores ? config.num_free_cores : topology.num_cores - 1;
+
+	if(first_core != config.num_free_cores)
 	{
-		_jobs[parent & INDEX_MASK].open_jobs++;
+		Logger::get().write(MESSAGE_LEVEL::WARNING_MESSAGE, CHANNEL::GENERAL,
+							"JobManager: Can't leave %u free cores with %u physical cores! Leaving %u.",
+							config.num_free_cores, topology.num_cores, first_core);
 	}
 
-	//Check dependency
-	if(dependency != NULL_JOB)
+	bool filter_node = config.placement == WorkerPlacement::NODE;
+
+	//Node ids are OS ids (not contiguous), look for a cpu in the node
+	if(filter_node)
 	{
-		u32 dependency_index = dependency & INDEX_MASK;
+		bool found = false;
 
-		std::lock_guard<std::mutex> lock(_jobs_mutexes[dependency_index]);
+		for(u32 i = 0; i < topology.num_cpus && !found; i++)
+			found = topology.cpus[i].node == config.node;
 
-		if(!isFinished(dependency))
+		if(!found)
 		{
-			Job& dependency_job = _jobs[dependency_index];
+			Logger::get().write(MESSAGE_LEVEL::WARNING_MESSAGE, CHANNEL::GENERAL,
+								"JobManager: NUMA node %u not found (or the process can't use its CPUs)! Using all nodes.",
+								config.node);
+			filter_node = false;
+		}
+	}
+
+	CPUSet usable_cpus;
+	usable_cpus.clear();
+
+	u32 num_usable_cpus  = 0;
+	u32 num_usable_cores = 0;
+
+	u32 core_first_cpu[MAX_NUM_CPUS]; //index in topology.cpus of the first cpu of each usable core
+	u32 last_core = UINT32_MAX;
+
+	for(u32 i = 0; i < topology.num_cpus; i++)
+	{
+		const CPUTopology::LogicalCPU& cpu = topology.cpus[i];
+
+		if(cpu.core < first_core || (filter_node && cpu.node != config.node))
+			continue;
 
-			job.sibling                    = dependency_job.first_dependent;
-			dependency_job.first_dependent = index;
+		usable_cpus.add(cpu.id);
+		num_usable_cpus++;
 
-			return job.id;
+		//cpus are sorted by core
+		if(cpu.core != last_core)
+		{
+			core_first_cpu[num_usable_cores++] = i;
+			last_core = cpu.core;
 		}
 	}
 
-	//Add job to queue
+	//Every cpu of the node is in the free cores
+	if(num_usable_cpus == 0)
+	{
+		Logger::get().write(MESSAGE_LEVEL::WARNING_MESSAGE, CHANNEL::GENERAL,
+							"JobManager: No CPUs left for workers after %u free cores%s! Using CPU %u.",
+							first_core, filter_node ? " in the NUMA node" : "", topology.cpus[0].id);
+
+		usable_cpus.add(topology.cpus[0].id);
+		num_usable_cpus   = 1;
+		num_usable_cores  = 1;
+		core_first_cpu[0] = 0;
+	}
+
+	u32 num_workers = config.num_workers;
+
+	if(num_workers == 0)
+		num_workers = config.placement == WorkerPlacement::PHYSICAL_CORE ? num_usable_cores : num_usable_cpus;
+
+	if(num_workers > max_num_workers)
+		num_workers = max_num_workers;
+
+	for(u32 i = 0; i < num_workers; i++)
 	{
-		std::lock_guard<std::mutex> queue_lock(_jobs_queue_mutex);
+		CPUSet& affinity = out_affinities[i];
+		affinity.clear();
 
-		_jobs_queue[_num_jobs_in_queue++] = index;
+		if(config.placement == WorkerPlacement::PHYSICAL_CORE)
+		{
+			//More workers than cores wrap around
+			u32 first = core_first_cpu[i % num_usable_cores];
 
-		std::push_heap(std::begin(_jobs_queue), _jobs_queue + _num_jobs_in_queue, [this](const u32 x, const u32 y)
+			for(u32 j = first; j < topology.num_cpus && topology.cpus[j].core == topology.cpus[first].core; j++)
+				affinity.add(topology.cpus[j].id);
+		}
+		else if(config.placement == WorkerPlacement::NODE || first_core > 0)
 		{
-			return _jobs[x].priority < _jobs[y].priority;
-		});
+			affinity = usable_cpus;
+		}
 	}
 
-	JobId id = job.id; //Copy id before notifying to prevent errors
+	return num_workers;
+}
+
+void JobManager::startWorkers(const JobManagerConfig& config)
+{
+	CPUTopology topology;
 
-	_condition.notify_one();
+	if(!cpu_topology::query(topology))
+		Logger::get().write(MESSAGE_LEVEL::WARNING_MESSAGE, CHANNEL::GENERAL, "JobManager: Error reading CPU topology!");
 
-	return id;
+	CPUSet affinities[MAX_NUM_WORKERS];
+
+	_num_workers = placeWorkers(config, topology, affinities, MAX_NUM_WORKERS);
+
+	if(_num_workers == 0)
+		_num_workers = 1;
+
+	Logger::get().write(MESSAGE_LEVEL::INFO_MESSAGE, CHANNEL::GENERAL,
+						"JobManager: %u workers (%u logical CPUs, %u physical cores, %u NUMA nodes)",
+						_num_workers, topology.num_cpus, topology.num_cores, topology.num_nodes);
+
+	_max_background_jobs = _num_workers / 4 > 0 ? _num_workers / 4 : 1;
+
+	_spin_waits = config.spin_waits;
+
+	_queues = new WorkerQueues[_num_workers + 1];
+
+	_queues[0].affinity.clear();
+
+	for(u32 i = 0; i < _num_workers; i++)
+		_queues[i + 1].affinity = affinities[i];
+
+	//Create worker threads
+	for(unsigned int i = 0; i < _num_workers; ++i)
+		_workers[i] = std::thread([this](int thread_id)
+	{
+		//init THREAD_ID
+		THREAD_ID = thread_id;
+
+		if(!_queues[thread_id].affinity.empty())
+			cpu_topology::setThreadAffinity(_queues[thread_id].affinity);
+
+		//Jobs run in pool fibers so a waiting job can be switched out while the worker keeps going
+		_queues[thread_id].thread_fiber = ConvertThreadToFiber(nullptr);
+
+		SwitchToFiber(acquireFiber());
+
+		//Back from the pool after stop
+		processPostSwitch();
+
+		ConvertFiberToThread();
+	}, i+1);
 }
 
-bool JobManager::isFinished(JobId job) const
+JobManager::~JobManager()
+{
+	ASSERT(_stop);
+
+	delete[] _queues;
+
+	delete[] _free_fibers;
+
+	for(u32 i = 0; i < _num_job_chunks; i++)
+		delete[] _job_chunks[i];
+}
+
+JobId JobManager::addJob(JobFunc func, void* data, JobId dependency, JobId parent, JobLane lane)
 {
-	return _jobs[job & INDEX_MASK].id != job;
+	u32 index = allocateJob(func, data, parent, lane);
+
+	Job& job = jobAt(index);
+
+	JobId id = job.id; //Copy id before pushing to prevent errors
+
+	//Check dependency
+	if(dependency != NULL_JOB && addDependent(dependency, index))
+		return id;
+
+	pushJob(index);
+
+	return id;
 }
 
-void JobManager::wait(JobId job)
+bool JobManager::addDependent(JobId dependency, u32 dependent_index)
 {
-	while(!isFinished(job))
+	Job& dependency_job = jobAt(dependency & INDEX_MASK);
+	Job& dependent_job  = jobAt(dependent_index);
+
+	u64 first_dependent = dependency_job.first_dependent.load(std::memory_order_acquire);
+
+	//Add to dependency's dependents list (unless it already finished)
+	while((first_dependent >> 32) == (dependency >> 32) && (u32)first_dependent != FINISHED_JOB)
 	{
-		if(_stop)
-			return;
+		dependent_job.sibling.store((u32)first_dependent, std::memory_order_relaxed);
+
+		u64 new_first_dependent = (first_dependent & ~(u64)INDEX_MASK) | dependent_index;
+
+		if(dependency_job.first_dependent.compare_exchange_weak(first_dependent, new_first_dependent, std::memory_order_release, std::memory_order_acquire))
+			return true;
+	}
+
+	return false;
+}
+
+JobManager::Job& JobManager::jobAt(u32 job_index) const
+{
+	return _job_chunks[job_index >> JOB_CHUNK_SHIFT][job_index & (JOBS_PER_CHUNK - 1)];
+}
+
+void JobManager::addJobs(u32 count, const JobDesc* jobs, JobId* out_ids, JobId parent, JobLane lane)
+{
+	static const u32 BATCH_SIZE = 64;
+
+	if(count == 0)
+		return;
+
+	u32 level = (u32)lane;
+
+	//Add all children to the parent at once (before any of them can finish)
+	if(parent != NULL_JOB)
+		jobAt(parent & INDEX_MASK).open_jobs += count;
+
+	_queues[THREAD_ID].num_jobs_added += count;
 
-		u32 job_index = MAX_NUM_JOBS;
+	u32 indices[BATCH_SIZE];
 
+	for(u32 first = 0; first < count; first += BATCH_SIZE)
+	{
+		u32 batch_size = count - first < BATCH_SIZE ? count - first : BATCH_SIZE;
+
+		for(u32 i = 0; i < batch_size; i++)
 		{
-			std::lock_guard<std::mutex> queue_lock(_jobs_queue_mutex);
+			u32 index = popFreeJob();
 
-			if(_num_jobs_in_queue > 0)
-			{
-				//Get job with highest priority
-				job_index = _jobs_queue[0];
+			initJob(index, jobs[first + i].func, jobs[first + i].data, parent, lane);
 
-				std::pop_heap(std::begin(_jobs_queue), _jobs_queue + _num_jobs_in_queue, [this](const u32 x, const u32 y)
-				{
-					return _jobs[x].priority < _jobs[y].priority;
-				});
+			//Copy ids before pushing to prevent errors
+			if(out_ids != nullptr)
+				out_ids[first + i] = jobAt(index).id;
 
-				_num_jobs_in_queue--;
-			}
+			indices[i] = index;
 		}
 
-		//If there was a job in queue
-		if(job_index != MAX_NUM_JOBS)
+		if(lane == JobLane::BACKGROUND)
 		{
-			Job& job = _jobs[job_index];
+			pushBackgroundJobs(indices, batch_size);
+			continue;
+		}
 
-			/*
-			//Wait for dependency
-			if(job.dependency != NULL_JOB)
-			{
-				wait(job.dependency);
-			}
-			*/
+		//Count before publishing, see pushJob()
+		updateMaxLaneDepth(lane, _num_queued_jobs[level] += batch_size);
+
+		_num_total_queued_jobs += batch_size;
 
-			//Run job
-			job.func(job.id, job.data);
+		if(THREAD_ID == 0)
+		{
+			std::lock_guard<std::mutex> lock(_external_queue_mutex);
 
-			finishJob(job.id);
+			_queues[0].queues[level].push(indices, batch_size);
 		}
 		else
 		{
-			std::this_thread::yield();
+			_queues[THREAD_ID].queues[level].push(indices, batch_size);
 		}
+
+		wakeWorkers(batch_size);
 	}
 }
 
-void JobManager::stop()
+u32 JobManager::allocateJob(JobFunc func, void* data, JobId parent, JobLane lane)
 {
-	_stop = true;
+	u32 index = popFreeJob();
 
-	_condition.notify_all();
+	initJob(index, func, data, parent, lane);
 
-	for(unsigned int i = 0; i < _num_workers; ++i)
+	if(parent != NULL_JOB)
 	{
-		bool k = _workers[i].joinable();
-		_workers[i].join();
+		jobAt(parent & INDEX_MASK).open_jobs++;
+	}
+
+	_queues[THREAD_ID].num_jobs_added++;
+
+	return index;
+}
+
+u32 JobManager::popFreeJob()
+{
+	//Pop job from free list
+	u32 index = popJobList(_free_list);
+
+	while(index == NO_JOB)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_job_chunks_mutex);
+
+			//Another thread might have added a chunk in the meantime
+			if((u32)_free_list.load(std::memory_order_acquire) == NO_JOB)
+				addJobChunk();
+		}
+
+		index = popJobList(_free_list);
 	}
+
+	return index;
 }
 
-u32 JobManager::getNumWorkers() const
+void JobManager::initJob(u32 job_index, JobFunc func, void* data, JobId parent, JobLane lane)
 {
-	return _num_workers;
+	ASSERT("Invalid job lane" && (u32)lane < NUM_JOB_LANES);
+
+	Job& job   = jobAt(job_index);
+	job.func   = func;
+	job.data   = data;
+	job.parent = parent;
+	job.lane   = lane;
+	job.sibling.store(NO_JOB, std::memory_order_relaxed);
+	job.open_jobs.store(1, std::memory_order_relaxed);
+	job.first_dependent.store((job.id & ~(u64)INDEX_MASK) | NO_JOB, std::memory_order_release);
 }
 
-void JobManager::finishJob(JobId job_id)
+void JobManager::freeJob(u32 job_index)
 {
-	u32 job_index = job_id & INDEX_MASK;
+	pushJobList(_free_list, job_index, job_index);
+}
 
-	Job& job = _jobs[job_index];
+//Treiber stack linked through Job::sibling, head is tagged to prevent ABA
+void JobManager::pushJobList(std::atomic<u64>& list, u32 first_index, u32 last_index)
+{
+	Job& last = jobAt(last_index);
 
-	ASSERT(job.id == job_id);
+	u64 head = list.load(std::memory_order_relaxed);
 
-	u32 open_jobs = --job.open_jobs;
+	while(true)
+	{
+		last.sibling.store((u32)head, std::memory_order_relaxed);
 
-	//Job finished, decrease parent open jobs (if job has a parent)
-	if(open_jobs == 0)
+		u64 new_head = (head & ~(u64)INDEX_MASK) + ((u64)1 << 32) | first_index;
+
+		if(list.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed))
+			return;
+	}
+}
+
+u32 JobManager::popJobList(std::atomic<u64>& list)
+{
+	u64 head = list.load(std::memory_order_acquire);
+
+	while(true)
 	{
-		if(job.parent != NULL_JOB)
-			finishJob(job.parent);
+		u32 index = (u32)head;
 
-		{
-			std::lock_guard<std::mutex> lock(_jobs_mutexes[job_index]);
+		if(index == NO_JOB)
+			return NO_JOB;
 
-			//Add dependents to queue
+		u32 next = jobAt(index).sibling.load(std::memory_order_relaxed);
 
-			u32 dependent_index = job.first_dependent;
+		u64 new_head = (head & ~(u64)INDEX_MASK) + ((u64)1 << 32) | next;
 
-			if(dependent_index != (NULL_JOB & INDEX_MASK))
-			{
-				{
-					std::lock_guard<std::mutex> queue_lock(_jobs_queue_mutex);
+		if(list.compare_exchange_weak(head, new_head, std::memory_order_acquire, std::memory_order_acquire))
+			return index;
+	}
+}
 
-					while(dependent_index != (NULL_JOB & INDEX_MASK))
-					{
-						_jobs_queue[_num_jobs_in_queue++] = dependent_index;
+//Must be called with _job_chunks_mutex locked (or from the constructor)
+void JobManager::addJobChunk()
+{
+	u32 chunk_index = _num_job_chunks;
 
-						std::push_heap(std::begin(_jobs_queue), _jobs_queue + _num_jobs_in_queue, [this](const u32 x, const u32 y)
-						{
-							return _jobs[x].priority < _jobs[y].priority;
-						});
+	ASSERT("JobManager full!" && chunk_index < MAX_NUM_JOB_CHUNKS);
 
-						dependent_index = _jobs[dependent_index].sibling;
-					}
-				}
+	Job* chunk = new Job[JOBS_PER_CHUNK];
 
-				_condition.notify_all();
-			}
+	u32 first_index = chunk_index << JOB_CHUNK_SHIFT;
+
+	for(u32 i = 0; i < JOBS_PER_CHUNK; i++)
+	{
+		JobId id = (_next_job++ << 32) | (first_index + i);
+
+		chunk[i].id = id;
+		chunk[i].first_dependent.store((id & ~(u64)INDEX_MASK) | FINISHED_JOB, std::memory_order_relaxed);
+		chunk[i].open_jobs.store(0, std::memory_order_relaxed);
+		chunk[i].sibling.store(first_index + i + 1, std::memory_order_relaxed);
+	}
+
+	_job_chunks[chunk_index] = chunk;
+
+	_num_job_chunks++;
+
+	//Push the whole chunk to the free list
+	pushJobList(_free_list, first_index, first_index + JOBS_PER_CHUNK - 1);
+}
+
+bool JobManager::isFinished(JobId job) const
+{
+	return jobAt(job & INDEX_MASK).id != job;
+}
+
+void JobManager::wait(JobId job)
+{
+	if(isFinished(job))
+		return;
 
-			//Set new id
-			JobId new_id = job_index | (_next_job++ << 32);
-			job.id       = new_id;
+	if(THREAD_ID != 0)
+	{
+		if(_spin_waits)
+		{
+			spinWait(job);
+			return;
 		}
-		
-		/*
+
+		void* fiber = acquireFiber();
+
+		if(fiber != nullptr)
 		{
-		std::lock_guard<std::mutex> lock(_jobs_mutex);
+			//Switch to another fiber that keeps executing jobs,
+			//this fiber is resumed (maybe in another worker) by a wait job that depends on job
+			_queues[THREAD_ID].num_suspended_waits++;
+
+			switchToFiber(fiber, WAIT, job);
+
+			ASSERT(isFinished(job));
+
+			return;
+		}
+
+		//Out of fibers, the waiting job stays in this worker's stack (counted in num_blocking_waits if it blocks)
+	}
+
+	helpWait(job);
+}
+
+//Runs queued jobs until job finishes and blocks when there's nothing to run.
+//Used by threads that can't suspend the waiting job, so suspended fibers aren't resumed here
+//(they would run on top of the waiting job's stack)
+void JobManager::helpWait(JobId job)
+{
+	bool wake_job_added = false;
+
+	while(!isFinished(job))
+	{
+		if(_stop)
+			return;
+
+		u32 job_index = getJob(false);
+
+		//If there was a job in any queue
+		if(job_index != NO_JOB)
+		{
+			executeJob(job_index);
+			continue;
+		}
+
+		//Nothing to help with, block until job finishes or new jobs are added
+		if(!wake_job_added)
+		{
+			u32 wake_index = allocateJob(wakeWaitingThreadsJob, this, NULL_JOB, JobLane::CRITICAL);
+
+			if(!addDependent(job, wake_index))
+				pushJob(wake_index);
+
+			wake_job_added = true;
+		}
+
+		std::unique_lock<std::mutex> sleep_lock(_sleep_mutex);
+
+		_num_sleeping_workers++;
+
+		_queues[THREAD_ID].num_blocking_waits++;
+
+		while(!_stop && !isFinished(job) && _num_total_queued_jobs == 0) //Check spurious wakeup
+		{
+			_condition.wait(sleep_lock);
+		}
+
+		_num_sleeping_workers--;
+	}
+}
+
+//Old wait: runs queued jobs until job finishes and yields when there's nothing to run
+void JobManager::spinWait(JobId job)
+{
+	WorkerQueues& queues = _queues[THREAD_ID];
+
+	while(!isFinished(job))
+	{
+		if(_stop)
+			return;
+
+		u32 job_index = getJob(false);
+
+		if(job_index != NO_JOB)
+		{
+			executeJob(job_index);
+			continue;
+		}
+
+		u64 start = Timer::getTicks();
+
+		std::this_thread::yield();
+
+		queues.wait_spin_ticks += Timer::getTicks() - start;
+	}
+}
+
+void JobManager::resumeFiberJob(JobId id, void* data)
+{
+	ASSERT("Wait jobs are resumed by executeJob" && false);
+}
+
+void JobManager::wakeWaitingThreadsJob(JobId id, void* data)
+{
+	JobManager* manager = (JobManager*)data;
+
+	{
+		std::lock_guard<std::mutex> sleep_lock(manager->_sleep_mutex);
+	}
+
+	manager->_condition.notify_all();
+}
+
+void WINAPI JobManager::fiberMain(void* data)
+{
+	JobManager* manager = (JobManager*)data;
+
+	manager->processPostSwitch();
+
+	manager->workerLoop();
+
+	//Stopped, go back to the thread's own fiber
+	manager->switchToFiber(manager->_queues[THREAD_ID].thread_fiber, DELETE_FIBER);
+}
+
+void JobManager::workerLoop()
+{
+	while(true)
+	{
+		u32 job_index = getJob();
+
+		if(job_index != NO_JOB)
+		{
+			executeJob(job_index);
+			continue;
+		}
+
+		//No jobs in any queue, sleep until a new job is added
+		std::unique_lock<std::mutex> sleep_lock(_sleep_mutex);
+
+		_num_sleeping_workers++;
+
+		while(!_stop && _num_total_queued_jobs == 0 && _num_resumable_jobs == 0 && !canRunBackgroundJob()) //Check spurious wakeup
+		{
+			_condition.wait(sleep_lock);
+		}
+
+		_num_sleeping_workers--;
+
+		if(_stop)
+			return;
+	}
+}
+
+void* JobManager::acquireFiber()
+{
+	std::lock_guard<std::mutex> lock(_fibers_mutex);
+
+	if(_num_free_fibers > 0)
+		return _free_fibers[--_num_free_fibers];
+
+	//Make room to return the new fiber to the pool
+	if(_num_fibers == _free_fibers_capacity)
+	{
+		u32    new_capacity = _free_fibers_capacity * 2 + 16;
+		void** free_fibers  = new (std::nothrow) void*[new_capacity];
+
+		if(free_fibers == nullptr)
+			return nullptr;
+
+		if(_num_free_fibers > 0)
+			memcpy(free_fibers, _free_fibers, _num_free_fibers * sizeof(void*));
+
+		delete[] _free_fibers;
+
+		_free_fibers          = free_fibers;
+		_free_fibers_capacity = new_capacity;
+	}
+
+	void* fiber = CreateFiber(FIBER_STACK_SIZE, fiberMain, this);
+
+	if(fiber != nullptr)
+		_num_fibers++;
+
+	return fiber;
+}
+
+void JobManager::releaseFiber(void* fiber)
+{
+	std::lock_guard<std::mutex> lock(_fibers_mutex);
+
+	ASSERT(_num_free_fibers < _free_fibers_capacity);
+
+	_free_fibers[_num_free_fibers++] = fiber;
+}
+
+void JobManager::switchToFiber(void* fiber, u32 action, JobId wait_job)
+{
+	WorkerQueues& queues = _queues[THREAD_ID];
+
+	queues.post_switch_action = action;
+	queues.post_switch_fiber  = GetCurrentFiber();
+	queues.post_switch_job    = wait_job;
+
+	SwitchToFiber(fiber);
+
+	//Resumed, might be in a different thread
+	processPostSwitch();
+}
+
+void JobManager::processPostSwitch()
+{
+	WorkerQueues& queues = _queues[THREAD_ID];
+
+	u32   action = queues.post_switch_action;
+	void* fiber  = queues.post_switch_fiber;
+	JobId job    = queues.post_switch_job;
+
+	queues.post_switch_action = NO_ACTION;
+
+	if(action == RELEASE_FIBER)
+	{
+		releaseFiber(fiber);
+	}
+	else if(action == DELETE_FIBER)
+	{
+		std::lock_guard<std::mutex> lock(_fibers_mutex);
+
+		DeleteFiber(fiber);
+		_num_fibers--;
+	}
+	else if(action == WAIT)
+	{
+		u32 wait_index = allocateJob(resumeFiberJob, fiber, NULL_JOB, JobLane::CRITICAL);
+
+		//Job might have finished in the meantime
+		if(!addDependent(job, wait_index))
+			pushJob(wait_index);
+	}
+}
+
+struct JobManager::ParallelForData
+{
+	std::atomic<u32> next;
+	u8               padding[CACHE_LINE_SIZE - sizeof(std::atomic<u32>)];
+	u32              end;
+	u32              grain;
+	u32              num_threads;
+	ParallelForFunc  func;
+	void*            data;
+};
+
+void JobManager::parallelFor(u32 begin, u32 end, u32 grain, ParallelForFunc func, void* data, JobLane lane)
+{
+	if(begin >= end)
+		return;
+
+	const u32 count       = end - begin;
+	const u32 num_threads = _num_workers + 1;
+
+	if(grain == 0)
+	{
+		//Aim for ~16 chunks per thread when the range is fully split
+		grain = count / (num_threads * 16);
+
+		if(grain == 0)
+			grain = 1;
+	}
+
+	u32 num_chunks = (count + grain - 1) / grain;
+
+	//Not worth splitting
+	if(num_chunks == 1 || _stop)
+	{
+		func(begin, end, data);
+		return;
+	}
+
+	ParallelForData pf;
+	pf.next        = begin;
+	pf.end         = end;
+	pf.grain       = grain;
+	pf.num_threads = num_threads;
+	pf.func        = func;
+	pf.data        = data;
+
+	//Parent job is never queued, this thread "runs" it and finishes it after spawning the helpers.
+	//Helpers that only start after the range is consumed return immediately.
+	//Not allocated with allocateJob() so it isn't counted in num_jobs_added (it's never executed)
+	u32 parent_index = popFreeJob();
+
+	initJob(parent_index, nullptr, nullptr, NULL_JOB, lane);
+
+	JobId parent = jobAt(parent_index).id;
+
+	u32 num_helpers = num_chunks - 1 < _num_workers ? num_chunks - 1 : _num_workers;
+
+	for(u32 i = 0; i < num_helpers; i++)
+		addJob(parallelForJob, &pf, NULL_JOB, parent, lane);
+
+	runParallelFor(pf);
+
+	finishJob(parent);
+
+	//Help with other jobs until the helpers are done
+	wait(parent);
+}
+
+void JobManager::parallelForJob(JobId id, void* data)
+{
+	runParallelFor(*(ParallelForData*)data);
+}
+
+void JobManager::runParallelFor(ParallelForData& data)
+{
+	u32 chunk_begin = data.next.load(std::memory_order_relaxed);
+
+	while(chunk_begin < data.end)
+	{
+		//Guided chunking: take a share of the remaining iterations
+		u32 chunk_size = (data.end - chunk_begin) / (data.num_threads * 2);
+
+		if(chunk_size < data.grain)
+			chunk_size = data.grain;
+
+		u32 chunk_end = data.end - chunk_begin > chunk_size ? chunk_begin + chunk_size : data.end;
+
+		if(data.next.compare_exchange_weak(chunk_begin, chunk_end, std::memory_order_relaxed))
+		{
+			data.func(chunk_begin, chunk_end, data.data);
+
+			chunk_begin = chunk_end;
+		}
+	}
+}
+
+void JobManager::stop()
+{
+	{
+		std::lock_guard<std::mutex> sleep_lock(_sleep_mutex);
+
+		_stop = true;
+	}
+
+	_condition.notify_all();
+
+	for(unsigned int i = 0; i < _num_workers; ++i)
+	{
+		_workers[i].join();
+	}
+
+	ASSERT("Jobs still waiting" && _num_free_fibers == _num_fibers);
+
+	for(u32 i = 0; i < _num_free_fibers; i++)
+		DeleteFiber(_free_fibers[i]);
+
+	_num_free_fibers = 0;
+	_num_fibers      = 0;
+}
+
+void JobManager::setMaxBackgroundJobs(u32 max_background_jobs)
+{
+	ASSERT(max_background_jobs > 0);
+
+	_max_background_jobs = max_background_jobs;
+
+	wakeWorkers(max_background_jobs);
+}
+
+u32 JobManager::getNumWorkers() const
+{
+	return _num_workers;
+}
+
+JobManagerStats JobManager::getStats() const
+{
+	JobManagerStats stats = {};
+
+	for(u32 i = 0; i < _num_workers + 1; i++)
+	{
+		stats.num_jobs_added      += _queues[i].num_jobs_added;
+		stats.num_jobs_executed   += _queues[i].num_jobs_executed;
+		stats.num_jobs_stolen     += _queues[i].num_jobs_stolen;
+		stats.num_failed_steals   += _queues[i].num_failed_steals;
+		stats.num_suspended_waits += _queues[i].num_suspended_waits;
+		stats.num_blocking_waits  += _queues[i].num_blocking_waits;
+		stats.wait_spin_ticks     += _queues[i].wait_spin_ticks;
+	}
+
+	for(u32 i = 0; i < NUM_JOB_LANES; i++)
+	{
+		stats.lane_depth[i]     = _num_queued_jobs[i];
+		stats.max_lane_depth[i] = _max_queued_jobs[i];
+	}
+
+	stats.num_running_background_jobs = _num_running_background_jobs;
+
+	return stats;
+}
+
+void JobManager::pushJob(u32 job_index)
+{
+	Job& job = jobAt(job_index);
+
+	if(job.func == resumeFiberJob)
+	{
+		pushJobList(_resumable_jobs, job_index, job_index);
+
+		_num_resumable_jobs++;
+
+		//Non worker threads might be sleeping too and can't resume fibers so wake everyone
+		wakeWorkers(UINT32_MAX);
+
+		return;
+	}
+
+	if(job.lane == JobLane::BACKGROUND)
+	{
+		pushBackgroundJobs(&job_index, 1);
+		return;
+	}
+
+	u32 level = (u32)job.lane;
+
+	//Count before publishing, a thief can pop the job (and decrement) as soon as it's pushed,
+	//the counters are unsigned and would wrap around
+	updateMaxLaneDepth(job.lane, ++_num_queued_jobs[level]);
+
+	_num_total_queued_jobs++;
+
+	//Only the owner can push to a work stealing queue,
+	//threads that aren't workers share queue 0 so they must serialize
+	if(THREAD_ID == 0)
+	{
+		std::lock_guard<std::mutex> lock(_external_queue_mutex);
+
+		_queues[0].queues[level].push(job_index);
+	}
+	else
+	{
+		_queues[THREAD_ID].queues[level].push(job_index);
+	}
+
+	wakeWorkers(1);
+}
+
+void JobManager::pushBackgroundJobs(const u32* job_indices, u32 count)
+{
+	{
+		std::lock_guard<std::mutex> lock(_background_mutex);
+
+		for(u32 i = 0; i < count; i++)
+		{
+			jobAt(job_indices[i]).sibling.store(NO_JOB, std::memory_order_relaxed);
+
+			if(_background_tail == NO_JOB)
+				_background_head = job_indices[i];
+			else
+				jobAt(_background_tail).sibling.store(job_indices[i], std::memory_order_relaxed);
+
+			_background_tail = job_indices[i];
+		}
+
+		updateMaxLaneDepth(JobLane::BACKGROUND, _num_queued_jobs[(u32)JobLane::BACKGROUND] += count);
+	}
+
+	//Only wake workers that will be allowed to run the jobs
+	u32 num_running = _num_running_background_jobs;
+	u32 max_running = _max_background_jobs;
+
+	if(num_running < max_running)
+		wakeWorkers(max_running - num_running < count ? max_running - num_running : count);
+}
+
+void JobManager::updateMaxLaneDepth(JobLane lane, u32 depth)
+{
+	std::atomic<u32>& max_depth = _max_queued_jobs[(u32)lane];
+
+	u32 current_max = max_depth.load(std::memory_order_relaxed);
+
+	while(depth > current_max && !max_depth.compare_exchange_weak(current_max, depth, std::memory_order_relaxed))
+	{}
+}
+
+void JobManager::wakeWorkers(u32 count)
+{
+	u32 num_sleeping = _num_sleeping_workers;
+
+	if(num_sleeping == 0)
+		return;
+
+	//Lock to make sure sleeping workers are either waiting or will see the new jobs
+	{
+		std::lock_guard<std::mutex> sleep_lock(_sleep_mutex);
+	}
+
+	if(count >= num_sleeping)
+	{
+		_condition.notify_all();
+	}
+	else
+	{
+		for(u32 i = 0; i < count; i++)
+			_condition.notify_one();
+	}
+}
+
+u32 JobManager::getJob(bool can_resume)
+{
+	const u32 thread_id  = THREAD_ID;
+	const u32 num_queues = _num_workers + 1;
+
+	WorkerQueues& local_queues = _queues[thread_id];
+
+	//Resume suspended jobs first
+	if(thread_id != 0 && can_resume && _num_resumable_jobs > 0)
+	{
+		u32 job_index = popJobList(_resumable_jobs);
+
+		if(job_index != NO_JOB)
+		{
+			_num_resumable_jobs--;
+
+			return job_index;
+		}
+	}
+
+	u32 job_index = NO_JOB;
+
+	//Non worker threads never run background jobs (they could block the main thread for a long time)
+	const bool background_allowed = thread_id != 0;
+
+	if(background_allowed && local_queues.num_jobs_since_background >= BACKGROUND_STARVATION_LIMIT)
+	{
+		job_index = getBackgroundJob();
+
+		if(job_index != NO_JOB)
+			return job_index;
+	}
+
+	//Critical jobs first, unless normal jobs have been waiting for too long
+	if(local_queues.num_critical_in_a_row >= CRITICAL_STARVATION_LIMIT)
+	{
+		local_queues.num_critical_in_a_row = 0;
+
+		job_index = getJobFromLane(JobLane::NORMAL);
+	}
+
+	if(job_index == NO_JOB)
+	{
+		job_index = getJobFromLane(JobLane::CRITICAL);
+
+		if(job_index != NO_JOB)
+			local_queues.num_critical_in_a_row++;
+	}
+
+	if(job_index == NO_JOB)
+	{
+		local_queues.num_critical_in_a_row = 0;
+
+		job_index = getJobFromLane(JobLane::NORMAL);
+	}
+
+	if(job_index != NO_JOB)
+	{
+		local_queues.num_jobs_since_background++;
+
+		return job_index;
+	}
+
+	if(background_allowed)
+		return getBackgroundJob();
+
+	return NO_JOB;
+}
+
+u32 JobManager::getJobFromLane(JobLane lane)
+{
+	const u32 level      = (u32)lane;
+	const u32 thread_id  = THREAD_ID;
+	const u32 num_queues = _num_workers + 1;
+
+	if(_num_queued_jobs[level] == 0)
+		return NO_JOB;
+
+	WorkerQueues& local_queues = _queues[thread_id];
+
+	u32 job_index;
+
+	//Prefer local jobs over stealing
+	if(thread_id == 0)
+	{
+		std::lock_guard<std::mutex> lock(_external_queue_mutex);
+
+		job_index = local_queues.queues[level].pop();
+	}
+	else
+	{
+		job_index = local_queues.queues[level].pop();
+	}
+
+	if(job_index == NO_JOB)
+	{
+		//Start at the next thread so thieves spread over different victims
+		for(u32 i = 1; i < num_queues; i++)
+		{
+			WorkStealingQueue& victim = _queues[(thread_id + i) % num_queues].queues[level];
+
+			if(victim.empty())
+				continue;
+
+			job_index = victim.steal();
+
+			if(job_index != NO_JOB)
+			{
+				local_queues.num_jobs_stolen++;
+				break;
+			}
+
+			local_queues.num_failed_steals++;
+		}
+	}
+
+	if(job_index != NO_JOB)
+	{
+		_num_queued_jobs[level]--;
+		_num_total_queued_jobs--;
+	}
+
+	return job_index;
+}
+
+u32 JobManager::getBackgroundJob()
+{
+	if(!canRunBackgroundJob())
+		return NO_JOB;
+
+	//Reserve a background slot
+	if(_num_running_background_jobs++ >= _max_background_jobs)
+	{
+		_num_running_background_jobs--;
+		return NO_JOB;
+	}
+
+	u32 job_index;
+
+	{
+		std::lock_guard<std::mutex> lock(_background_mutex);
+
+		job_index = _background_head;
+
+		if(job_index != NO_JOB)
+		{
+			_background_head = jobAt(job_index).sibling.load(std::memory_order_relaxed);
+
+			if(_background_head == NO_JOB)
+				_background_tail = NO_JOB;
+
+			_num_queued_jobs[(u32)JobLane::BACKGROUND]--;
+		}
+	}
+
+	if(job_index == NO_JOB)
+	{
+		_num_running_background_jobs--;
+		return NO_JOB;
+	}
+
+	_queues[THREAD_ID].num_jobs_since_background = 0;
+
+	return job_index;
+}
+
+bool JobManager::canRunBackgroundJob() const
+{
+	return _num_queued_jobs[(u32)JobLane::BACKGROUND] > 0 && _num_running_background_jobs < _max_background_jobs;
+}
+
+void JobManager::executeJob(u32 job_index)
+{
+	Job& job = jobAt(job_index);
+
+	if(job.func == resumeFiberJob)
+	{
+		void* fiber = job.data;
+
+		//Counted like any other job so num_jobs_executed matches num_jobs_added
+		_queues[THREAD_ID].num_jobs_executed++;
+
+		finishJob(job.id);
+
+		//This fiber goes back to the pool, the waiting job continues from its wait call
+		switchToFiber(fiber, RELEASE_FIBER);
+
+		return;
+	}
+
+	/*
+	//Wait for dependency
+	if(job.dependency != NULL_JOB)
+	{
+		wait(job.dependency);
+	}
+	*/
+
+	JobLane lane = job.lane;
+
+	//Run job
+	job.func(job.id, job.data);
+
+	_queues[THREAD_ID].num_jobs_executed++;
+
+	finishJob(job.id);
+
+	if(lane == JobLane::BACKGROUND)
+	{
+		_num_running_background_jobs--;
+
+		//Let another worker pick the next background job
+		if(_num_queued_jobs[(u32)JobLane::BACKGROUND] > 0)
+			wakeWorkers(1);
+	}
+}
+
+void JobManager::finishJob(JobId job_id)
+{
+	u32 job_index = job_id & INDEX_MASK;
+
+	Job& job = jobAt(job_index);
+
+	ASSERT(job.id == job_id);
+
+	u32 open_jobs = --job.open_jobs;
+
+	//Job finished, decrease parent open jobs (if job has a parent)
+	if(open_jobs == 0)
+	{
+		if(job.parent != NULL_JOB)
+			finishJob(job.parent);
+
+		//Set new id before closing the dependents list so anyone that finds it closed also sees the job finished
+		JobId new_id = job_index | (_next_job++ << 32);
+		job.id       = new_id;
+
+		//Close dependents list, jobs added with this job as a dependency from now on are pushed immediately
+		u64 first_dependent = job.first_dependent.exchange((job_id & ~(u64)INDEX_MASK) | FINISHED_JOB, std::memory_order_acq_rel);
+
+		//Add dependents to this thread's queues
+		u32 dependent_index = (u32)first_dependent;
+
+		while(dependent_index != NO_JOB)
+		{
+			u32 next_dependent = jobAt(dependent_index).sibling.load(std::memory_order_relaxed);
+
+			pushJob(dependent_index);
 
-		_free_list[--_first_free] = job_index; //Add job to free list
+			dependent_index = next_dependent;
 		}
-		*/
 
-		_free_list[--_first_free] = job_index; //Add job to free list
+		freeJob(job_index);
 	}
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <type_traits>
+#include <cstring>
 
 //////////////////////////////////////////////
 //Should the JobManager be a singleton?
@@ -25,6 +27,57 @@ namespace aqua
 
 	typedef u64 JobId; //<unique id (32 bits)><index (32 bits)>
 	typedef void(*JobFunc)(JobId, void*);
+	typedef void(*ParallelForFunc)(u32 begin, u32 end, void*);
+
+	enum class JobLane : u8
+	{
+		NORMAL,
+		CRITICAL,   //frame critical work, served before normal jobs
+		BACKGROUND, //long running work (asset streaming, IO, shader compilation). Only a limited number runs at a time
+	};
+
+	static const u32 NUM_JOB_LANES = 3;
+
+	struct JobDesc
+	{
+		JobFunc func;
+		void*   data;
+	};
+
+	enum class WorkerPlacement : u8
+	{
+		DEFAULT,       //workers aren't pinned, the OS schedules them
+		PHYSICAL_CORE, //one worker per physical core, pinned to the core (SMT siblings)
+		NODE,          //workers pinned to the CPUs of a NUMA node
+	};
+
+	struct JobManagerConfig
+	{
+		JobManagerConfig() : num_workers(0), placement(WorkerPlacement::DEFAULT), node(0), num_free_cores(0), spin_waits(false)
+		{}
+
+		u32             num_workers;    //0 = one per available CPU (or physical core, depending on placement)
+		WorkerPlacement placement;
+		u32             node;           //NUMA node (OS id) used by WorkerPlacement::NODE
+		u32             num_free_cores; //physical cores left for the main thread and other processes
+		bool            spin_waits;     //workers wait by running queued jobs and yielding instead of suspending the
+		                                //waiting job (the old wait, to measure how much time it spent spinning)
+	};
+
+	struct JobManagerStats
+	{
+		u64 num_jobs_added;
+		u64 num_jobs_executed;
+		u64 num_jobs_stolen;
+		u64 num_failed_steals; //steal attempts that found an empty queue or lost a race
+		u64 num_suspended_waits; //waits in worker threads that suspended the waiting job
+		u64 num_blocking_waits; //times a thread that can't suspend (non worker or no fiber available) blocked in wait
+		u64 wait_spin_ticks; //Timer::getTicks() ticks workers spent yielding in wait with nothing to run (spin_waits)
+
+		u32 lane_depth[NUM_JOB_LANES];     //jobs currently queued in each lane
+		u32 max_lane_depth[NUM_JOB_LANES]; //high water mark of lane_depth
+		u32 num_running_background_jobs;
+	};
 
 	class JobManager
 	{
@@ -33,59 +86,222 @@ namespace aqua
 
 		static const JobId NULL_JOB = UINT64_MAX;
 
+		//Critical jobs are served first but every CRITICAL_STARVATION_LIMIT critical jobs in a row a worker checks normal jobs first.
+		//Background jobs run when there's nothing else to do or after BACKGROUND_STARVATION_LIMIT other jobs
+		static const u32 CRITICAL_STARVATION_LIMIT   = 8;
+		static const u32 BACKGROUND_STARVATION_LIMIT = 64;
+
 		static JobManager& get();
 
-		JobId addJob(JobFunc func, void* data, JobId dependency = NULL_JOB, JobId parent = NULL_JOB, u32 priority = 0);
+		//Restarts the workers with a new config. There can't be jobs in flight.
+		//The JobManager starts with the default config
+		void init(const JobManagerConfig& config);
+
+		JobId addJob(JobFunc func, void* data, JobId dependency = NULL_JOB, JobId parent = NULL_JOB, JobLane lane = JobLane::NORMAL);
+
+		//Adds count jobs at once. Jobs are published in batches (one queue update each)
+		//and only as many sleeping workers as there are new jobs are woken up.
+		//out_ids (optional) receives the ids of the added jobs
+		void addJobs(u32 count, const JobDesc* jobs, JobId* out_ids = nullptr, JobId parent = NULL_JOB, JobLane lane = JobLane::NORMAL);
+
+		//Adds a job that calls fn() (lambda, functor, ...).
+		//Callables that fit in a pointer and are trivially copyable (eg: lambdas capturing a single reference) are
+		//stored in the job itself, others are copied to the heap.
+		//Combined with wait this allows straight line code inside jobs without blocking workers:
+		//	JobId physics = jobs.run([&]{ physics_manager.simulate(dt); });
+		//	jobs.wait(physics);
+		//	JobId lights  = jobs.run([&]{ light_manager.update(); });
+		template<typename F>
+		JobId run(const F& fn, JobId dependency = NULL_JOB, JobId parent = NULL_JOB, JobLane lane = JobLane::NORMAL)
+		{
+			if(sizeof(F) <= sizeof(void*) && std::is_trivially_copyable<F>::value)
+			{
+				void* data = nullptr;
+				memcpy(&data, &fn, sizeof(F) <= sizeof(void*) ? sizeof(F) : sizeof(void*));
+
+				return addJob(runInlineClosure<F>, data, dependency, parent, lane);
+			}
+
+			return addJob(runHeapClosure<F>, new F(fn), dependency, parent, lane);
+		}
 
 		bool isFinished(JobId job) const;
 
+		//In worker threads the waiting job is suspended (its fiber is switched out) and resumed once job finishes,
+		//the worker keeps executing other jobs meanwhile.
+		//Other threads (and workers if a fiber can't be created) help by executing queued jobs and block when there's
+		//nothing to do.
+		//Jobs can resume in a different worker thread so code using thread local storage must be compiled with /GT
 		void wait(JobId job);
 
+		//Calls func for sub ranges of [begin, end) in parallel and returns when the whole range is processed.
+		//Chunks start large and shrink as the range runs out (never below grain) to balance the load.
+		//grain = 0 picks a grain based on the number of workers.
+		//The calling thread also processes chunks.
+		void parallelFor(u32 begin, u32 end, u32 grain, ParallelForFunc func, void* data, JobLane lane = JobLane::NORMAL);
+
+		//fn is called as fn(u32 begin, u32 end)
+		template<typename F>
+		void parallelFor(u32 begin, u32 end, u32 grain, const F& fn, JobLane lane = JobLane::NORMAL)
+		{
+			parallelFor(begin, end, grain, [](u32 b, u32 e, void* data)
+			{
+				(*(const F*)data)(b, e);
+			}, (void*)&fn, lane);
+		}
+
 		void stop();
 
+		//Max number of background jobs running at the same time (default: 1/4 of the workers)
+		void setMaxBackgroundJobs(u32 max_background_jobs);
+
 		u32 getNumWorkers() const;
 
+		JobManagerStats getStats() const;
+
 	private:
 		JobManager();
 		JobManager(const JobManager&); //Disable copies
 		JobManager& operator=(JobManager);
 
-		static const unsigned int MIN_NUM_WORKERS = 4;
 		static const unsigned int MAX_NUM_WORKERS = 32;
-		static const u32          MAX_NUM_JOBS    = 2048;
+
+		//Jobs are stored in chunks that are allocated on demand and never freed until shutdown
+		static const u32          JOB_CHUNK_SHIFT    = 10;
+		static const u32          JOBS_PER_CHUNK     = 1 << JOB_CHUNK_SHIFT;
+		static const u32          MAX_NUM_JOB_CHUNKS = 1024;
+		static const u32          INITIAL_NUM_CHUNKS = 2;
 
 		static const u32          INDEX_MASK = UINT32_MAX;
 
+		static const u32          FIBER_STACK_SIZE = 256 * 1024;
+
 		struct Job
 		{
 			std::atomic<JobId> id;
 			JobId              parent;
-			//JobId              dependency;
 			JobFunc            func;
 			void*              data;
+
+			//<id unique part (32 bits)><index of the first dependent (32 bits)>
+			//Tagged with the id so dependents can't be added to a later use of the same job
+			std::atomic<u64>   first_dependent;
+
 			std::atomic<u32>   open_jobs;
-			u32                priority;
 
-			u32 first_dependent;
-			u32 sibling;
+			//Next dependent of the same job, or next free job while in the free list
+			std::atomic<u32>   sibling;
+
+			JobLane            lane;
 		};
 
+		template<typename F>
+		static void runInlineClosure(JobId id, void* data)
+		{
+			const F* fn = (const F*)&data;
+			(*fn)();
+		}
+
+		template<typename F>
+		static void runHeapClosure(JobId id, void* data)
+		{
+			F* fn = (F*)data;
+			(*fn)();
+			delete fn;
+		}
+
+		struct ParallelForData;
+
+		static void parallelForJob(JobId id, void* data);
+		static void runParallelFor(ParallelForData& data);
+
+		//Wait jobs. Never added to the normal queues
+		static void resumeFiberJob(JobId id, void* data);
+		static void wakeWaitingThreadsJob(JobId id, void* data);
+
+		static void WINAPI fiberMain(void* data);
+
+		void  startWorkers(const JobManagerConfig& config);
+		void  workerLoop();
+		void  helpWait(JobId job);
+		void  spinWait(JobId job);
+
+		//Returns nullptr if a fiber can't be created
+		void* acquireFiber();
+		void  releaseFiber(void* fiber);
+		void  switchToFiber(void* fiber, u32 action, JobId wait_job = NULL_JOB);
+		void  processPostSwitch();
+
+		//Per thread work stealing queues (critical and normal lanes). Defined in JobManager.cpp
+		struct WorkerQueues;
+
+		Job& jobAt(u32 job_index) const;
+
+		u32  allocateJob(JobFunc func, void* data, JobId parent, JobLane lane);
+		u32  popFreeJob();
+		void initJob(u32 job_index, JobFunc func, void* data, JobId parent, JobLane lane);
+		void freeJob(u32 job_index);
+		void addJobChunk();
+		bool addDependent(JobId dependency, u32 dependent_index);
+
+		void pushJobList(std::atomic<u64>& list, u32 first_index, u32 last_index);
+		u32  popJobList(std::atomic<u64>& list);
+
+		void pushJob(u32 job_index);
+		void pushBackgroundJobs(const u32* job_indices, u32 count);
+		void wakeWorkers(u32 count);
+		void updateMaxLaneDepth(JobLane lane, u32 depth);
+		u32  getJob(bool can_resume = true);
+		u32  getJobFromLane(JobLane lane);
+		u32  getBackgroundJob();
+		bool canRunBackgroundJob() const;
+		void executeJob(u32 job_index);
+
 		void finishJob(JobId job);
 
 		u32          _num_workers;
 		std::thread  _workers[MAX_NUM_WORKERS];
 
-		u32              _jobs_queue[MAX_NUM_JOBS]; //priority queue of jobs
-		Job              _jobs[MAX_NUM_JOBS];
-		std::mutex       _jobs_mutexes[MAX_NUM_JOBS];
-		u32              _free_list[MAX_NUM_JOBS]; //list of free entries in jobs array
-		u32              _num_jobs_in_queue;
-		std::atomic<u32> _first_free;
+		//Index 0 is used by the main thread (and any other thread that isn't a worker)
+		WorkerQueues*    _queues;
+		std::mutex       _external_queue_mutex;
+
+		Job*             _job_chunks[MAX_NUM_JOB_CHUNKS];
+		std::atomic<u32> _num_job_chunks;
+		std::mutex       _job_chunks_mutex;
+
+		//Treiber stack of free jobs linked through Job::sibling
+		//<ABA tag (32 bits)><index of the first free job (32 bits)>
+		std::atomic<u64> _free_list;
 
 		std::atomic<u64> _next_job;
 
-		//std::mutex              _jobs_mutex;
-		std::mutex              _jobs_queue_mutex;
+		//Wait jobs of suspended fibers ready to resume, only workers can resume them
+		std::atomic<u64> _resumable_jobs;
+		std::atomic<u32> _num_resumable_jobs;
+
+		//Grows with the number of fibers so every fiber can be returned to the pool
+		void**           _free_fibers;
+		u32              _free_fibers_capacity;
+		u32              _num_free_fibers;
+		u32              _num_fibers;
+		std::mutex       _fibers_mutex;
+
+		bool             _spin_waits;
+
+		std::atomic<u32> _num_queued_jobs[NUM_JOB_LANES];
+		std::atomic<u32> _max_queued_jobs[NUM_JOB_LANES];
+		std::atomic<u32> _num_total_queued_jobs; //critical and normal lanes only
+
+		//Background jobs FIFO linked through Job::sibling
+		u32              _background_head;
+		u32              _background_tail;
+		std::mutex       _background_mutex;
+		std::atomic<u32> _num_running_background_jobs;
+		std::atomic<u32> _max_background_jobs;
+		std::atomic<u32> _num_sleeping_workers;
+
+		std::mutex              _sleep_mutex;
 		std::condition_variable _condition;
 		std::atomic<bool>       _stop;
 	};
@@ -26,6 +26,10 @@ namespace aqua
 
 		float getMillisecondsPerFrame();
 
+		//High resolution counter (for profiling)
+		static u64 getTicks();
+		static u64 getTicksPerSecond();
+
 	private:
 		u64 _ticks_per_second; //How many ticks are incremented per second
 		u64 _start_ticks; //When was start called
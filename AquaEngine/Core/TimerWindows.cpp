@@ -96,4 +96,20 @@ float Timer::getMillisecondsPerFrame()
 	return 1000.0f / _frames_per_second;
 }
 
+u64 Timer::getTicks()
+{
+	u64 ticks;
+	QueryPerformanceCounter((LARGE_INTEGER*)&ticks);
+
+	return ticks;
+}
+
+u64 Timer::getTicksPerSecond()
+{
+	u64 ticks_per_second;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&ticks_per_second);
+
+	return ticks_per_second;
+}
+
 #endif
\ No newline at end of file
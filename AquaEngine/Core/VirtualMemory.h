@@ -0,0 +1,40 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "..\AquaTypes.h"
+
+#include <cstddef>
+
+namespace aqua
+{
+	//Address space is reserved without using physical memory, pages must be committed before they are used.
+	//Addresses and sizes passed to commit/decommit must be page aligned.
+	namespace virtual_memory
+	{
+		size_t getPageSize();
+
+		//Returns nullptr on failure
+		void* reserve(size_t size);
+		void  release(void* address, size_t size);
+
+		bool  commit(void* address, size_t size);
+		void  decommit(void* address, size_t size);
+
+		//Large (huge) pages, usually 2MB. Fewer TLB entries are needed to cover big buffers.
+		size_t getLargePageSize();
+
+		//Reserves and commits size bytes (multiple of getLargePageSize()) of locked large pages (MAP_HUGETLB/MEM_LARGE_PAGES).
+		//Returns nullptr if the OS can't provide them (no huge pages reserved, missing SeLockMemoryPrivilege, ...)
+		void* allocateLargePages(size_t size);
+		void  freeLargePages(void* address, size_t size);
+
+		//Asks the OS to back a committed range with transparent huge pages. Returns false if not supported
+		bool  adviseLargePages(void* address, size_t size);
+
+		//Bytes of the range currently backed by large pages (queried from the OS, slow)
+		size_t getLargePageBackedSize(void* address, size_t size);
+	};
+};
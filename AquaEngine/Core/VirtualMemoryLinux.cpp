@@ -0,0 +1,135 @@
+#ifdef __linux__
+
+#include "VirtualMemory.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+using namespace aqua;
+
+size_t virtual_memory::getPageSize()
+{
+	static size_t page_size = 0;
+
+	if(page_size == 0)
+		page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+	return page_size;
+}
+
+//Reserved ranges are PROT_NONE mappings, committing makes pages accessible (physical memory is used on first touch)
+
+void* virtual_memory::reserve(size_t size)
+{
+	void* address = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	return address != MAP_FAILED ? address : nullptr;
+}
+
+void virtual_memory::release(void* address, size_t size)
+{
+	munmap(address, size);
+}
+
+bool virtual_memory::commit(void* address, size_t size)
+{
+	return mprotect(address, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+void virtual_memory::decommit(void* address, size_t size)
+{
+	//Returns the physical pages to the OS, next commit gets zeroed pages
+	madvise(address, size, MADV_DONTNEED);
+	mprotect(address, size, PROT_NONE);
+}
+
+
+size_t virtual_memory::getLargePageSize()
+{
+	static size_t large_page_size = 0;
+
+	if(large_page_size == 0)
+	{
+		large_page_size = 2 * 1024 * 1024;
+
+		FILE* file = fopen("/proc/meminfo", "r");
+
+		if(file != nullptr)
+		{
+			char line[256];
+
+			unsigned long long size_kb;
+
+			while(fgets(line, sizeof(line), file) != nullptr)
+			{
+				if(sscanf(line, "Hugepagesize: %llu kB", &size_kb) == 1)
+				{
+					large_page_size = (size_t)size_kb * 1024;
+					break;
+				}
+			}
+
+			fclose(file);
+		}
+	}
+
+	return large_page_size;
+}
+
+void* virtual_memory::allocateLargePages(size_t size)
+{
+	//Needs pages reserved in the hugetlb pool (/proc/sys/vm/nr_hugepages)
+	void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+	return address != MAP_FAILED ? address : nullptr;
+}
+
+void virtual_memory::freeLargePages(void* address, size_t size)
+{
+	munmap(address, size);
+}
+
+bool virtual_memory::adviseLargePages(void* address, size_t size)
+{
+	//Transparent huge pages, only used if the range covers whole aligned large pages
+	return madvise(address, size, MADV_HUGEPAGE) == 0;
+}
+
+size_t virtual_memory::getLargePageBackedSize(void* address, size_t size)
+{
+	//Sum AnonHugePages of every mapping that overlaps the range (mappings can be merged with neighbours so this
+	//is an upper bound)
+	FILE* file = fopen("/proc/self/smaps", "r");
+
+	if(file == nullptr)
+		return 0;
+
+	uptr start = (uptr)address;
+	uptr end   = start + size;
+
+	bool   overlaps = false;
+	size_t backed   = 0;
+
+	char line[512];
+
+	while(fgets(line, sizeof(line), file) != nullptr)
+	{
+		unsigned long long mapping_start;
+		unsigned long long mapping_end;
+		unsigned long long size_kb;
+
+		if(sscanf(line, "%llx-%llx ", &mapping_start, &mapping_end) == 2)
+			overlaps = mapping_start < end && mapping_end > start;
+		else if(overlaps && (sscanf(line, "AnonHugePages: %llu kB", &size_kb) == 1 ||
+							 sscanf(line, "Private_Hugetlb: %llu kB", &size_kb) == 1))
+			backed += (size_t)size_kb * 1024;
+	}
+
+	fclose(file);
+
+	return backed < size ? backed : size;
+}
+
+#endif
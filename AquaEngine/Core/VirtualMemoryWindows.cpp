@@ -0,0 +1,117 @@
+#ifdef _WIN32
+
+#include "VirtualMemory.h"
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif //WIN32_LEAN_AND_MEAN
+
+#include <Windows.h>
+
+using namespace aqua;
+
+size_t virtual_memory::getPageSize()
+{
+	static size_t page_size = 0;
+
+	if(page_size == 0)
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+
+		//Reservations are aligned to the allocation granularity (64KB) but committed in pages
+		page_size = info.dwPageSize;
+	}
+
+	return page_size;
+}
+
+void* virtual_memory::reserve(size_t size)
+{
+	return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+void virtual_memory::release(void* address, size_t size)
+{
+	VirtualFree(address, 0, MEM_RELEASE);
+}
+
+bool virtual_memory::commit(void* address, size_t size)
+{
+	return VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+}
+
+void virtual_memory::decommit(void* address, size_t size)
+{
+	VirtualFree(address, size, MEM_DECOMMIT);
+}
+
+
+size_t virtual_memory::getLargePageSize()
+{
+	static size_t large_page_size = 0;
+
+	if(large_page_size == 0)
+	{
+		large_page_size = GetLargePageMinimum();
+
+		if(large_page_size == 0)
+			large_page_size = 2 * 1024 * 1024;
+	}
+
+	return large_page_size;
+}
+
+//MEM_LARGE_PAGES needs SeLockMemoryPrivilege ("Lock pages in memory") and it must be enabled in the process token
+static bool enableLockMemoryPrivilege()
+{
+	HANDLE token;
+
+	if(!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+		return false;
+
+	TOKEN_PRIVILEGES privileges;
+	privileges.PrivilegeCount           = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+	bool enabled = false;
+
+	if(LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid))
+	{
+		//Succeeds without assigning the privilege if the account doesn't have it
+		enabled = AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) && GetLastError() == ERROR_SUCCESS;
+	}
+
+	CloseHandle(token);
+
+	return enabled;
+}
+
+void* virtual_memory::allocateLargePages(size_t size)
+{
+	static bool has_privilege = enableLockMemoryPrivilege();
+
+	if(!has_privilege || GetLargePageMinimum() == 0)
+		return nullptr;
+
+	return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+}
+
+void virtual_memory::freeLargePages(void* address, size_t size)
+{
+	VirtualFree(address, 0, MEM_RELEASE);
+}
+
+bool virtual_memory::adviseLargePages(void* address, size_t size)
+{
+	//No transparent huge pages on Windows
+	return false;
+}
+
+size_t virtual_memory::getLargePageBackedSize(void* address, size_t size)
+{
+	//Only MEM_LARGE_PAGES allocations use large pages and the caller knows which ones they are
+	return 0;
+}
+
+#endif
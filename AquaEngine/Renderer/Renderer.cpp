@@ -192,7 +192,7 @@ bool Renderer::init(u32 window_width, u32 window_height, WindowH wnd, bool windo
 
 	file::readFile("data/shaders/common.cshader", false, shader_common.data);
 
-	_shader_manager_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator);
+	_shader_manager_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator, "shader_manager");
 
 	if(!_shader_manager.init(shader_common, num_loaded_render_shaders, render_shaders_files, 
 							 num_loaded_compute_shaders, compute_shaders_files,
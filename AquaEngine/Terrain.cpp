@@ -6,6 +6,8 @@
 #include "Renderer\Renderer.h"
 #include "Renderer\RendererStructs.h"
 
+#include "Core\JobManager.h"
+
 #include "Core\Allocators\ScopeStack.h"
 #include "Core\Allocators\LinearAllocator.h"
 #include "Core\Allocators\Allocator.h"
@@ -340,7 +342,7 @@ bool Terrain::getRenderItems(u8 num_passes, const u32* passes_names, const Visib
 	return true;
 }
 
-void Terrain::selectLOD(const Vector3& camera_position, const Vector3& patch_position, u32 level)
+void Terrain::selectLOD(const Vector3& camera_position, const Vector3& patch_position, u32 level, u32 position_scale_offset)
 {
 	//Frustum cull
 	/*
@@ -358,20 +360,20 @@ void Terrain::selectLOD(const Vector3& camera_position, const Vector3& patch_pos
 	if(level == 0 || distance > _levels_ranges[level - 1])
 	{
 		//Add patch
-		u32 offset = _instance_params_desc->getConstantOffset(getStringID("position_scale"));
+		u32 patch = _num_patches++;
 
-		Vector4 position_scale(patch_position.x, patch_position.z, patch_size / 16, (float)level);
+		ASSERT(patch < TER_WIDTH * TER_HEIGHT);
 
-		memcpy(pointer_math::add(_instances_params[_num_patches]->getCBuffersData(), offset), &position_scale, sizeof(position_scale));
+		Vector4 position_scale(patch_position.x, patch_position.z, patch_size / 16, (float)level);
 
-		_num_patches++;
+		memcpy(pointer_math::add(_instances_params[patch]->getCBuffersData(), position_scale_offset), &position_scale, sizeof(position_scale));
 	}
 	else
 	{
-		selectLOD(camera_position, patch_position + Vector3(0, 0, 0), level - 1);
-		selectLOD(camera_position, patch_position + Vector3(0, 0, patch_size_half), level - 1);
-		selectLOD(camera_position, patch_position + Vector3(patch_size_half, 0, 0), level - 1);
-		selectLOD(camera_position, patch_position + Vector3(patch_size_half, 0, patch_size_half), level - 1);
+		selectLOD(camera_position, patch_position + Vector3(0, 0, 0), level - 1, position_scale_offset);
+		selectLOD(camera_position, patch_position + Vector3(0, 0, patch_size_half), level - 1, position_scale_offset);
+		selectLOD(camera_position, patch_position + Vector3(patch_size_half, 0, 0), level - 1, position_scale_offset);
+		selectLOD(camera_position, patch_position + Vector3(patch_size_half, 0, patch_size_half), level - 1, position_scale_offset);
 	}
 }
 
@@ -390,13 +392,20 @@ void Terrain::updateLODs(const Camera& camera)
 
 	u32 num_patches = (u32)ceil(_size / last_level_patch_size);
 
-	for(u32 i = 0; i < num_patches; i++)
+	//Looked up here because getStringID isn't thread safe
+	u32 position_scale_offset = _instance_params_desc->getConstantOffset(getStringID("position_scale"));
+
+	//Each top level patch is subdivided independently
+	JobManager::get().parallelFor(0, num_patches * num_patches, 1, [&](u32 begin, u32 end)
 	{
-		for(u32 j = 0; j < num_patches; j++)
+		for(u32 k = begin; k < end; k++)
 		{
-			selectLOD(eye_pos, Vector3(i*last_level_patch_size, 0, j*last_level_patch_size), _num_levels - 1);
+			u32 i = k / num_patches;
+			u32 j = k % num_patches;
+
+			selectLOD(eye_pos, Vector3(i*last_level_patch_size, 0, j*last_level_patch_size), _num_levels - 1, position_scale_offset);
 		}
-	}
+	});
 
 	//selectLOD(cp, Vector3(0, 0, 0), _num_levels - 1);
 }
@@ -8,6 +8,8 @@
 #include "AquaMath.h"
 #include "AquaTypes.h"
 
+#include <atomic>
+
 namespace aqua
 {
 	class Renderer;
@@ -41,7 +43,7 @@ namespace aqua
 
 	private:
 
-		void selectLOD(const Vector3& camera_position, const Vector3& patch_position, u32 level);
+		void selectLOD(const Vector3& camera_position, const Vector3& patch_position, u32 level, u32 position_scale_offset);
 
 		Allocator&       _allocator;
 		LinearAllocator* _temp_allocator;
@@ -68,7 +70,7 @@ namespace aqua
 		ParameterGroup*  _material_params;
 		ParameterGroup** _instances_params;
 
-		u32 _num_patches;
+		std::atomic<u32> _num_patches; //patches are added from multiple threads in updateLODs
 
 		u32    _size;
 		u32    _num_levels;
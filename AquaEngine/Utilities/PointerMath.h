@@ -6,6 +6,10 @@
 
 #include "..\AquaTypes.h"
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 namespace aqua
 {
 	//Declarations
@@ -34,6 +38,9 @@ namespace aqua
 
 		void*       subtract(void* p, size_t x);
 		const void* subtract(const void* p, size_t x);
+
+		//Hint to bring the cache line containing address into all cache levels (no fault if address is invalid)
+		void        prefetch(const void* address);
 	}
 
 	//Inline Definitions
@@ -140,5 +147,14 @@ namespace aqua
 		{
 			return (const void*)(reinterpret_cast<uptr>(p)-x);
 		}
+
+		inline void prefetch(const void* address)
+		{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+			_mm_prefetch((const char*)address, _MM_HINT_T0);
+#elif defined(__GNUC__)
+			__builtin_prefetch(address);
+#endif
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,17 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "..\AquaTypes.h"
+
+namespace aqua
+{
+	namespace stack_trace
+	{
+		//Return addresses of the calling thread's stack, skipping the first num_skipped frames (capture itself not included).
+		//Returns the number of frames written
+		u32 capture(void** out, u32 max_num_frames, u32 num_skipped = 0);
+	};
+};
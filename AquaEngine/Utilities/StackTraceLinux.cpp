@@ -0,0 +1,26 @@
+#ifdef __linux__
+
+#include "StackTrace.h"
+
+#include <execinfo.h>
+
+using namespace aqua;
+
+static const u32 MAX_NUM_FRAMES = 64;
+
+u32 stack_trace::capture(void** out, u32 max_num_frames, u32 num_skipped)
+{
+	//backtrace() can't skip frames
+	void* frames[MAX_NUM_FRAMES];
+
+	int num_frames = backtrace(frames, MAX_NUM_FRAMES);
+
+	u32 count = 0;
+
+	for(u32 i = num_skipped + 1; i < (u32)num_frames && count < max_num_frames; i++)
+		out[count++] = frames[i];
+
+	return count;
+}
+
+#endif
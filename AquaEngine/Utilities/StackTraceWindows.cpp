@@ -0,0 +1,18 @@
+#ifdef _WIN32
+
+#include "StackTrace.h"
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif //WIN32_LEAN_AND_MEAN
+
+#include <Windows.h>
+
+using namespace aqua;
+
+u32 stack_trace::capture(void** out, u32 max_num_frames, u32 num_skipped)
+{
+	return CaptureStackBackTrace(num_skipped + 1, max_num_frames, out, nullptr);
+}
+
+#endif
@@ -96,23 +96,23 @@ public:
 		// INIT COMPONENT MANAGERS
 		//------------------------------------------
 
-		_entity_manager_allocator    = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator);
+		_entity_manager_allocator    = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator, "entity_manager");
 		_entity_manager              = allocator::allocateNew<EntityManager>(*_main_allocator, *_entity_manager_allocator);
 
-		_transform_manager_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator);
+		_transform_manager_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator, "transform_manager");
 		_transform_manager           = allocator::allocateNew<TransformManager>(*_main_allocator, *_transform_manager_allocator, 1024);
 
-		_physics_manager_allocator   = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator);
+		_physics_manager_allocator   = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator, "physics_manager");
 		_physics_manager             = allocator::allocateNew<PhysicsManager>(*_main_allocator, *_physics_manager_allocator, 1024, 4);
 
-		_model_manager_allocator     = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator);
+		_model_manager_allocator     = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator, "model_manager");
 		_model_manager               = allocator::allocateNew<ModelManager>(*_main_allocator, *_model_manager_allocator,
 																			*_scratchpad_allocator, _renderer,
 																			*_transform_manager, 1024);
 
 		_renderer.addRenderQueueGenerator(getStringID("model_queue_generator"), _model_manager);
 
-		_light_manager_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator);
+		_light_manager_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator, "light_manager");
 		_light_manager           = allocator::allocateNew<LightManager>(*_main_allocator, *_light_manager_allocator,
 																		*_transform_manager, _renderer, 1024);
 
@@ -124,7 +124,7 @@ public:
 		// INIT RESOURCE GENERATORS
 		//------------------------------------------
 
-		_shadow_map_generator_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator);
+		_shadow_map_generator_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator, "shadow_map_generator");
 
 		_shadow_map_generator.init(_renderer, _lua_state, *_shadow_map_generator_allocator, *_scratchpad_allocator);
 
@@ -144,14 +144,14 @@ public:
 
 		//---------------------------------------------------------------------------------
 
-		_volumetric_light_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator);
+		_volumetric_light_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator, "volumetric_light");
 		_volumetric_light_manager.init(_renderer, nullptr, *_volumetric_light_allocator, *_scratchpad_allocator, _wnd_width, _wnd_height);
 
 		_renderer.addResourceGenerator(getStringID("volumetric_lights"), &_volumetric_light_manager);
 
 		//---------------------------------------------------------------------------------
 
-		_main_view_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator);
+		_main_view_allocator = allocator::allocateNew<ProxyAllocator>(*_main_allocator, *_main_allocator, "main_view");
 
 		_main_view_generator.init(_renderer, _lua_state, *_main_view_allocator, *_scratchpad_allocator,
 								  *_light_manager, _wnd_width, _wnd_height);
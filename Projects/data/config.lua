@@ -4,6 +4,13 @@ window_height = 720
 
 memory_size = 1024 * 1024 * 1024; --1GB
 
+num_workers      = 0         --0 = one per logical CPU (per physical core with "physical_core")
+worker_placement = "default" --"default", "physical_core" or "node"
+worker_node      = 0         --NUMA node used by "node"
+free_cores       = 0         --physical cores without workers
+
+allocation_guard = "off"     --"off", "record" or "assert": allocations from the main allocator during a frame are errors (debug and development builds)
+
 function initRenderer()
 
 end
\ No newline at end of file
@@ -0,0 +1,746 @@
+#include "Benchmark.h"
+
+#include <Core\Allocators\FreeListAllocator.h>
+#include <Core\Allocators\TLSFAllocator.h>
+#include <Core\Allocators\BlockAllocator.h>
+#include <Core\Allocators\SmallBlockAllocator.h>
+#include <Core\Allocators\FixedLinearAllocator.h>
+#include <Core\Allocators\DynamicLinearAllocator.h>
+#include <Core\Allocators\EndAllocator.h>
+#include <Core\Allocators\ThreadCachingAllocator.h>
+
+#include <Core\JobManager.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+
+using namespace aqua;
+
+//Traces modelled on how the engine allocates, replayed on every allocator that can serve them and on malloc:
+//	- churn_small/churn_mixed: long running heap, every operation frees a random allocation and replaces it with a new
+//	  one of random size (entities being spawned and despawned)
+//	- capacity_doubling: component managers SoA buffers growing with setCapacity(capacity * 2 + 8) (allocate, memcpy,
+//	  deallocate) interleaved with small allocations that stay alive (hash maps, ...)
+//	- frame_scratch: bursts of temporary allocations released at the end of every frame
+//	- param_groups: parameter groups created and deleted in batches (ModelManager uses a SmallBlockAllocator)
+//	- mt_churn: churn_small on every worker at the same time
+//Heap memory is allocated for every run so runs start with cold pages.
+//fragmentation = 1 - largest possible allocation / free memory (measured at the end, fixed size heaps only)
+//peak_rss_mb   = peak resident memory during the run - resident memory before it
+
+static const size_t HEAP_SIZE                 = 256 * 1024 * 1024;
+
+static const u32    NUM_OPERATIONS            = 100000;
+
+static const u32    NUM_LIVE_SMALL            = 16384;
+static const u32    MIN_SMALL_SIZE            = 16;
+static const u32    MAX_SMALL_SIZE            = 256;
+
+static const u32    NUM_LIVE_MIXED            = 2048;
+static const u32    MAX_MIXED_SIZE_LOG2       = 16;     //log-uniform sizes from 16 bytes up to 64KB
+
+static const u32    NUM_MANAGERS              = 6;
+static const u32    NUM_INSTANCES             = 100000; //per manager
+static const u32    MIN_PERSISTENT_SIZE       = 32;     //allocations that stay alive made after every grow
+static const u32    MAX_PERSISTENT_SIZE       = 512;
+
+static const u32    NUM_FRAMES                = 200;
+static const u32    NUM_SCRATCH_ALLOCATIONS   = 2000;   //per frame
+static const u32    MAX_SCRATCH_SIZE_LOG2     = 10;     //log-uniform sizes from 16 bytes up to 1KB
+
+static const u32    NUM_PARAM_GROUPS          = 4096;   //live
+static const u32    PARAM_GROUP_BATCH_SIZE    = 64;     //materials loaded/unloaded together
+static const u32    MIN_PARAM_GROUP_SIZE      = 32;
+static const u32    MAX_PARAM_GROUP_SIZE      = 512;
+
+static const u32    NUM_LIVE_PER_THREAD       = 1024;
+static const u32    NUM_OPERATIONS_PER_THREAD = 100000;
+
+static const size_t BLOCK_SIZE                = 64 * 1024;       //BlockAllocator
+static const u32    SMALL_BLOCK_SIZE          = 4 * 1024;        //same as ModelManager
+static const size_t DYNAMIC_LINEAR_BLOCK_SIZE = 1024 * 1024;
+
+static const u32    MAX_NUM_LIVE              = NUM_LIVE_SMALL;
+static const u32    MAX_NUM_THREADS           = 64;
+
+static const u32    SEED                      = 0x2545F491;
+
+struct Random
+{
+	u32 state;
+
+	u32 next()
+	{
+		//xorshift32, same sequence for every allocator
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+
+		return state;
+	}
+
+	u32 range(u32 min, u32 max)
+	{
+		return min + next() % (max - min + 1);
+	}
+
+	//Log-uniform size from 16 bytes up to 2^(max_size_log2 + 1)
+	size_t logSize(u32 max_size_log2)
+	{
+		size_t size = (size_t)1 << (next() % (max_size_log2 - 3) + 4);
+
+		return size + next() % size;
+	}
+};
+
+//glibc malloc (CRT heap on Windows)
+class MallocAllocator : public Allocator
+{
+public:
+	MallocAllocator() : Allocator(1)
+	{}
+
+	void* allocate(size_t size, u8 alignment) override
+	{
+		ASSERT(alignment <= 16);
+
+		return malloc(size);
+	}
+
+	void deallocate(void* p) override
+	{
+		free(p);
+	}
+};
+
+//Makes a single threaded allocator thread safe with a mutex
+class LockedAllocator : public Allocator
+{
+public:
+	LockedAllocator(Allocator& allocator) : Allocator(1), _allocator(allocator)
+	{}
+
+	void* allocate(size_t size, u8 alignment) override
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		return _allocator.allocate(size, alignment);
+	}
+
+	void deallocate(void* p) override
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_allocator.deallocate(p);
+	}
+
+private:
+	Allocator& _allocator;
+	std::mutex _mutex;
+};
+
+enum class AllocatorType : u8
+{
+	MALLOC,
+	FREE_LIST,
+	TLSF,
+	BLOCK,
+	SMALL_BLOCK,
+	LINEAR,
+	DYNAMIC_LINEAR,
+	END,
+	LOCKED_TLSF,
+	THREAD_CACHING
+};
+
+static const char* ALLOCATOR_NAMES[] =
+{
+	"malloc",
+	"free_list",
+	"tlsf",
+	"block",
+	"small_block",
+	"linear",
+	"dynamic_linear",
+	"end",
+	"tlsf_locked",
+	"thread_caching"
+};
+
+//Creates the allocators under test (their memory comes from malloc so it doesn't interfere)
+static MallocAllocator malloc_allocator;
+
+struct TestAllocator
+{
+	AllocatorType type;
+	void*         memory;
+	Allocator*    heap;      //fixed size allocator that owns memory (nullptr for malloc)
+	Allocator*    allocator; //allocator under test (heap or an allocator on top of it)
+};
+
+static void createAllocator(AllocatorType type, TestAllocator& out)
+{
+	out.type      = type;
+	out.memory    = nullptr;
+	out.heap      = nullptr;
+	out.allocator = &malloc_allocator;
+
+	if(type == AllocatorType::MALLOC)
+		return;
+
+	out.memory = malloc(HEAP_SIZE);
+
+	switch(type)
+	{
+	case AllocatorType::TLSF:
+	case AllocatorType::LOCKED_TLSF:
+		out.heap = allocator::allocateNew<TLSFAllocator>(malloc_allocator, HEAP_SIZE, out.memory);
+		break;
+	case AllocatorType::BLOCK:
+		out.heap = allocator::allocateNew<BlockAllocator>(malloc_allocator, HEAP_SIZE, out.memory, BLOCK_SIZE, (u8)16);
+		break;
+	case AllocatorType::LINEAR:
+		out.heap = allocator::allocateNew<FixedLinearAllocator>(malloc_allocator, HEAP_SIZE, out.memory);
+		break;
+	case AllocatorType::END:
+		//Allocates backwards from start
+		out.heap = allocator::allocateNew<EndAllocator>(malloc_allocator, HEAP_SIZE, pointer_math::add(out.memory, HEAP_SIZE));
+		break;
+	default:
+		out.heap = allocator::allocateNew<FreeListAllocator>(malloc_allocator, HEAP_SIZE, out.memory);
+		break;
+	}
+
+	switch(type)
+	{
+	case AllocatorType::SMALL_BLOCK:
+		out.allocator = allocator::allocateNew<SmallBlockAllocator>(malloc_allocator, *out.heap, SMALL_BLOCK_SIZE, 16u);
+		break;
+	case AllocatorType::DYNAMIC_LINEAR:
+		out.allocator = allocator::allocateNew<DynamicLinearAllocator>(malloc_allocator, *out.heap, DYNAMIC_LINEAR_BLOCK_SIZE, (u8)16);
+		break;
+	case AllocatorType::LOCKED_TLSF:
+		out.allocator = allocator::allocateNew<LockedAllocator>(malloc_allocator, *out.heap);
+		break;
+	case AllocatorType::THREAD_CACHING:
+		out.allocator = allocator::allocateNew<ThreadCachingAllocator>(malloc_allocator, *out.heap,
+																	   (u8)(JobManager::get().getNumWorkers() + 1));
+		break;
+	default:
+		out.allocator = out.heap;
+		break;
+	}
+}
+
+static void destroyAllocator(TestAllocator& allocator)
+{
+	if(allocator.allocator != allocator.heap && allocator.allocator != &malloc_allocator)
+		allocator::deallocateDelete(malloc_allocator, allocator.allocator);
+
+	if(allocator.heap != nullptr)
+		allocator::deallocateDelete(malloc_allocator, allocator.heap);
+
+	free(allocator.memory);
+}
+
+//Binary search using allocate, works with any fixed size allocator
+static size_t getLargestAllocation(Allocator& allocator, size_t granularity)
+{
+	size_t min = 0;
+	size_t max = allocator.getSize() - allocator.getUsedMemory();
+
+	while(max - min > granularity)
+	{
+		size_t size = (min + (max - min) / 2) / granularity * granularity;
+
+		if(size == 0 || size == min)
+			break;
+
+		void* p = allocator.allocate(size, 16);
+
+		if(p != nullptr)
+		{
+			allocator.deallocate(p);
+			min = size;
+		}
+		else
+		{
+			max = size;
+		}
+	}
+
+	return min;
+}
+
+//Common per run measurements
+struct Run
+{
+	double seconds;
+	u64    num_operations;
+	u32    num_failed;
+	double fragmentation;  //< 0 = not measured
+	size_t largest;
+	size_t rss;            //peak_rss_mb
+};
+
+//Call before freeing the live allocations
+static void measureFragmentation(const TestAllocator& allocator, Run& run)
+{
+	run.fragmentation = -1.0;
+	run.largest       = 0;
+
+	if(allocator.type != AllocatorType::FREE_LIST && allocator.type != AllocatorType::TLSF &&
+	   allocator.type != AllocatorType::BLOCK)
+		return;
+
+	size_t granularity = allocator.type == AllocatorType::BLOCK ? BLOCK_SIZE : 64;
+
+	run.largest       = getLargestAllocation(*allocator.heap, granularity);
+	run.fragmentation = 1.0 - (double)run.largest / (allocator.heap->getSize() - allocator.heap->getUsedMemory());
+}
+
+//Heap churn
+static void runChurn(TestAllocator& allocator, Run& run, u32 num_live, bool mixed, void** live)
+{
+	Allocator& a = *allocator.allocator;
+
+	Random random = { SEED };
+
+	for(u32 i = 0; i < num_live; i++)
+		live[i] = a.allocate(mixed ? random.logSize(MAX_MIXED_SIZE_LOG2) : random.range(MIN_SMALL_SIZE, MAX_SMALL_SIZE), DEFAULT_ALIGNMENT);
+
+	double start = benchmark::getTime();
+
+	for(u32 i = 0; i < NUM_OPERATIONS; i++)
+	{
+		u32 index = random.next() % num_live;
+
+		if(live[index] != nullptr)
+			a.deallocate(live[index]);
+
+		live[index] = a.allocate(mixed ? random.logSize(MAX_MIXED_SIZE_LOG2) : random.range(MIN_SMALL_SIZE, MAX_SMALL_SIZE), DEFAULT_ALIGNMENT);
+
+		if(live[index] == nullptr)
+			run.num_failed++;
+	}
+
+	run.seconds        = benchmark::getTime() - start;
+	run.num_operations = 2 * NUM_OPERATIONS; //deallocate + allocate
+
+	measureFragmentation(allocator, run);
+
+	for(u32 i = 0; i < num_live; i++)
+	{
+		if(live[i] != nullptr)
+			a.deallocate(live[i]);
+	}
+}
+
+static void runChurnSmall(TestAllocator& allocator, Run& run, void** live)
+{
+	runChurn(allocator, run, NUM_LIVE_SMALL, false, live);
+}
+
+static void runChurnMixed(TestAllocator& allocator, Run& run, void** live)
+{
+	runChurn(allocator, run, NUM_LIVE_MIXED, true, live);
+}
+
+//Component managers growing (instance sizes of TransformManager, ModelManager, LightManager, ...)
+static const u32 INSTANCE_SIZES[NUM_MANAGERS] = { 156, 120, 48, 64, 32, 96 };
+
+static void runCapacityDoubling(TestAllocator& allocator, Run& run, void** live)
+{
+	Allocator& a = *allocator.allocator;
+
+	Random random = { SEED };
+
+	size_t granularity = allocator.type == AllocatorType::BLOCK ? BLOCK_SIZE : 1;
+
+	void*  buffers[NUM_MANAGERS];
+	u32    sizes[NUM_MANAGERS];
+	u32    capacities[NUM_MANAGERS];
+
+	u32    num_persistent = 0;
+
+	for(u32 i = 0; i < NUM_MANAGERS; i++)
+	{
+		buffers[i]    = nullptr;
+		sizes[i]      = 0;
+		capacities[i] = 0;
+	}
+
+	double start = benchmark::getTime();
+
+	for(u32 i = 0; i < NUM_INSTANCES * NUM_MANAGERS; i++)
+	{
+		u32 manager = i % NUM_MANAGERS;
+
+		if(sizes[manager] == capacities[manager])
+		{
+			u32    new_capacity = capacities[manager] * 2 + 8;
+			size_t buffer_size  = (new_capacity * (size_t)INSTANCE_SIZES[manager] + granularity - 1) / granularity * granularity;
+
+			void* new_buffer = a.allocate(buffer_size, 16);
+
+			if(new_buffer == nullptr)
+			{
+				run.num_failed++;
+				break;
+			}
+
+			if(buffers[manager] != nullptr)
+			{
+				memcpy(new_buffer, buffers[manager], sizes[manager] * (size_t)INSTANCE_SIZES[manager]);
+
+				a.deallocate(buffers[manager]);
+			}
+
+			buffers[manager]    = new_buffer;
+			capacities[manager] = new_capacity;
+
+			//Something else allocates while the manager grows and keeps the memory (hash map, parameter group, ...)
+			if(num_persistent < MAX_NUM_LIVE && allocator.type != AllocatorType::BLOCK)
+			{
+				live[num_persistent++] = a.allocate(random.range(MIN_PERSISTENT_SIZE, MAX_PERSISTENT_SIZE), DEFAULT_ALIGNMENT);
+			}
+		}
+
+		memset((u8*)buffers[manager] + sizes[manager] * (size_t)INSTANCE_SIZES[manager], 0, INSTANCE_SIZES[manager]);
+		sizes[manager]++;
+	}
+
+	//Time per instance created, growing (page faults and memcpy included) is most of it
+	run.seconds        = benchmark::getTime() - start;
+	run.num_operations = (u64)NUM_INSTANCES * NUM_MANAGERS;
+
+	measureFragmentation(allocator, run);
+
+	for(u32 i = 0; i < NUM_MANAGERS; i++)
+	{
+		if(buffers[i] != nullptr)
+			a.deallocate(buffers[i]);
+	}
+
+	for(u32 i = 0; i < num_persistent; i++)
+	{
+		if(live[i] != nullptr)
+			a.deallocate(live[i]);
+	}
+}
+
+//Temporary allocations released at the end of every frame (rewind for linear allocators, in reverse order otherwise)
+static void runFrameScratch(TestAllocator& allocator, Run& run, void** live)
+{
+	Allocator& a = *allocator.allocator;
+
+	bool linear = allocator.type == AllocatorType::LINEAR || allocator.type == AllocatorType::DYNAMIC_LINEAR ||
+				  allocator.type == AllocatorType::END;
+
+	Random random = { SEED };
+
+	double start = benchmark::getTime();
+
+	for(u32 i = 0; i < NUM_FRAMES; i++)
+	{
+		for(u32 j = 0; j < NUM_SCRATCH_ALLOCATIONS; j++)
+		{
+			live[j] = a.allocate(random.logSize(MAX_SCRATCH_SIZE_LOG2 - 1), 16);
+
+			if(live[j] == nullptr)
+				run.num_failed++;
+		}
+
+		if(linear)
+		{
+			((LinearAllocator&)a).clear();
+		}
+		else
+		{
+			for(u32 j = NUM_SCRATCH_ALLOCATIONS; j > 0; j--)
+			{
+				if(live[j - 1] != nullptr)
+					a.deallocate(live[j - 1]);
+			}
+		}
+	}
+
+	run.seconds        = benchmark::getTime() - start;
+	run.num_operations = (u64)NUM_FRAMES * NUM_SCRATCH_ALLOCATIONS; //allocations (release included)
+	run.fragmentation  = -1.0;
+}
+
+//Batches of parameter groups created together and a random older batch deleted
+static void runParamGroups(TestAllocator& allocator, Run& run, void** live)
+{
+	static const u32 NUM_BATCHES = NUM_PARAM_GROUPS / PARAM_GROUP_BATCH_SIZE;
+
+	Allocator& a = *allocator.allocator;
+
+	Random random = { SEED };
+
+	for(u32 i = 0; i < NUM_PARAM_GROUPS; i++)
+		live[i] = a.allocate(random.range(MIN_PARAM_GROUP_SIZE, MAX_PARAM_GROUP_SIZE), 16);
+
+	double start = benchmark::getTime();
+
+	u32 num_batches = NUM_OPERATIONS / PARAM_GROUP_BATCH_SIZE;
+
+	for(u32 i = 0; i < num_batches; i++)
+	{
+		void** batch = live + (random.next() % NUM_BATCHES) * PARAM_GROUP_BATCH_SIZE;
+
+		for(u32 j = 0; j < PARAM_GROUP_BATCH_SIZE; j++)
+		{
+			if(batch[j] != nullptr)
+				a.deallocate(batch[j]);
+		}
+
+		for(u32 j = 0; j < PARAM_GROUP_BATCH_SIZE; j++)
+		{
+			batch[j] = a.allocate(random.range(MIN_PARAM_GROUP_SIZE, MAX_PARAM_GROUP_SIZE), 16);
+
+			if(batch[j] == nullptr)
+				run.num_failed++;
+		}
+	}
+
+	run.seconds        = benchmark::getTime() - start;
+	run.num_operations = 2 * (u64)num_batches * PARAM_GROUP_BATCH_SIZE;
+
+	measureFragmentation(allocator, run);
+
+	for(u32 i = 0; i < NUM_PARAM_GROUPS; i++)
+	{
+		if(live[i] != nullptr)
+			a.deallocate(live[i]);
+	}
+}
+
+struct Trace
+{
+	const char*   name;
+	void          (*run)(TestAllocator&, Run&, void**);
+	u32           num_allocators;
+	AllocatorType allocators[6];
+};
+
+static const Trace TRACES[] =
+{
+	{ "churn_small",       runChurnSmall,       4, { AllocatorType::MALLOC, AllocatorType::FREE_LIST, AllocatorType::TLSF, AllocatorType::SMALL_BLOCK } },
+	{ "churn_mixed",       runChurnMixed,       3, { AllocatorType::MALLOC, AllocatorType::FREE_LIST, AllocatorType::TLSF } },
+	{ "capacity_doubling", runCapacityDoubling, 4, { AllocatorType::MALLOC, AllocatorType::FREE_LIST, AllocatorType::TLSF, AllocatorType::BLOCK } },
+	{ "frame_scratch",     runFrameScratch,     6, { AllocatorType::MALLOC, AllocatorType::FREE_LIST, AllocatorType::TLSF,
+													AllocatorType::LINEAR, AllocatorType::DYNAMIC_LINEAR, AllocatorType::END } },
+	{ "param_groups",      runParamGroups,      4, { AllocatorType::MALLOC, AllocatorType::FREE_LIST, AllocatorType::TLSF, AllocatorType::SMALL_BLOCK } },
+};
+
+static const u32 NUM_TRACES = sizeof(TRACES) / sizeof(Trace);
+
+//Result names must outlive the results
+static std::deque<std::string> result_names;
+
+static const char* getResultName(AllocatorType type, const char* trace)
+{
+	result_names.push_back(std::string(ALLOCATOR_NAMES[(u8)type]) + "_" + trace);
+
+	return result_names.back().c_str();
+}
+
+static void addResult(AllocatorType type, const char* trace, u32 num_threads, const Run& best, const Run& last)
+{
+	benchmark::Result result("allocators", getResultName(type, trace), num_threads, best.num_operations, best.seconds);
+
+	if(last.fragmentation >= 0.0)
+	{
+		result.addMetric("fragmentation", last.fragmentation);
+		result.addMetric("largest_free_kb", last.largest / 1024.0);
+	}
+
+	result.addMetric("failed_allocations", last.num_failed);
+	result.addMetric("peak_rss_mb", last.rss / (1024.0 * 1024.0));
+
+	benchmark::addResult(result);
+}
+
+static size_t getRSSIncrease(size_t rss_before)
+{
+	size_t peak = benchmark::getPeakRSS();
+
+	return peak > rss_before ? peak - rss_before : 0;
+}
+
+static void runTrace(const benchmark::Options& options, const Trace& trace, AllocatorType type, void** live)
+{
+	Run best = {};
+	Run last = {};
+
+	for(u32 i = 0; i < options.repetitions; i++)
+	{
+		benchmark::resetPeakRSS();
+
+		size_t rss_before = benchmark::getCurrentRSS();
+
+		TestAllocator allocator;
+		createAllocator(type, allocator);
+
+		last = Run();
+		trace.run(allocator, last, live);
+
+		destroyAllocator(allocator);
+
+		last.rss = getRSSIncrease(rss_before);
+
+		if(i == 0 || last.seconds < best.seconds)
+			best = last;
+	}
+
+	addResult(type, trace.name, 1, best, last);
+}
+
+//Multithreaded churn, one job per worker (THREAD_ID is needed by ThreadCachingAllocator)
+struct ChurnJobData
+{
+	Allocator* allocator;
+	u32        seed;
+	u32        num_failed;
+	void*      live[NUM_LIVE_PER_THREAD];
+};
+
+static void churnJob(JobId id, void* data)
+{
+	ChurnJobData& job = *(ChurnJobData*)data;
+
+	Random random = { job.seed };
+
+	for(u32 i = 0; i < NUM_LIVE_PER_THREAD; i++)
+		job.live[i] = job.allocator->allocate(random.range(MIN_SMALL_SIZE, MAX_SMALL_SIZE), DEFAULT_ALIGNMENT);
+
+	for(u32 i = 0; i < NUM_OPERATIONS_PER_THREAD; i++)
+	{
+		u32 index = random.next() % NUM_LIVE_PER_THREAD;
+
+		if(job.live[index] != nullptr)
+			job.allocator->deallocate(job.live[index]);
+
+		job.live[index] = job.allocator->allocate(random.range(MIN_SMALL_SIZE, MAX_SMALL_SIZE), DEFAULT_ALIGNMENT);
+
+		if(job.live[index] == nullptr)
+			job.num_failed++;
+	}
+
+	for(u32 i = 0; i < NUM_LIVE_PER_THREAD; i++)
+	{
+		if(job.live[i] != nullptr)
+			job.allocator->deallocate(job.live[i]);
+	}
+}
+
+struct ChurnRootData
+{
+	ChurnJobData* jobs;
+	u32           num_jobs;
+};
+
+static void churnRootJob(JobId id, void* data)
+{
+	ChurnRootData& root = *(ChurnRootData*)data;
+
+	JobManager& jobs = JobManager::get();
+
+	for(u32 i = 0; i < root.num_jobs; i++)
+		jobs.addJob(churnJob, &root.jobs[i], JobManager::NULL_JOB, id);
+}
+
+static const AllocatorType MT_ALLOCATORS[] = { AllocatorType::MALLOC, AllocatorType::LOCKED_TLSF, AllocatorType::THREAD_CACHING };
+
+static const u32 NUM_MT_ALLOCATORS = sizeof(MT_ALLOCATORS) / sizeof(AllocatorType);
+
+static void runMultithreadedChurn(const benchmark::Options& options)
+{
+	JobManager& jobs = JobManager::get();
+
+	u32 thread_counts[16];
+	u32 num_thread_counts = benchmark::getThreadCounts(options.max_threads < MAX_NUM_THREADS ? options.max_threads : MAX_NUM_THREADS,
+													   thread_counts, 16);
+
+	ChurnJobData* job_data = (ChurnJobData*)malloc(MAX_NUM_THREADS * sizeof(ChurnJobData));
+
+	for(u32 i = 0; i < num_thread_counts; i++)
+	{
+		u32 num_threads = thread_counts[i];
+
+		JobManagerConfig config;
+		config.num_workers = num_threads;
+
+		jobs.init(config);
+
+		for(u32 j = 0; j < NUM_MT_ALLOCATORS; j++)
+		{
+			Run best = {};
+			Run last = {};
+
+			for(u32 k = 0; k < options.repetitions; k++)
+			{
+				benchmark::resetPeakRSS();
+
+				size_t rss_before = benchmark::getCurrentRSS();
+
+				TestAllocator allocator;
+				createAllocator(MT_ALLOCATORS[j], allocator);
+
+				for(u32 l = 0; l < num_threads; l++)
+				{
+					job_data[l].allocator  = allocator.allocator;
+					job_data[l].seed       = SEED + l;
+					job_data[l].num_failed = 0;
+				}
+
+				ChurnRootData root = { job_data, num_threads };
+
+				double start = benchmark::getTime();
+
+				jobs.wait(jobs.addJob(churnRootJob, &root));
+
+				last               = Run();
+				last.seconds       = benchmark::getTime() - start;
+				last.fragmentation = -1.0;
+
+				for(u32 l = 0; l < num_threads; l++)
+				{
+					last.num_operations += 2 * (NUM_LIVE_PER_THREAD + NUM_OPERATIONS_PER_THREAD);
+					last.num_failed     += job_data[l].num_failed;
+				}
+
+				destroyAllocator(allocator);
+
+				last.rss = getRSSIncrease(rss_before);
+
+				if(k == 0 || last.seconds < best.seconds)
+					best = last;
+			}
+
+			addResult(MT_ALLOCATORS[j], "mt_churn", num_threads, best, last);
+		}
+	}
+
+	free(job_data);
+}
+
+void benchmark::runAllocatorBenchmarks(const Options& options)
+{
+	void** live = (void**)malloc(MAX_NUM_LIVE * sizeof(void*));
+
+	for(u32 i = 0; i < NUM_TRACES; i++)
+	{
+		for(u32 j = 0; j < TRACES[i].num_allocators; j++)
+			runTrace(options, TRACES[i], TRACES[i].allocators[j], live);
+	}
+
+	free(live);
+
+	runMultithreadedChurn(options);
+}
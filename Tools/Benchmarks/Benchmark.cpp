@@ -0,0 +1,198 @@
+#include "Benchmark.h"
+
+#include <Core\Timer.h>
+
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif //WIN32_LEAN_AND_MEAN
+
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace aqua;
+
+static std::vector<benchmark::Result> results;
+
+static u32 num_failures = 0;
+
+benchmark::Result::Result(const char* suite, const char* name, u32 num_threads, u64 num_operations, double seconds)
+	: suite(suite), name(name), num_threads(num_threads), num_operations(num_operations), seconds(seconds), num_metrics(0)
+{}
+
+void benchmark::Result::addMetric(const char* name, double value)
+{
+	if(num_metrics == MAX_NUM_METRICS)
+		return;
+
+	metric_names[num_metrics] = name;
+	metrics[num_metrics]      = value;
+	num_metrics++;
+}
+
+double benchmark::getTime()
+{
+	static const double ticks_per_second = (double)Timer::getTicksPerSecond();
+
+	return (double)Timer::getTicks() / ticks_per_second;
+}
+
+void benchmark::addResult(const Result& result)
+{
+	results.push_back(result);
+
+	//Progress in human readable form, the results go to the JSON document
+	std::cerr << result.suite << "." << result.name << " threads=" << result.num_threads << " "
+			  << (result.seconds * 1e9 / (result.num_operations > 0 ? result.num_operations : 1)) << " ns/op";
+
+	for(u32 i = 0; i < result.num_metrics; i++)
+		std::cerr << " " << result.metric_names[i] << "=" << result.metrics[i];
+
+	std::cerr << std::endl;
+}
+
+void benchmark::reportFailure(const Result& result, const char* message)
+{
+	num_failures++;
+
+	std::cerr << "FAILED " << result.suite << "." << result.name << " threads=" << result.num_threads << ": " << message << std::endl;
+}
+
+u32 benchmark::getNumFailures()
+{
+	return num_failures;
+}
+
+static void writeResults(std::ostream& out)
+{
+	out << "{\n\t\"results\": [\n";
+
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		const benchmark::Result& result = results[i];
+
+		double ns_per_op = result.seconds * 1e9 / (result.num_operations > 0 ? result.num_operations : 1);
+
+		out << "\t\t{ \"suite\": \"" << result.suite << "\", \"name\": \"" << result.name << "\", \"threads\": " << result.num_threads
+			<< ", \"operations\": " << result.num_operations << ", \"seconds\": " << result.seconds << ", \"ns_per_op\": " << ns_per_op;
+
+		for(u32 j = 0; j < result.num_metrics; j++)
+			out << ", \"" << result.metric_names[j] << "\": " << result.metrics[j];
+
+		out << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	out << "\t]\n}\n";
+}
+
+bool benchmark::writeResults(const char* filename)
+{
+	if(filename == nullptr)
+	{
+		::writeResults(std::cout);
+		return true;
+	}
+
+	std::ofstream file(filename);
+
+	if(!file.is_open())
+		return false;
+
+	::writeResults(file);
+
+	return true;
+}
+
+u32 benchmark::getThreadCounts(u32 max_threads, u32* out, u32 max_count)
+{
+	u32 count = 0;
+
+	for(u32 i = 1; i < max_threads && count < max_count; i *= 2)
+		out[count++] = i;
+
+	if(count < max_count)
+		out[count++] = max_threads;
+
+	return count;
+}
+
+#ifdef _WIN32
+
+size_t benchmark::getCurrentRSS()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+
+	return counters.WorkingSetSize;
+}
+
+size_t benchmark::getPeakRSS()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+
+	return counters.PeakWorkingSetSize;
+}
+
+bool benchmark::resetPeakRSS()
+{
+	//The peak working set can't be reset
+	return false;
+}
+
+#else
+
+size_t benchmark::getCurrentRSS()
+{
+	std::ifstream file("/proc/self/statm");
+
+	size_t size;
+	size_t resident = 0;
+
+	file >> size >> resident;
+
+	return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+size_t benchmark::getPeakRSS()
+{
+	std::ifstream file("/proc/self/status");
+
+	std::string line;
+
+	while(std::getline(file, line))
+	{
+		//VmHWM:   123456 kB
+		if(line.compare(0, 6, "VmHWM:") == 0)
+			return (size_t)std::stoull(line.substr(6)) * 1024;
+	}
+
+	return 0;
+}
+
+bool benchmark::resetPeakRSS()
+{
+	//Linux 4.0+
+	std::ofstream file("/proc/self/clear_refs");
+
+	if(!file.is_open())
+		return false;
+
+	file << "5";
+
+	return (bool)file.flush();
+}
+
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+///////////////// Tiago Costa, 2015
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <AquaTypes.h>
+
+namespace benchmark
+{
+	static const aqua::u32 MAX_NUM_METRICS = 4;
+
+	struct Result
+	{
+		Result(const char* suite, const char* name, aqua::u32 num_threads, aqua::u64 num_operations, double seconds);
+
+		void addMetric(const char* name, double value);
+
+		const char* suite;
+		const char* name;
+		aqua::u32   num_threads;
+		aqua::u64   num_operations;
+		double      seconds;
+
+		//Suite specific values (scaling efficiency, fragmentation, ...)
+		aqua::u32   num_metrics;
+		const char* metric_names[MAX_NUM_METRICS];
+		double      metrics[MAX_NUM_METRICS];
+	};
+
+	struct Options
+	{
+		aqua::u32   max_threads;  //0 = hardware threads
+		aqua::u32   repetitions;  //best run is reported
+		const char* suite;        //nullptr = all suites
+		const char* output;       //nullptr = stdout
+	};
+
+	//Seconds since an arbitrary point
+	double getTime();
+
+	void addResult(const Result& result);
+
+	//Suites that double as stress tests report failed checks, the process exit code is non-zero if any failed
+	void      reportFailure(const Result& result, const char* message);
+	aqua::u32 getNumFailures();
+
+	//JSON document with every result added so far
+	bool writeResults(const char* filename);
+
+	//Resident memory of the process in bytes.
+	//If resetPeakRSS() isn't supported (Windows) getPeakRSS() returns the peak since the process started
+	size_t getCurrentRSS();
+	size_t getPeakRSS();
+	bool   resetPeakRSS();
+
+	//Thread counts to test: 1, 2, 4, ..., max_threads
+	aqua::u32 getThreadCounts(aqua::u32 max_threads, aqua::u32* out, aqua::u32 max_count);
+
+	//Suites
+	void runJobManagerBenchmarks(const Options& options);
+	void runAllocatorBenchmarks(const Options& options);
+	void runTransformBenchmarks(const Options& options);
+	void runHashMapBenchmarks(const Options& options);
+	void runConcurrentHashMapBenchmarks(const Options& options);
+	void runQueueBenchmarks(const Options& options);
+};
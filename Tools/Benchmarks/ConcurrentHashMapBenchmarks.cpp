@@ -0,0 +1,290 @@
+#include "Benchmark.h"
+
+#include <Core\Allocators\FreeListAllocator.h>
+
+#include <Core\Containers\ConcurrentHashMap.h>
+#include <Core\Containers\FlatHashMap.h>
+
+#include <Core\JobManager.h>
+
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+
+using namespace aqua;
+
+//ConcurrentHashMap vs FlatHashMap behind a mutex, with one job per worker doing entity lookups and sometimes
+//creating/destroying entities (inserting/removing keys):
+//	- read_mostly: 1 write every READ_MOSTLY_WRITE_PERIOD operations
+//	- write_heavy: 1 write every WRITE_HEAVY_WRITE_PERIOD operations (rebuilds/rehashes while readers are running)
+//Half of the lookups are stable keys (never removed), the other half volatile keys (inserted/removed by the writes).
+//Doubles as a stress test (any error fails the run), errors counts:
+//	- lookups that returned a value that doesn't belong to the key or missed a stable key
+//	- after the run: keys found by has() that don't match size(), stable keys missing
+//ops = lookups + writes of every job
+
+static const size_t HEAP_SIZE                 = 64 * 1024 * 1024;
+
+static const u32    MAX_NUM_THREADS           = 64;
+
+static const u32    NUM_STABLE_KEYS           = 16 * 1024;
+static const u32    NUM_VOLATILE_KEYS         = 16 * 1024;
+static const u32    NUM_KEYS                  = NUM_STABLE_KEYS + NUM_VOLATILE_KEYS;
+
+static const u32    NUM_OPERATIONS_PER_THREAD = 512 * 1024;
+
+static const u32    READ_MOSTLY_WRITE_PERIOD  = 1024;
+static const u32    WRITE_HEAVY_WRITE_PERIOD  = 16;
+
+static const u32    SEED                      = 0x7F4A7C15;
+
+static const u32    MISSING                   = UINT32_MAX;
+
+static u32 xorshift(u32& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+
+	return state;
+}
+
+//Never MISSING for keys < NUM_KEYS
+static u32 getValue(u32 key)
+{
+	return key ^ 0xA5A5A5A5;
+}
+
+class LockedFlatHashMap
+{
+public:
+	LockedFlatHashMap(Allocator& allocator) : _map(allocator)
+	{
+	}
+
+	bool has(u32 key) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _map.has(key);
+	}
+
+	u32 lookup(u32 key, const u32& default_value) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _map.lookup(key, default_value);
+	}
+
+	void insert(u32 key, const u32& value)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_map.insert(key, value);
+	}
+
+	bool remove(u32 key)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _map.remove(key);
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _map.size();
+	}
+
+	u32 getNumRebuilds() const
+	{
+		return 0;
+	}
+
+private:
+	FlatHashMap<u32, u32> _map;
+	mutable std::mutex    _mutex;
+};
+
+template<class Map>
+struct MapJobData
+{
+	Map* map;
+	u32  seed;
+	u32  write_period;
+	u32  num_writes;
+	u32  num_errors;
+	u32  checksum;
+};
+
+template<class Map>
+static void mapJob(JobId id, void* data)
+{
+	MapJobData<Map>& job = *(MapJobData<Map>*)data;
+
+	u32 random = job.seed;
+
+	for(u32 i = 0; i < NUM_OPERATIONS_PER_THREAD; i++)
+	{
+		u32 r = xorshift(random);
+
+		if(i % job.write_period == 0)
+		{
+			u32 key = NUM_STABLE_KEYS + r % NUM_VOLATILE_KEYS;
+
+			if(r & 0x80000000)
+				job.map->insert(key, getValue(key));
+			else
+				job.map->remove(key);
+
+			job.num_writes++;
+		}
+		else
+		{
+			u32 key   = r % NUM_KEYS;
+			u32 value = job.map->lookup(key, MISSING);
+
+			if(value == MISSING ? key < NUM_STABLE_KEYS : value != getValue(key))
+				job.num_errors++;
+
+			job.checksum += value;
+		}
+	}
+}
+
+template<class Map>
+struct MapRootData
+{
+	MapJobData<Map>* jobs;
+	u32              num_jobs;
+};
+
+template<class Map>
+static void mapRootJob(JobId id, void* data)
+{
+	MapRootData<Map>& root = *(MapRootData<Map>*)data;
+
+	JobManager& jobs = JobManager::get();
+
+	for(u32 i = 0; i < root.num_jobs; i++)
+		jobs.addJob(mapJob<Map>, &root.jobs[i], JobManager::NULL_JOB, id);
+}
+
+//Result names must outlive the results
+static std::deque<std::string> result_names;
+
+template<class Map>
+static void run(const benchmark::Options& options, const char* map_name, const char* scenario, u32 write_period,
+				u32 num_threads, void* memory)
+{
+	JobManager& jobs = JobManager::get();
+
+	MapJobData<Map>* job_data = (MapJobData<Map>*)malloc(num_threads * sizeof(MapJobData<Map>));
+
+	double best_seconds = 0.0;
+	u64    num_writes   = 0;
+	u32    num_errors   = 0;
+	u32    num_rebuilds = 0;
+	u32    checksum     = 0;
+
+	for(u32 r = 0; r < options.repetitions; r++)
+	{
+		FreeListAllocator allocator(HEAP_SIZE, memory);
+
+		{
+			Map map(allocator);
+
+			//Stable keys and half of the volatile keys
+			for(u32 i = 0; i < NUM_STABLE_KEYS + NUM_VOLATILE_KEYS / 2; i++)
+				map.insert(i, getValue(i));
+
+			for(u32 i = 0; i < num_threads; i++)
+			{
+				job_data[i].map          = &map;
+				job_data[i].seed         = SEED + i;
+				job_data[i].write_period = write_period;
+				job_data[i].num_writes   = 0;
+				job_data[i].num_errors   = 0;
+				job_data[i].checksum     = 0;
+			}
+
+			MapRootData<Map> root = { job_data, num_threads };
+
+			double start = benchmark::getTime();
+
+			jobs.wait(jobs.addJob(mapRootJob<Map>, &root));
+
+			double seconds = benchmark::getTime() - start;
+
+			num_writes = 0;
+			checksum   = 0;
+
+			for(u32 i = 0; i < num_threads; i++)
+			{
+				num_writes += job_data[i].num_writes;
+				num_errors += job_data[i].num_errors;
+				checksum   += job_data[i].checksum;
+			}
+
+			//Final state must be consistent
+			u32 num_found = 0;
+
+			for(u32 i = 0; i < NUM_KEYS; i++)
+			{
+				if(map.has(i))
+					num_found++;
+				else if(i < NUM_STABLE_KEYS)
+					num_errors++;
+			}
+
+			if(num_found != map.size())
+				num_errors++;
+
+			num_rebuilds = map.getNumRebuilds();
+
+			if(r == 0 || seconds < best_seconds)
+				best_seconds = seconds;
+		}
+	}
+
+	result_names.push_back(std::string(map_name) + "_" + scenario);
+
+	benchmark::Result result("concurrent_maps", result_names.back().c_str(), num_threads,
+							 (u64)num_threads * NUM_OPERATIONS_PER_THREAD, best_seconds);
+	result.addMetric("errors", num_errors); //every repetition
+	result.addMetric("writes", (double)num_writes);
+	result.addMetric("rebuilds", num_rebuilds);
+	result.addMetric("checksum", checksum); //keeps lookups from being optimized away
+
+	benchmark::addResult(result);
+
+	if(num_errors > 0)
+		benchmark::reportFailure(result, "wrong values returned, stable keys lost or size() doesn't match the keys found");
+
+	free(job_data);
+}
+
+void benchmark::runConcurrentHashMapBenchmarks(const Options& options)
+{
+	JobManager& jobs = JobManager::get();
+
+	u32 thread_counts[16];
+	u32 num_thread_counts = benchmark::getThreadCounts(options.max_threads < MAX_NUM_THREADS ? options.max_threads : MAX_NUM_THREADS,
+													   thread_counts, 16);
+
+	void* memory = malloc(HEAP_SIZE);
+
+	for(u32 i = 0; i < num_thread_counts; i++)
+	{
+		u32 num_threads = thread_counts[i];
+
+		JobManagerConfig config;
+		config.num_workers = num_threads;
+
+		jobs.init(config);
+
+		run<ConcurrentHashMap<u32, u32>>(options, "concurrent_hash_map", "read_mostly", READ_MOSTLY_WRITE_PERIOD, num_threads, memory);
+		run<LockedFlatHashMap>(options, "locked_flat_hash_map", "read_mostly", READ_MOSTLY_WRITE_PERIOD, num_threads, memory);
+		run<ConcurrentHashMap<u32, u32>>(options, "concurrent_hash_map", "write_heavy", WRITE_HEAVY_WRITE_PERIOD, num_threads, memory);
+		run<LockedFlatHashMap>(options, "locked_flat_hash_map", "write_heavy", WRITE_HEAVY_WRITE_PERIOD, num_threads, memory);
+	}
+
+	free(memory);
+}
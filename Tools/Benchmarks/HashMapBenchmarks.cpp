@@ -0,0 +1,214 @@
+#include "Benchmark.h"
+
+#include <Core\Allocators\FreeListAllocator.h>
+
+#include <Core\Containers\HashMap.h>
+#include <Core\Containers\FlatHashMap.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+
+using namespace aqua;
+
+//HashMap vs FlatHashMap with the key/value types the component managers use (entity id -> instance index).
+//Keys look like entity ids: dense indices with a few generation bits set, inserted and looked up in random order.
+//	- insert:      insert every key in an empty map (includes growing)
+//	- lookup_hit:  lookup every key
+//	- lookup_batch: lookup_hit with lookupBatch (prefetches the buckets of several keys before resolving them)
+//	- lookup_miss: lookup keys that aren't in the map (same indices, different generation), at most MAX_NUM_MISSES
+//	  because HashMap scans every bucket once tombstones fill the empty ones
+//	- erase:       remove every key
+//	- churn:       remove a random key and insert a new one (entities being destroyed and created, leaves tombstones)
+//memory_kb = allocator memory used by the map after inserting every key
+
+static const size_t HEAP_SIZE  = 256 * 1024 * 1024;
+
+static const u32    SIZES[]    = { 1024, 16 * 1024, 256 * 1024 };
+static const u32    NUM_SIZES  = sizeof(SIZES) / sizeof(u32);
+
+static const u32    MAX_NUM_MISSES = 16 * 1024;
+
+static const u32    SEED       = 0x9E3779B9;
+
+static const u32    NUM_INDEX_BITS = 24;
+
+static u32 xorshift(u32& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+
+	return state;
+}
+
+static u32* createKeys(u32 num_keys, u32 generation)
+{
+	u32* keys = (u32*)malloc(num_keys * sizeof(u32));
+
+	for(u32 i = 0; i < num_keys; i++)
+		keys[i] = (((generation + i % 3) & 0xFF) << NUM_INDEX_BITS) | i;
+
+	return keys;
+}
+
+static void shuffle(u32* keys, u32 num_keys, u32 seed)
+{
+	u32 random = seed;
+
+	for(u32 i = num_keys - 1; i > 0; i--)
+	{
+		u32 j = xorshift(random) % (i + 1);
+
+		u32 temp = keys[i];
+		keys[i]  = keys[j];
+		keys[j]  = temp;
+	}
+}
+
+//Result names must outlive the results
+static std::deque<std::string> result_names;
+
+static void addResult(const char* map_name, const char* operation, u32 num_keys, u64 num_operations, double seconds,
+					  double memory_kb, u64 checksum)
+{
+	result_names.push_back(std::string(map_name) + "_" + operation + "_" + std::to_string(num_keys));
+
+	benchmark::Result result("hash_maps", result_names.back().c_str(), 1, num_operations, seconds);
+	result.addMetric("memory_kb", memory_kb);
+	result.addMetric("checksum", (double)checksum); //keeps lookups from being optimized away
+
+	benchmark::addResult(result);
+}
+
+template<class Map>
+static void run(const benchmark::Options& options, const char* map_name, u32 num_keys)
+{
+	void* memory = malloc(HEAP_SIZE);
+
+	u32* initial_keys = createKeys(num_keys, 1);
+	u32* keys         = (u32*)malloc(num_keys * sizeof(u32));
+	u32* lookup_keys  = createKeys(num_keys, 1);
+	u32* miss_keys    = createKeys(num_keys, 7);
+	u32* values       = (u32*)malloc(num_keys * sizeof(u32));
+
+	shuffle(initial_keys, num_keys, SEED);
+	shuffle(lookup_keys, num_keys, SEED * 3);
+	shuffle(miss_keys, num_keys, SEED * 5);
+
+	double best_insert = 0.0, best_hit = 0.0, best_batch = 0.0, best_miss = 0.0, best_erase = 0.0, best_churn = 0.0;
+	u64    hit_sum     = 0,   batch_sum = 0,  miss_sum = 0,   churn_sum = 0;
+	double memory_kb   = 0.0;
+
+	u32 num_misses = num_keys < MAX_NUM_MISSES ? num_keys : MAX_NUM_MISSES;
+
+	for(u32 r = 0; r < options.repetitions; r++)
+	{
+		//Churn changes the keys
+		memcpy(keys, initial_keys, num_keys * sizeof(u32));
+
+		FreeListAllocator allocator(HEAP_SIZE, memory);
+
+		{
+			Map map(allocator);
+
+			//Insert
+			double start = benchmark::getTime();
+
+			for(u32 i = 0; i < num_keys; i++)
+				map.insert(keys[i], i);
+
+			double insert_time = benchmark::getTime() - start;
+
+			memory_kb = allocator.getUsedMemory() / 1024.0;
+
+			//Lookup hit
+			hit_sum = 0;
+			start   = benchmark::getTime();
+
+			for(u32 i = 0; i < num_keys; i++)
+				hit_sum += map.lookup(lookup_keys[i], UINT32_MAX);
+
+			double hit_time = benchmark::getTime() - start;
+
+			//Lookup batch
+			batch_sum = 0;
+			start     = benchmark::getTime();
+
+			map.lookupBatch(lookup_keys, num_keys, values, UINT32_MAX);
+
+			for(u32 i = 0; i < num_keys; i++)
+				batch_sum += values[i];
+
+			double batch_time = benchmark::getTime() - start;
+
+			//Lookup miss
+			miss_sum = 0;
+			start    = benchmark::getTime();
+
+			for(u32 i = 0; i < num_misses; i++)
+				miss_sum += map.lookup(miss_keys[i], 1);
+
+			double miss_time = benchmark::getTime() - start;
+
+			//Churn: every keys[j] is in the map, replace it with a key with the next generation
+			u32 random = SEED;
+			churn_sum  = 0;
+			start      = benchmark::getTime();
+
+			for(u32 i = 0; i < num_keys; i++)
+			{
+				u32 j = xorshift(random) % num_keys;
+
+				map.remove(keys[j]);
+
+				keys[j] += 1 << NUM_INDEX_BITS;
+
+				map.insert(keys[j], j);
+
+				churn_sum += map.lookup(keys[(j + 1) % num_keys], 0);
+			}
+
+			double churn_time = benchmark::getTime() - start;
+
+			//Erase
+			start = benchmark::getTime();
+
+			for(u32 i = 0; i < num_keys; i++)
+				map.remove(keys[i]);
+
+			double erase_time = benchmark::getTime() - start;
+
+			if(r == 0 || insert_time < best_insert) best_insert = insert_time;
+			if(r == 0 || hit_time < best_hit)       best_hit    = hit_time;
+			if(r == 0 || batch_time < best_batch)   best_batch  = batch_time;
+			if(r == 0 || miss_time < best_miss)     best_miss   = miss_time;
+			if(r == 0 || churn_time < best_churn)   best_churn  = churn_time;
+			if(r == 0 || erase_time < best_erase)   best_erase  = erase_time;
+		}
+	}
+
+	addResult(map_name, "insert", num_keys, num_keys, best_insert, memory_kb, 0);
+	addResult(map_name, "lookup_hit", num_keys, num_keys, best_hit, memory_kb, hit_sum);
+	addResult(map_name, "lookup_batch", num_keys, num_keys, best_batch, memory_kb, batch_sum);
+	addResult(map_name, "lookup_miss", num_keys, num_misses, best_miss, memory_kb, miss_sum);
+	addResult(map_name, "churn", num_keys, num_keys, best_churn, memory_kb, churn_sum);
+	addResult(map_name, "erase", num_keys, num_keys, best_erase, memory_kb, 0);
+
+	free(values);
+	free(miss_keys);
+	free(lookup_keys);
+	free(keys);
+	free(initial_keys);
+	free(memory);
+}
+
+void benchmark::runHashMapBenchmarks(const Options& options)
+{
+	for(u32 i = 0; i < NUM_SIZES; i++)
+	{
+		run<HashMap<u32, u32>>(options, "hash_map", SIZES[i]);
+		run<FlatHashMap<u32, u32>>(options, "flat_hash_map", SIZES[i]);
+	}
+}
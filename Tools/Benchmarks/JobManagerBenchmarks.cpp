@@ -0,0 +1,255 @@
+#include "Benchmark.h"
+
+#include <Core\JobManager.h>
+#include <Core\Timer.h>
+
+using namespace aqua;
+
+//Each scenario returns the number of jobs it ran.
+//Results are reported for 1, 2, 4, ..., N workers (the thread calling wait helps too).
+//efficiency = time per job with 1 worker / (time per job with N workers * N)
+//steals_per_s/failed_steals_per_s = jobs taken from other workers' queues and steal attempts that found nothing
+//(empty queue or lost race) per second, for the best run
+//wait_spin_share = fraction of worker time spent yielding in wait with nothing to run. Only the *_spin scenarios
+//(JobManagerConfig::spin_waits, the wait used before jobs were suspended on fibers) spin, the others show it's gone
+
+static const u32 NUM_SPAWN_JOBS     = 100000;
+static const u32 CHAIN_LENGTH       = 20000;
+static const u32 FAN_WIDTH          = 256;     //FAN_WIDTH children with FAN_WIDTH children each
+static const u32 NUM_NESTED_JOBS    = 64;
+static const u32 NUM_NESTED_WAITS   = 64;      //pairs of children waited for in each nested job
+static const u32 MIXED_BATCH_SIZE   = 256;
+static const u32 NUM_MIXED_BATCHES  = 40;      //of 4 batches (critical, normal, background, normal)
+static const u32 MIXED_JOB_WORK     = 256;     //iterations of busy work in each mixed and nested child job
+
+static void emptyJob(JobId id, void* data)
+{}
+
+static void workJob(JobId id, void* data)
+{
+	volatile u32 x = 0;
+
+	for(u32 i = 0; i < MIXED_JOB_WORK; i++)
+		x = x * 31 + i;
+}
+
+//Spawn: a single job adds empty jobs as its children one by one
+static void spawnRootJob(JobId id, void* data)
+{
+	JobManager& jobs = JobManager::get();
+
+	for(u32 i = 0; i < NUM_SPAWN_JOBS; i++)
+		jobs.addJob(emptyJob, nullptr, JobManager::NULL_JOB, id);
+}
+
+static u64 runSpawn()
+{
+	JobManager& jobs = JobManager::get();
+
+	jobs.wait(jobs.addJob(spawnRootJob, nullptr));
+
+	return NUM_SPAWN_JOBS + 1;
+}
+
+//Chain: every job depends on the previous one
+static u64 runChain()
+{
+	JobManager& jobs = JobManager::get();
+
+	JobId previous = JobManager::NULL_JOB;
+
+	for(u32 i = 0; i < CHAIN_LENGTH; i++)
+		previous = jobs.addJob(emptyJob, nullptr, previous);
+
+	jobs.wait(previous);
+
+	return CHAIN_LENGTH;
+}
+
+//Fan-out/fan-in: two levels of children and a job that depends on the root
+static void fanMiddleJob(JobId id, void* data)
+{
+	JobManager& jobs = JobManager::get();
+
+	for(u32 i = 0; i < FAN_WIDTH; i++)
+		jobs.addJob(emptyJob, nullptr, JobManager::NULL_JOB, id);
+}
+
+static void fanRootJob(JobId id, void* data)
+{
+	JobManager& jobs = JobManager::get();
+
+	for(u32 i = 0; i < FAN_WIDTH; i++)
+		jobs.addJob(fanMiddleJob, nullptr, JobManager::NULL_JOB, id);
+}
+
+static u64 runFan()
+{
+	JobManager& jobs = JobManager::get();
+
+	JobId root   = jobs.addJob(fanRootJob, nullptr);
+	JobId fan_in = jobs.addJob(emptyJob, nullptr, root);
+
+	jobs.wait(fan_in);
+
+	return 1 + FAN_WIDTH + FAN_WIDTH * FAN_WIDTH + 1;
+}
+
+//Nested wait: jobs that repeatedly add two children and wait for them (suspends the job's fiber, or spins in
+//nested_wait_spin when the other child was stolen and is still running)
+static void nestedJob(JobId id, void* data)
+{
+	JobManager& jobs = JobManager::get();
+
+	for(u32 i = 0; i < NUM_NESTED_WAITS; i++)
+	{
+		JobId a = jobs.addJob(workJob, nullptr);
+		JobId b = jobs.addJob(workJob, nullptr);
+
+		jobs.wait(b);
+		jobs.wait(a);
+	}
+}
+
+static void nestedRootJob(JobId id, void* data)
+{
+	JobManager& jobs = JobManager::get();
+
+	for(u32 i = 0; i < NUM_NESTED_JOBS; i++)
+		jobs.addJob(nestedJob, nullptr, JobManager::NULL_JOB, id);
+}
+
+static u64 runNestedWait()
+{
+	JobManager& jobs = JobManager::get();
+
+	jobs.wait(jobs.addJob(nestedRootJob, nullptr));
+
+	return 1 + NUM_NESTED_JOBS * (1 + 2 * NUM_NESTED_WAITS);
+}
+
+//Mixed priorities: small jobs in every lane (1/4 critical, 1/2 normal, 1/4 background) added in batches
+static void mixedRootJob(JobId id, void* data)
+{
+	JobManager& jobs = JobManager::get();
+
+	JobDesc batch[MIXED_BATCH_SIZE];
+
+	for(u32 i = 0; i < MIXED_BATCH_SIZE; i++)
+	{
+		batch[i].func = workJob;
+		batch[i].data = nullptr;
+	}
+
+	for(u32 i = 0; i < NUM_MIXED_BATCHES; i++)
+	{
+		jobs.addJobs(MIXED_BATCH_SIZE, batch, nullptr, id, JobLane::CRITICAL);
+		jobs.addJobs(MIXED_BATCH_SIZE, batch, nullptr, id, JobLane::NORMAL);
+		jobs.addJobs(MIXED_BATCH_SIZE, batch, nullptr, id, JobLane::BACKGROUND);
+		jobs.addJobs(MIXED_BATCH_SIZE, batch, nullptr, id, JobLane::NORMAL);
+	}
+}
+
+static u64 runMixed()
+{
+	JobManager& jobs = JobManager::get();
+
+	jobs.wait(jobs.addJob(mixedRootJob, nullptr));
+
+	return 1 + NUM_MIXED_BATCHES * 4 * MIXED_BATCH_SIZE;
+}
+
+struct Scenario
+{
+	const char* name;
+	u64         (*run)();
+	bool        spin_waits;
+};
+
+static const Scenario SCENARIOS[] =
+{
+	{ "spawn",            runSpawn,      false },
+	{ "chain",            runChain,      false },
+	{ "fan_out_in",       runFan,        false },
+	{ "nested_wait",      runNestedWait, false },
+	{ "nested_wait_spin", runNestedWait, true },
+	{ "mixed_lanes",      runMixed,      false },
+};
+
+static const u32 NUM_SCENARIOS = sizeof(SCENARIOS) / sizeof(Scenario);
+
+void benchmark::runJobManagerBenchmarks(const Options& options)
+{
+	JobManager& jobs = JobManager::get();
+
+	u32 worker_counts[16];
+	u32 num_worker_counts = getThreadCounts(options.max_threads, worker_counts, 16);
+
+	double single_worker_ns[NUM_SCENARIOS];
+
+	double ticks_per_second = (double)Timer::getTicksPerSecond();
+
+	for(u32 i = 0; i < num_worker_counts; i++)
+	{
+		//Scenarios that spin in wait run after restarting the workers with spin_waits
+		for(u32 spin_waits = 0; spin_waits < 2; spin_waits++)
+		{
+			JobManagerConfig config;
+			config.num_workers = worker_counts[i];
+			config.spin_waits  = spin_waits != 0;
+
+			jobs.init(config);
+
+			for(u32 j = 0; j < NUM_SCENARIOS; j++)
+			{
+				const Scenario& scenario = SCENARIOS[j];
+
+				if(scenario.spin_waits != config.spin_waits)
+					continue;
+
+				//Warm up (grows the job pool and the fiber pool)
+				scenario.run();
+
+				double best            = 0.0;
+				u64    num_jobs        = 0;
+				u64    wait_spin_ticks = 0;
+				u64    num_steals      = 0;
+				u64    num_failed      = 0;
+
+				for(u32 k = 0; k < options.repetitions; k++)
+				{
+					JobManagerStats before = jobs.getStats();
+
+					double start = getTime();
+					num_jobs     = scenario.run();
+					double time  = getTime() - start;
+
+					JobManagerStats after = jobs.getStats();
+
+					if(k == 0 || time < best)
+					{
+						best            = time;
+						wait_spin_ticks = after.wait_spin_ticks - before.wait_spin_ticks;
+						num_steals      = after.num_jobs_stolen - before.num_jobs_stolen;
+						num_failed      = after.num_failed_steals - before.num_failed_steals;
+					}
+				}
+
+				double ns_per_job = best * 1e9 / num_jobs;
+
+				if(i == 0)
+					single_worker_ns[j] = ns_per_job;
+
+				Result result("job_manager", scenario.name, jobs.getNumWorkers(), num_jobs, best);
+				result.addMetric("efficiency", single_worker_ns[j] / (ns_per_job * jobs.getNumWorkers()));
+				result.addMetric("steals_per_s", num_steals / best);
+				result.addMetric("failed_steals_per_s", num_failed / best);
+				result.addMetric("wait_spin_share", wait_spin_ticks / ticks_per_second / (best * jobs.getNumWorkers()));
+
+				addResult(result);
+			}
+		}
+	}
+
+	jobs.init(JobManagerConfig());
+}
@@ -0,0 +1,362 @@
+#include "Benchmark.h"
+
+#include <Core\Allocators\FreeListAllocator.h>
+
+#include <Core\Containers\ConcurrentQueue.h>
+#include <Core\Containers\Queue.h>
+
+#include <Core\JobManager.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace aqua;
+
+//Throughput of the queues used to pass work between threads: MPMCQueue, SPSCQueue and Queue<T> behind a mutex
+//(bounded to the same capacity). NUM_ITEMS items go through the queue in every run:
+//	- 1 thread: push half the capacity, pop it, repeat (uncontended cost of push + pop)
+//	- N threads: N / 2 producer jobs and N - N / 2 consumer jobs (SPSCQueue only with 1 producer and 1 consumer).
+//	  Producers retry when the queue is full, consumers when it's empty
+//Items are (producer << 32) | sequence, errors counts items of a producer popped out of order by a consumer and
+//items lost or duplicated (sum of popped items != sum of pushed items). Any error fails the run.
+//ops = items, full_retries = failed pushes
+
+static const size_t HEAP_SIZE       = 16 * 1024 * 1024;
+
+static const u32    MAX_NUM_THREADS = 64;
+
+static const u32    QUEUE_CAPACITY  = 1024;
+
+static const u32    NUM_ITEMS       = 1024 * 1024;
+
+//Consumers add their pops to the shared counter in batches
+static const u32    POP_FLUSH_SIZE  = 64;
+
+class LockedQueue
+{
+public:
+	LockedQueue(Allocator& allocator, size_t capacity) : _queue(allocator), _capacity(capacity)
+	{
+		_queue.reserve(capacity);
+	}
+
+	bool tryPush(const u64& value)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if(_queue.size() == _capacity)
+			return false;
+
+		_queue.push(value);
+
+		return true;
+	}
+
+	bool tryPop(u64& out)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if(_queue.empty())
+			return false;
+
+		out = _queue.front();
+		_queue.pop();
+
+		return true;
+	}
+
+private:
+	Queue<u64> _queue;
+	size_t     _capacity;
+	std::mutex _mutex;
+};
+
+template<class Queue>
+struct QueueJobData
+{
+	Queue*            queue;
+	u32               producer;      //producer index, or UINT32_MAX for consumers
+	u32               num_items;     //pushed by a producer
+	std::atomic<u32>* num_popped;    //by every consumer
+	u32               num_producers;
+	u32               num_errors;
+	u64               num_retries;
+	u64               sum;
+	u32               next_sequence[MAX_NUM_THREADS]; //min sequence expected from every producer
+};
+
+template<class Queue>
+static void producerJob(QueueJobData<Queue>& job)
+{
+	u64 producer = (u64)job.producer << 32;
+
+	for(u32 i = 0; i < job.num_items; i++)
+	{
+		while(!job.queue->tryPush(producer | i))
+		{
+			job.num_retries++;
+			std::this_thread::yield();
+		}
+	}
+}
+
+template<class Queue>
+static void consumerJob(QueueJobData<Queue>& job)
+{
+	for(u32 i = 0; i < job.num_producers; i++)
+		job.next_sequence[i] = 0;
+
+	u32 num_popped = 0;
+
+	while(true)
+	{
+		u64 value;
+
+		if(job.queue->tryPop(value))
+		{
+			u32 producer = (u32)(value >> 32);
+			u32 sequence = (u32)value;
+
+			if(producer >= job.num_producers || sequence < job.next_sequence[producer])
+				job.num_errors++;
+			else
+				job.next_sequence[producer] = sequence + 1;
+
+			job.sum += value;
+
+			if(++num_popped == POP_FLUSH_SIZE)
+			{
+				job.num_popped->fetch_add(num_popped, std::memory_order_relaxed);
+				num_popped = 0;
+			}
+		}
+		else
+		{
+			job.num_popped->fetch_add(num_popped, std::memory_order_relaxed);
+			num_popped = 0;
+
+			if(job.num_popped->load(std::memory_order_relaxed) >= NUM_ITEMS)
+				break;
+
+			std::this_thread::yield();
+		}
+	}
+}
+
+template<class Queue>
+static void queueJob(JobId id, void* data)
+{
+	QueueJobData<Queue>& job = *(QueueJobData<Queue>*)data;
+
+	if(job.producer != UINT32_MAX)
+		producerJob(job);
+	else
+		consumerJob(job);
+}
+
+template<class Queue>
+struct QueueRootData
+{
+	QueueJobData<Queue>* jobs;
+	u32                  num_jobs;
+};
+
+template<class Queue>
+static void queueRootJob(JobId id, void* data)
+{
+	QueueRootData<Queue>& root = *(QueueRootData<Queue>*)data;
+
+	JobManager& jobs = JobManager::get();
+
+	for(u32 i = 0; i < root.num_jobs; i++)
+		jobs.addJob(queueJob<Queue>, &root.jobs[i], JobManager::NULL_JOB, id);
+}
+
+//Result names must outlive the results
+static std::deque<std::string> result_names;
+
+static void addResult(const char* queue_name, u32 num_threads, double seconds, u32 num_producers, u32 num_consumers,
+					  u32 num_errors, u64 num_retries)
+{
+	result_names.push_back(queue_name);
+
+	benchmark::Result result("queues", result_names.back().c_str(), num_threads, NUM_ITEMS, seconds);
+	result.addMetric("producers", num_producers);
+	result.addMetric("consumers", num_consumers);
+	result.addMetric("errors", num_errors); //every repetition
+	result.addMetric("full_retries", (double)num_retries);
+
+	benchmark::addResult(result);
+
+	if(num_errors > 0)
+		benchmark::reportFailure(result, "items popped out of order, lost or duplicated");
+}
+
+template<class Queue>
+static void runSingleThread(const benchmark::Options& options, const char* queue_name, void* memory)
+{
+	double best_seconds = 0.0;
+	u32    num_errors   = 0;
+
+	for(u32 r = 0; r < options.repetitions; r++)
+	{
+		FreeListAllocator allocator(HEAP_SIZE, memory);
+
+		{
+			Queue queue(allocator, QUEUE_CAPACITY);
+
+			u64 sum = 0;
+
+			double start = benchmark::getTime();
+
+			for(u32 i = 0; i < NUM_ITEMS; i += QUEUE_CAPACITY / 2)
+			{
+				for(u32 j = 0; j < QUEUE_CAPACITY / 2; j++)
+				{
+					if(!queue.tryPush(i + j))
+						num_errors++;
+				}
+
+				for(u32 j = 0; j < QUEUE_CAPACITY / 2; j++)
+				{
+					u64 value;
+
+					if(!queue.tryPop(value) || value != i + j)
+						num_errors++;
+
+					sum += value;
+				}
+			}
+
+			double seconds = benchmark::getTime() - start;
+
+			if(sum != (u64)NUM_ITEMS * (NUM_ITEMS - 1) / 2)
+				num_errors++;
+
+			if(r == 0 || seconds < best_seconds)
+				best_seconds = seconds;
+		}
+	}
+
+	addResult(queue_name, 1, best_seconds, 1, 1, num_errors, 0);
+}
+
+template<class Queue>
+static void runMultithreaded(const benchmark::Options& options, const char* queue_name, u32 num_threads, void* memory)
+{
+	JobManager& jobs = JobManager::get();
+
+	u32 num_producers = num_threads / 2;
+	u32 num_consumers = num_threads - num_producers;
+
+	QueueJobData<Queue>* job_data = (QueueJobData<Queue>*)malloc(num_threads * sizeof(QueueJobData<Queue>));
+
+	//Sum of every item pushed
+	u64 expected_sum = 0;
+
+	for(u32 i = 0; i < num_producers; i++)
+	{
+		u64 num_items = NUM_ITEMS / num_producers + (i < NUM_ITEMS % num_producers ? 1 : 0);
+
+		expected_sum += ((u64)i << 32) * num_items + num_items * (num_items - 1) / 2;
+	}
+
+	double best_seconds = 0.0;
+	u32    num_errors   = 0;
+	u64    num_retries  = 0;
+
+	for(u32 r = 0; r < options.repetitions; r++)
+	{
+		FreeListAllocator allocator(HEAP_SIZE, memory);
+
+		{
+			Queue queue(allocator, QUEUE_CAPACITY);
+
+			std::atomic<u32> num_popped(0);
+
+			for(u32 i = 0; i < num_threads; i++)
+			{
+				QueueJobData<Queue>& job = job_data[i];
+
+				job.queue         = &queue;
+				job.producer      = i < num_producers ? i : UINT32_MAX;
+				job.num_items     = i < num_producers ? NUM_ITEMS / num_producers + (i < NUM_ITEMS % num_producers ? 1 : 0) : 0;
+				job.num_popped    = &num_popped;
+				job.num_producers = num_producers;
+				job.num_errors    = 0;
+				job.num_retries   = 0;
+				job.sum           = 0;
+			}
+
+			QueueRootData<Queue> root = { job_data, num_threads };
+
+			double start = benchmark::getTime();
+
+			jobs.wait(jobs.addJob(queueRootJob<Queue>, &root));
+
+			double seconds = benchmark::getTime() - start;
+
+			u64 sum = 0;
+			num_retries = 0;
+
+			for(u32 i = 0; i < num_threads; i++)
+			{
+				num_errors  += job_data[i].num_errors;
+				num_retries += job_data[i].num_retries;
+				sum         += job_data[i].sum;
+			}
+
+			if(sum != expected_sum)
+				num_errors++;
+
+			if(r == 0 || seconds < best_seconds)
+				best_seconds = seconds;
+		}
+	}
+
+	addResult(queue_name, num_threads, best_seconds, num_producers, num_consumers, num_errors, num_retries);
+
+	free(job_data);
+}
+
+void benchmark::runQueueBenchmarks(const Options& options)
+{
+	JobManager& jobs = JobManager::get();
+
+	void* memory = malloc(HEAP_SIZE);
+
+	runSingleThread<MPMCQueue<u64>>(options, "mpmc_queue", memory);
+	runSingleThread<SPSCQueue<u64>>(options, "spsc_queue", memory);
+	runSingleThread<LockedQueue>(options, "locked_queue", memory);
+
+	u32 thread_counts[16];
+	u32 num_thread_counts = benchmark::getThreadCounts(options.max_threads < MAX_NUM_THREADS ? options.max_threads : MAX_NUM_THREADS,
+													   thread_counts, 16);
+
+	for(u32 i = 0; i < num_thread_counts; i++)
+	{
+		u32 num_threads = thread_counts[i];
+
+		//Producers and consumers wait for each other, every job needs its own worker
+		if(num_threads < 2)
+			continue;
+
+		JobManagerConfig config;
+		config.num_workers = num_threads;
+
+		jobs.init(config);
+
+		runMultithreaded<MPMCQueue<u64>>(options, "mpmc_queue", num_threads, memory);
+
+		if(num_threads == 2)
+			runMultithreaded<SPSCQueue<u64>>(options, "spsc_queue", num_threads, memory);
+
+		runMultithreaded<LockedQueue>(options, "locked_queue", num_threads, memory);
+	}
+
+	free(memory);
+}
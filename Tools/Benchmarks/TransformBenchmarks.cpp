@@ -0,0 +1,152 @@
+#include "Benchmark.h"
+
+#include <Core\Allocators\FreeListAllocator.h>
+#include <Core\Allocators\HugePageAllocator.h>
+
+#include <Components\EntityManager.h>
+#include <Components\TransformManager.h>
+
+#include <cstdlib>
+
+using namespace aqua;
+
+//TransformManager update over NUM_INSTANCES with its SoA data in a HugePageAllocator using large pages and using
+//normal pages (TransformManager's data_allocator).
+//Instances are split in hierarchies of ~NUM_INSTANCES / NUM_HIERARCHIES instances, every instance joins a random
+//hierarchy so parents and children are all over the buffer (TLB misses). An update calls transform() on every root
+//(which updates the children recursively).
+//With transparent huge pages set to "always" the normal pages run can also get huge pages, check large_page_coverage.
+
+static const u32    NUM_INSTANCES   = 1024 * 1024;
+static const u32    NUM_HIERARCHIES = NUM_INSTANCES / 64;
+static const u32    NUM_UPDATES     = 4;
+static const u32    SEED            = 0x2545F491;
+
+static const size_t HEAP_SIZE       = 64 * 1024 * 1024;  //entities, entity map
+static const size_t ARENA_SIZE      = 1024ULL * 1024 * 1024;
+
+typedef TransformManager::Instance Instance;
+
+static u32 xorshift(u32& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+
+	return state;
+}
+
+//Returns the number of roots written to out (at most NUM_HIERARCHIES)
+static u32 createInstances(EntityManager& entities, TransformManager& transforms, Instance* out_roots)
+{
+	//Root and last instance added of each hierarchy
+	Instance* root = (Instance*)malloc(NUM_HIERARCHIES * sizeof(Instance));
+	Instance* last = (Instance*)malloc(NUM_HIERARCHIES * sizeof(Instance));
+
+	for(u32 i = 0; i < NUM_HIERARCHIES; i++)
+	{
+		root[i] = TransformManager::INVALID_INSTANCE;
+		last[i] = TransformManager::INVALID_INSTANCE;
+	}
+
+	u32 num_roots = 0;
+	u32 random    = SEED;
+
+	for(u32 i = 0; i < NUM_INSTANCES; i++)
+	{
+		u32 r         = xorshift(random);
+		u32 hierarchy = r % NUM_HIERARCHIES;
+
+		Instance instance = transforms.create(entities.create());
+
+		transforms.setLocal(instance, Vector3((float)(r & 0xFF), 1.0f, 2.0f),
+							Quaternion(0.0f, 0.38268343f, 0.0f, 0.92387953f), //45 degrees around y
+							Vector3(1.0f, 1.0f, 1.0f));
+
+		if(!root[hierarchy].valid())
+		{
+			root[hierarchy]        = instance;
+			out_roots[num_roots++] = instance;
+		}
+		else
+		{
+			//Parent is the hierarchy's root or its last instance (deeper hierarchies)
+			transforms.setParent(instance, (r & 0x100) ? root[hierarchy] : last[hierarchy]);
+		}
+
+		last[hierarchy] = instance;
+
+		//Only the update is measured
+		transforms.clearModifiedTransforms();
+	}
+
+	free(root);
+	free(last);
+
+	return num_roots;
+}
+
+static void runUpdate(const benchmark::Options& options, const char* name, bool use_large_pages, void* memory)
+{
+	FreeListAllocator allocator(HEAP_SIZE, memory);
+	HugePageAllocator data_allocator(ARENA_SIZE, use_large_pages);
+
+	HugePageAllocatorStats stats;
+
+	double best = 0.0;
+
+	{
+		EntityManager     entities(allocator);
+		TransformManager* transforms = allocator::allocateNew<TransformManager>(allocator, allocator, NUM_INSTANCES,
+																				&data_allocator);
+
+		Instance* roots     = (Instance*)malloc(NUM_HIERARCHIES * sizeof(Instance));
+		u32       num_roots = createInstances(entities, *transforms, roots);
+
+		for(u32 i = 0; i < options.repetitions; i++)
+		{
+			double start = benchmark::getTime();
+
+			for(u32 j = 0; j < NUM_UPDATES; j++)
+			{
+				for(u32 k = 0; k < num_roots; k++)
+				{
+					transforms->transform(roots[k]);
+
+					//Modified list only has room for a few hierarchies (a frame would consume it here)
+					transforms->clearModifiedTransforms();
+				}
+			}
+
+			double time = benchmark::getTime() - start;
+
+			if(i == 0 || time < best)
+				best = time;
+		}
+
+		stats = data_allocator.getStats();
+
+		free(roots);
+
+		allocator::deallocateDelete(allocator, transforms);
+	}
+
+	double coverage = stats.mapped_size > 0 ? (double)stats.large_page_backed_size / stats.mapped_size : 0.0;
+
+	benchmark::Result result("transforms", name, 1, (u64)NUM_UPDATES * NUM_INSTANCES, best);
+	result.addMetric("large_page_coverage", coverage);
+	result.addMetric("locked_large_pages", stats.num_large_page_allocations);
+	result.addMetric("buffer_mb", stats.mapped_size / (1024.0 * 1024.0));
+
+	benchmark::addResult(result);
+}
+
+void benchmark::runTransformBenchmarks(const Options& options)
+{
+	void* memory = malloc(HEAP_SIZE);
+
+	runUpdate(options, "transform_update_1m_small_pages", false, memory);
+	runUpdate(options, "transform_update_1m_huge_pages", true, memory);
+
+	free(memory);
+}
@@ -0,0 +1,89 @@
+#include "Benchmark.h"
+
+#include <Core\JobManager.h>
+
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+
+//Headless micro benchmarks. Results are written as JSON (stdout or -o file) so they can be compared across commits,
+//progress is written to stderr.
+//Exits with 2 if a suite that doubles as a stress test reported a failure (benchmark::reportFailure).
+//
+//Usage: Benchmarks [-s suite] [-t max_threads] [-r repetitions] [-o output.json]
+
+using namespace aqua;
+
+struct Suite
+{
+	const char* name;
+	void        (*run)(const benchmark::Options&);
+};
+
+static const Suite SUITES[] =
+{
+	{ "job_manager",     benchmark::runJobManagerBenchmarks },
+	{ "allocators",      benchmark::runAllocatorBenchmarks },
+	{ "transforms",      benchmark::runTransformBenchmarks },
+	{ "hash_maps",       benchmark::runHashMapBenchmarks },
+	{ "concurrent_maps", benchmark::runConcurrentHashMapBenchmarks },
+	{ "queues",          benchmark::runQueueBenchmarks },
+};
+
+static const u32 NUM_SUITES = sizeof(SUITES) / sizeof(Suite);
+
+int main(int argc, char* argv[])
+{
+	benchmark::Options options;
+	options.max_threads = std::thread::hardware_concurrency();
+	options.repetitions = 5;
+	options.suite       = nullptr;
+	options.output      = nullptr;
+
+	for(int i = 1; i + 1 < argc; i += 2)
+	{
+		if(strcmp(argv[i], "-s") == 0)
+			options.suite = argv[i + 1];
+		else if(strcmp(argv[i], "-t") == 0)
+			options.max_threads = atoi(argv[i + 1]);
+		else if(strcmp(argv[i], "-r") == 0)
+			options.repetitions = atoi(argv[i + 1]);
+		else if(strcmp(argv[i], "-o") == 0)
+			options.output = argv[i + 1];
+		else
+		{
+			std::cerr << "Unknown option " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+
+	if(options.max_threads == 0)
+		options.max_threads = 1;
+
+	if(options.repetitions == 0)
+		options.repetitions = 1;
+
+	for(u32 i = 0; i < NUM_SUITES; i++)
+	{
+		if(options.suite == nullptr || strcmp(options.suite, SUITES[i].name) == 0)
+			SUITES[i].run(options);
+	}
+
+	JobManager::get().stop();
+
+	if(!benchmark::writeResults(options.output))
+	{
+		std::cerr << "Error writing " << options.output << std::endl;
+		return 1;
+	}
+
+	//Results are still written so the failing runs can be inspected
+	if(benchmark::getNumFailures() > 0)
+	{
+		std::cerr << benchmark::getNumFailures() << " benchmark(s) failed" << std::endl;
+		return 2;
+	}
+
+	return 0;
+}